@@ -0,0 +1,663 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include <gcs/mem.h>
+#include <gcs/dir.h>
+#include <gcs/gst.h>
+#include <gcs/index.h>
+#include <gcs/cache.h>
+#include <gcs/time.h>
+#include <gcs/readahead.h>
+
+/* generates archives of synthetic chunks and measures how long it
+takes to index them, once without a cache (every chunk is probed)
+and once with the cache the first run left behind, the archives
+are kept so the next run can skip generating them
+
+in `clock` mode it checks that the wall clock range a client sends
+to seek with resolves to the chunk that was recorded at that time
+
+in `readahead` mode it plays files of chunk size with many sessions
+at once, from a cold page cache, once without read-ahead and once
+with, and measures how long the start of every chunk takes to read,
+which is what holds up a switch */
+
+#define DEFAULT_CHUNK_COUNTS { 1000, 10000, 100000, 1000000 }
+#define DEFAULT_CLOCK_CHUNK_COUNT 10000
+#define DEFAULT_READAHEAD_SESSION_COUNT 32
+
+/* chunks every session plays in `readahead` mode, 10 seconds of
+a camera at about 3Mbit/s each, played a lot faster than that, so
+the disk is kept busy by far fewer sessions than in reality */
+#define READAHEAD_CHUNK_COUNT 8
+#define READAHEAD_CHUNK_SIZE (4 * 1024 * 1024)
+#define READAHEAD_PLAY_TIME 200000
+
+/* what a bin reads of a chunk before it can switch to it, the
+header and the first cluster */
+#define READAHEAD_START_SIZE (256 * 1024)
+
+/* chunk-recorder switches files every 10 seconds */
+#define CHUNK_DURATION_SECONDS 10
+
+/* every so many chunks, one is broken or uses the old format */
+#define EMPTY_EVERY 100
+#define TRUNCATED_EVERY 101
+#define OLD_FORMAT_EVERY 50
+#define NO_DURATION_EVERY 10
+
+/* a tiny matroska file is a couple of hundred bytes */
+#define MAX_CHUNK_SIZE 512
+
+typedef struct {
+    uint8_t data[MAX_CHUNK_SIZE];
+    int len;
+} GcsBenchBuffer;
+
+static void
+write_bytes(GcsBenchBuffer *buffer, const void *data, int len)
+{
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+static void
+write_id(GcsBenchBuffer *buffer, uint32_t id)
+{
+    /* id's include their length marker, write the significant bytes */
+    int i;
+    for(i = 3; i >= 0; --i) {
+        uint8_t byte = (uint8_t) (id >> (i * 8));
+        if(byte || (id >> (i * 8)) > 0xFF) {
+            write_bytes(buffer, &byte, 1);
+        }
+    }
+}
+
+static void
+write_size(GcsBenchBuffer *buffer, uint64_t size)
+{
+    /* always use 8 bytes, sizes can then be patched in place */
+    uint8_t data[8];
+    data[0] = 0x01;
+
+    int i;
+    for(i = 1; i < 8; ++i) {
+        data[i] = (uint8_t) (size >> ((7 - i) * 8));
+    }
+
+    write_bytes(buffer, data, sizeof(data));
+}
+
+static void
+write_uint(GcsBenchBuffer *buffer, uint32_t id, uint64_t value)
+{
+    uint8_t data[8];
+
+    int i;
+    for(i = 0; i < 8; ++i) {
+        data[i] = (uint8_t) (value >> ((7 - i) * 8));
+    }
+
+    write_id(buffer, id);
+    write_size(buffer, sizeof(data));
+    write_bytes(buffer, data, sizeof(data));
+}
+
+static void
+write_float(GcsBenchBuffer *buffer, uint32_t id, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_uint(buffer, id, bits);
+}
+
+static int
+begin_master(GcsBenchBuffer *buffer, uint32_t id)
+{
+    write_id(buffer, id);
+    write_size(buffer, 0);
+
+    /* position of the data, the size is patched in end_master */
+    return buffer->len;
+}
+
+static void
+end_master(GcsBenchBuffer *buffer, int start)
+{
+    GcsBenchBuffer size;
+    size.len = 0;
+    write_size(&size, buffer->len - start);
+
+    memcpy(buffer->data + start - size.len, size.data, size.len);
+}
+
+static void
+build_chunk(GcsBenchBuffer *buffer, int with_duration)
+{
+    buffer->len = 0;
+
+    int ebml = begin_master(buffer, 0x1A45DFA3);
+    write_uint(buffer, 0x4282, 0);
+    end_master(buffer, ebml);
+
+    int segment = begin_master(buffer, 0x18538067);
+
+    int info = begin_master(buffer, 0x1549A966);
+    write_uint(buffer, 0x2AD7B1, 1000000);
+
+    if(with_duration) {
+        write_float(buffer, 0x4489, CHUNK_DURATION_SECONDS * 1000.0);
+    }
+
+    end_master(buffer, info);
+
+    /* one cluster with a single block at the end of the chunk,
+    which is what files without a duration are measured by */
+    int cluster = begin_master(buffer, 0x1F43B675);
+    write_uint(buffer, 0xE7, 0);
+
+    uint8_t block[] = { 0x81, 0x27, 0x10, 0x80, 0x00, 0x00, 0x00, 0x01 };
+    write_id(buffer, 0xA3);
+    write_size(buffer, sizeof(block));
+    write_bytes(buffer, block, sizeof(block));
+
+    end_master(buffer, cluster);
+    end_master(buffer, segment);
+}
+
+static int
+write_chunk(const char *path, GcsBenchBuffer *buffer, int len)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file) {
+        return 0;
+    }
+
+    int result = (fwrite(buffer->data, 1, len, file) == (size_t) len);
+    return (fclose(file) == 0) && result;
+}
+
+static int
+generate_archive(const char *directory, int count)
+{
+    if(gcs_dir_exists((char *) directory)) {
+        printf("[inf] using existing archive '%s'\n", directory);
+        return 1;
+    }
+
+    printf("[inf] generating %i chunks in '%s'\n", count, directory);
+
+    char temp_directory[PATH_MAX];
+    snprintf(temp_directory, PATH_MAX, "%s.tmp", directory);
+    mkdir(temp_directory, 0755);
+
+    GcsBenchBuffer with_duration;
+    GcsBenchBuffer without_duration;
+    build_chunk(&with_duration, 1);
+    build_chunk(&without_duration, 0);
+
+    /* start at the first of january, local time */
+    struct tm date_time;
+    memset(&date_time, 0, sizeof(date_time));
+    date_time.tm_year = 2016 - 1900;
+    date_time.tm_mday = 1;
+    date_time.tm_isdst = -1;
+
+    time_t moment = mktime(&date_time);
+
+    int i;
+    for(i = 0; i < count; ++i, moment += CHUNK_DURATION_SECONDS) {
+        struct tm current = *localtime(&moment);
+
+        const char *format = (i % OLD_FORMAT_EVERY == 0) ?
+            "%s/%02d-%02d-%04d_%02d;%02d;%02d.mkv" :
+            "%s/%02d-%02d-%04d_%02d-%02d-%02d.mkv";
+
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, format, temp_directory, current.tm_mday,
+            current.tm_mon + 1, current.tm_year + 1900, current.tm_hour,
+            current.tm_min, current.tm_sec);
+
+        GcsBenchBuffer *buffer = (i % NO_DURATION_EVERY == 0) ?
+            &without_duration : &with_duration;
+
+        int len = buffer->len;
+        if(i % EMPTY_EVERY == 0) {
+            len = 0;
+        } else if(i % TRUNCATED_EVERY == 0) {
+            len = buffer->len / 2;
+        }
+
+        if(!write_chunk(path, buffer, len)) {
+            fprintf(stderr, "[err] could not write '%s'\n", path);
+            return 0;
+        }
+    }
+
+    /* only complete archives get the real name, so an interrupted
+    run is not mistaken for one */
+    return rename(temp_directory, directory) == 0;
+}
+
+static long
+get_peak_rss()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    /* in kilobytes on linux */
+    return usage.ru_maxrss;
+}
+
+static void
+remove_cache(const char *directory)
+{
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%s", directory, GCS_CACHE_FILENAME);
+    remove(path);
+}
+
+static void
+print_ms(const char *name, gint64 time)
+{
+    printf("[inf]   %-14s %10.2fms\n", name, (double) time / 1000.0);
+}
+
+static int
+run(const char *directory, const char *name)
+{
+    GcsIndex *index = gcs_index_new();
+
+    gint64 start = g_get_monotonic_time();
+    int count = gcs_index_fill(index, (char *) directory);
+    gint64 wall_time = g_get_monotonic_time() - start;
+
+    if(count < 0) {
+        fprintf(stderr, "[err] could not index '%s'\n", directory);
+        gcs_index_free(index);
+        return 0;
+    }
+
+    GcsIndexStats *stats = &index->stats;
+    double probes_per_second = 0.0;
+
+    if(stats->probe_wall_time > 0) {
+        probes_per_second = (double) stats->probed /
+            ((double) stats->probe_wall_time / G_USEC_PER_SEC);
+    }
+
+    printf("[inf] %s: %i chunks (incl. gaps), %i probed, %i cached\n", name,
+        count, stats->probed, stats->cached);
+
+    print_ms("wall", wall_time);
+    print_ms("readdir", stats->readdir_time);
+    print_ms("cache", stats->cache_time);
+    print_ms("parse (sum)", stats->parse_time);
+    print_ms("probe (sum)", stats->probe_time);
+    print_ms("probe (wall)", stats->probe_wall_time);
+    print_ms("sort", stats->sort_time);
+    print_ms("gaps", stats->gap_time);
+
+    printf("[inf]   %-14s %10.0f/s\n", "probes", probes_per_second);
+    printf("[inf]   %-14s %10likB\n", "peak rss", get_peak_rss());
+
+    gcs_index_free(index);
+    return 1;
+}
+
+static int
+check_clock_ranges(const char *directory)
+{
+    GcsIndex *index = gcs_index_new();
+    if(gcs_index_fill(index, (char *) directory) < 0) {
+        fprintf(stderr, "[err] could not index '%s'\n", directory);
+        gcs_index_free(index);
+        return 0;
+    }
+
+    GcsIndexIterator *itr = gcs_index_iterator_new(index);
+    int checked = 0;
+    int failed = 0;
+
+    int count = gcs_index_count(index);
+    int i;
+    for(i = 0; i < count; ++i) {
+        GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk, i);
+        if(gcs_chunk_is_gap(chunk)) {
+            continue;
+        }
+
+        /* halfway into the chunk, in whole seconds, which is all
+        a clock range has, the names are in local time, the range
+        is in UTC */
+        uint64_t halfway = chunk->start_moment + chunk->duration / 2;
+        time_t moment = (time_t) GCS_TIME_NANO_AS_SECONDS(halfway);
+
+        struct tm date_time;
+        gmtime_r(&moment, &date_time);
+
+        char range_header[64];
+        strftime(range_header, sizeof(range_header),
+            "clock=%Y%m%dT%H%M%SZ-", &date_time);
+
+        uint64_t start_moment = 0;
+        GcsChunk *found = NULL;
+
+        if(gcs_gst_parse_clock_range(range_header, &start_moment)) {
+            found = gcs_index_iterator_seek(itr, start_moment, NULL);
+        }
+
+        ++checked;
+
+        if(!found || found->start_moment != chunk->start_moment ||
+            found->filename != chunk->filename) {
+            if(failed++ < 10) {
+                fprintf(stderr, "[err] '%s' did not resolve to '%s'\n",
+                    range_header, gcs_index_get_filename(index, chunk));
+            }
+        }
+    }
+
+    printf("[inf] %i clock ranges checked, %i resolved to the wrong "
+        "chunk\n", checked, failed);
+
+    gcs_index_iterator_free(itr);
+    gcs_index_free(index);
+
+    return checked > 0 && failed == 0;
+}
+
+typedef struct {
+    const char *directory;
+    int session;
+    int readahead_count;
+
+    /* time it took to read the start of every chunk, summed */
+    gint64 start_time;
+    gint64 max_start_time;
+} GcsBenchSession;
+
+static void
+get_readahead_path(const char *directory, int session, int chunk, char *path)
+{
+    snprintf(path, PATH_MAX, "%s/%02i-%02i.mkv", directory, session, chunk);
+}
+
+static int
+generate_readahead_files(const char *directory, int session_count)
+{
+    if(gcs_dir_exists((char *) directory)) {
+        printf("[inf] using existing files in '%s'\n", directory);
+        return 1;
+    }
+
+    printf("[inf] generating %i files of %ikB in '%s'\n",
+        session_count * READAHEAD_CHUNK_COUNT, READAHEAD_CHUNK_SIZE / 1024,
+        directory);
+
+    char temp_directory[PATH_MAX];
+    snprintf(temp_directory, PATH_MAX, "%s.tmp", directory);
+    mkdir(temp_directory, 0755);
+
+    char *data = ALLOC_NULL(char *, READAHEAD_CHUNK_SIZE);
+    memset(data, 0x5a, READAHEAD_CHUNK_SIZE);
+
+    int result = 1;
+
+    int i;
+    for(i = 0; i < session_count * READAHEAD_CHUNK_COUNT && result; ++i) {
+        char path[PATH_MAX];
+        get_readahead_path(temp_directory, i / READAHEAD_CHUNK_COUNT,
+            i % READAHEAD_CHUNK_COUNT, path);
+
+        FILE *file = fopen(path, "wb");
+        if(!file) {
+            fprintf(stderr, "[err] could not write '%s'\n", path);
+            result = 0;
+            break;
+        }
+
+        result = fwrite(data, 1, READAHEAD_CHUNK_SIZE, file) ==
+            READAHEAD_CHUNK_SIZE;
+
+        /* only written pages that reached the disk can be dropped
+        from the page cache */
+        result = (fflush(file) == 0) && (fsync(fileno(file)) == 0) && result;
+        result = (fclose(file) == 0) && result;
+    }
+
+    free(data);
+
+    return result && rename(temp_directory, directory) == 0;
+}
+
+static void
+drop_readahead_files(const char *directory, int session_count)
+{
+    /* every pass starts from disk, like chunks recorded long ago */
+    int i;
+    for(i = 0; i < session_count * READAHEAD_CHUNK_COUNT; ++i) {
+        char path[PATH_MAX];
+        get_readahead_path(directory, i / READAHEAD_CHUNK_COUNT,
+            i % READAHEAD_CHUNK_COUNT, path);
+
+        int fd = open(path, O_RDONLY);
+        if(fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+static gpointer
+play_readahead_session(gpointer data)
+{
+    GcsBenchSession *session = (GcsBenchSession *) data;
+    char *buffer = ALLOC_NULL(char *, READAHEAD_START_SIZE);
+
+    int i;
+    for(i = 0; i < READAHEAD_CHUNK_COUNT; ++i) {
+        char path[PATH_MAX];
+
+        /* like the player, the chunk that's prepared gives back its
+        share of the budget, then the chunks after it are warmed,
+        each of them once */
+        get_readahead_path(session->directory, session->session, i, path);
+        gcs_readahead_release(path);
+
+        int first = (i == 0) ? 1 : MAX(i + 1, i + session->readahead_count);
+        int j;
+        for(j = first; j <= i + session->readahead_count &&
+                j < READAHEAD_CHUNK_COUNT; ++j) {
+            char next_path[PATH_MAX];
+            get_readahead_path(session->directory, session->session, j,
+                next_path);
+            gcs_readahead_warm(next_path);
+        }
+
+        gint64 start = g_get_monotonic_time();
+
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) {
+            break;
+        }
+
+        ssize_t len = read(fd, buffer, READAHEAD_START_SIZE);
+        gint64 time = g_get_monotonic_time() - start;
+
+        session->start_time += time;
+        session->max_start_time = MAX(session->max_start_time, time);
+
+        /* the rest of the chunk is read at the pace it's played,
+        a block at a time */
+        while(len > 0) {
+            g_usleep(READAHEAD_PLAY_TIME / (READAHEAD_CHUNK_SIZE /
+                READAHEAD_START_SIZE));
+            len = read(fd, buffer, READAHEAD_START_SIZE);
+        }
+
+        close(fd);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+static void
+run_readahead(const char *directory, int session_count, int readahead_count)
+{
+    drop_readahead_files(directory, session_count);
+
+    GcsReadaheadStats before;
+    gcs_readahead_get_stats(&before);
+
+    GcsBenchSession *sessions = ALLOC_NULL(GcsBenchSession *,
+        session_count * sizeof(GcsBenchSession));
+    GThread **threads = ALLOC_NULL(GThread **,
+        session_count * sizeof(GThread *));
+
+    gint64 start = g_get_monotonic_time();
+
+    int i;
+    for(i = 0; i < session_count; ++i) {
+        sessions[i].directory = directory;
+        sessions[i].session = i;
+        sessions[i].readahead_count = readahead_count;
+        threads[i] = g_thread_new(NULL, play_readahead_session, &sessions[i]);
+    }
+
+    gint64 start_time = 0;
+    gint64 max_start_time = 0;
+
+    for(i = 0; i < session_count; ++i) {
+        g_thread_join(threads[i]);
+        start_time += sessions[i].start_time;
+        max_start_time = MAX(max_start_time, sessions[i].max_start_time);
+    }
+
+    gint64 wall_time = g_get_monotonic_time() - start;
+
+    GcsReadaheadStats after;
+    gcs_readahead_get_stats(&after);
+
+    printf("[inf] read-ahead of %i chunks: %i sessions, %i chunks each\n",
+        readahead_count, session_count, READAHEAD_CHUNK_COUNT);
+
+    print_ms("wall", wall_time);
+    print_ms("start (avg)", start_time / (session_count *
+        READAHEAD_CHUNK_COUNT));
+    print_ms("start (max)", max_start_time);
+
+    printf("[inf]   %-14s %10i\n", "read ahead", after.warmed - before.warmed);
+    printf("[inf]   %-14s %10i\n", "over budget",
+        after.skipped - before.skipped);
+
+    free(threads);
+    free(sessions);
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "Usage: chunk-bench [directory] [chunk count...]\n"
+            "       chunk-bench clock [directory] [chunk count]\n"
+            "       chunk-bench readahead [directory] [session count] "
+            "[read-ahead count]\n");
+        return 1;
+    }
+
+    if(argc > 2 && strcmp(argv[1], "clock") == 0) {
+        int count = (argc > 3) ? atoi(argv[3]) : DEFAULT_CLOCK_CHUNK_COUNT;
+
+        if(!gcs_dir_exists(argv[2])) {
+            gcs_dir_create(argv[2]);
+        }
+
+        char directory[PATH_MAX];
+        snprintf(directory, PATH_MAX, "%s/%i", argv[2], count);
+
+        if(count <= 0 || !generate_archive(directory, count)) {
+            fprintf(stderr, "[err] could not generate '%s'\n", directory);
+            return 1;
+        }
+
+        return check_clock_ranges(directory) ? 0 : 1;
+    }
+
+    if(argc > 2 && strcmp(argv[1], "readahead") == 0) {
+        int session_count = (argc > 3) ? atoi(argv[3]) :
+            DEFAULT_READAHEAD_SESSION_COUNT;
+        int readahead_count = (argc > 4) ? atoi(argv[4]) :
+            GCS_READAHEAD_DEFAULT_CHUNK_COUNT;
+
+        if(!gcs_dir_exists(argv[2])) {
+            gcs_dir_create(argv[2]);
+        }
+
+        char directory[PATH_MAX];
+        snprintf(directory, PATH_MAX, "%s/readahead-%i", argv[2],
+            session_count);
+
+        if(session_count <= 0 ||
+                !generate_readahead_files(directory, session_count)) {
+            fprintf(stderr, "[err] could not generate '%s'\n", directory);
+            return 1;
+        }
+
+        /* the same files, from disk every time, without and with */
+        run_readahead(directory, session_count, 0);
+        if(readahead_count > 0) {
+            run_readahead(directory, session_count, readahead_count);
+        }
+
+        return 0;
+    }
+
+    if(!gcs_dir_exists(argv[1])) {
+        gcs_dir_create(argv[1]);
+    }
+
+    int default_counts[] = DEFAULT_CHUNK_COUNTS;
+    int count_len = argc - 2;
+
+    if(count_len == 0) {
+        count_len = G_N_ELEMENTS(default_counts);
+    }
+
+    int i;
+    for(i = 0; i < count_len; ++i) {
+        int count = (argc > 2) ? atoi(argv[i + 2]) : default_counts[i];
+        if(count <= 0) {
+            continue;
+        }
+
+        char directory[PATH_MAX];
+        snprintf(directory, PATH_MAX, "%s/%i", argv[1], count);
+
+        if(!generate_archive(directory, count)) {
+            fprintf(stderr, "[err] could not generate '%s'\n", directory);
+            return 1;
+        }
+
+        /* peak rss only grows, which is why the smaller
+        archives go first */
+        remove_cache(directory);
+
+        if(!run(directory, "cold") || !run(directory, "warm")) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -8,10 +8,19 @@
 #include <gcs/dir.h>
 #include <gcs/chunk.h>
 #include <gcs/index.h>
+#include <gcs/watch.h>
 #include <gcs/mem.h>
 #include <gcs/player.h>
+#include <gcs/metrics.h>
+
+/* seconds between printing the player's stats */
+#define STATS_INTERVAL 600
+
+/* seconds between seeks to the moment on the command line */
+#define SEEK_INTERVAL 10
 
 static GMainLoop *loop;
+static uint64_t seek_moment;
 
 static void
 on_sigint(int signo)
@@ -21,6 +30,24 @@ on_sigint(int signo)
 		g_main_loop_quit(loop);
 }
 
+static gboolean
+on_print_stats(gpointer user_data)
+{
+    /* switch times and memory use over a long playback, neither
+    should grow the longer it plays */
+    gcs_player_print_stats((GcsPlayer *) user_data);
+    return TRUE;
+}
+
+static gboolean
+on_seek(gpointer user_data)
+{
+    /* over and over, so the stats have the average time from
+    the seek to its first frame, and not just a single one */
+    gcs_player_seek((GcsPlayer *) user_data, seek_moment);
+    return TRUE;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -29,7 +56,7 @@ main(int argc, char **argv)
 
     /* make sure we have enough arguments */
     if(argc < 2) {
-		fprintf(stderr, "Usage: chunk-player [directory]\n");
+		fprintf(stderr, "Usage: chunk-player [directory[:directory...]] [bin count] [play|skip|marker] [rate] [read-ahead chunks] [seek to DD-MM-YYYY_HH-MM-SS]\n");
 		return 1;
 	}
 
@@ -40,26 +67,86 @@ main(int argc, char **argv)
     /* start indexing, sorting etc of the chunks */
     printf("[inf] indexing chunks in %s\n", argv[1]);
     GcsIndex *index = gcs_index_new();
-    if(gcs_index_fill(index, argv[1]) <= 0) {
+    /* only the hours that are played are read, the first
+    seek doesn't wait for the whole archive to be indexed */
+    gcs_index_set_max_loaded_hours(index,
+        GCS_INDEX_DEFAULT_MAX_LOADED_HOURS);
+
+    if(gcs_index_fill_directories(index, argv[1]) <= 0) {
         fprintf(stderr, "[err] did not find any chunks\n");
         return 1;
     }
     printf("[inf] indexed %i chunks\n", gcs_index_count(index));
 
+    /* pick up chunks that are recorded while we're running */
+    gcs_index_watch(index);
+
     /* create a new iterator for our chunk index */
     GcsIndexIterator *index_itr = gcs_index_iterator_new(index);
 
     /* create a new player with xvmagesink as the output, and start
     playing */
-    GcsPlayer *player = gcs_player_new(index_itr, "xvimagesink", NULL, TRUE);
+    /* more bins means more chunks are prepared ahead, which
+    helps on slow storage */
+    int bin_count = (argc > 2) ? atoi(argv[2]) : GCS_PLAYER_DEFAULT_BIN_COUNT;
+
+    GcsPlayer *player = gcs_player_new(index_itr, "xvimagesink", NULL, TRUE,
+        bin_count);
+
+    /* sparse archives are mostly gaps, skip or shorten them
+    to get through them quickly */
+    if(argc > 3) {
+        if(strcmp(argv[3], "skip") == 0) {
+            gcs_player_set_gap_mode(player, GCS_PLAYER_GAP_MODE_SKIP, 0);
+        } else if(strcmp(argv[3], "marker") == 0) {
+            gcs_player_set_gap_mode(player, GCS_PLAYER_GAP_MODE_MARKER, 0);
+        }
+    }
+
+    /* fast forward, only keyframes are decoded from
+    GCS_PLAYER_KEYFRAME_RATE on, negative rates play backwards */
+    if(argc > 4) {
+        double rate = atof(argv[4]);
+        gcs_player_set_rate(player, rate);
+
+        /* move past the last chunk, the player walks back from there */
+        if(rate < 0) {
+            while(gcs_index_iterator_next(index_itr));
+        }
+    }
+
+    /* chunks read into the page cache ahead of the switch to
+    them, 0 turns it off, to compare stalls with and without */
+    if(argc > 5) {
+        gcs_player_set_readahead(player, atoi(argv[5]));
+    }
+
     gcs_player_play(player);
 
+    g_timeout_add_seconds(STATS_INTERVAL, on_print_stats, player);
+
+    /* jumps back to the moment every few seconds, written like the
+    chunks are named, to see how long seeking takes */
+    if(argc > 6) {
+        seek_moment = gcs_chunk_parse_start_moment(argv[6]);
+        g_timeout_add_seconds(SEEK_INTERVAL, on_seek, player);
+    }
+
     /* run main loop so we don't exit until streaming stops */
     loop = g_main_loop_new(NULL, FALSE);
     g_main_loop_run(loop);
 
     /* if we get here, we're stopping */
     gcs_player_stop(player);
+    gcs_player_print_stats(player);
+
+    /* the histograms, in the format prometheus scrapes from
+    chunk-server, to compare runs */
+    GString *metrics = g_string_new(NULL);
+    gcs_metrics_write(metrics);
+    printf("%s", metrics->str);
+    g_string_free(metrics, TRUE);
+
     gcs_player_free(player);
     gcs_index_iterator_free(index_itr);
     gcs_index_free(index);
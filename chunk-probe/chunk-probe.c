@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <inttypes.h>
+
+#include <gst/gst.h>
+
+#include <gcs/meta.h>
+#include <gcs/time.h>
+
+/* measures how long it takes to determine the duration of every
+chunk in a directory, using the native matroska reader and using
+GstDiscoverer, so we can see what the probe costs per file */
+
+typedef struct {
+    int count;
+    int mismatches;
+    gint64 native_time;
+    gint64 discoverer_time;
+} GcsProbeStats;
+
+/* durations that differ more than this are reported, the native
+reader has no way to know the duration of the last frame on
+files without a duration element */
+#define MAXIMUM_DURATION_DIFFERENCE 100000000
+
+static void
+probe_file(GcsProbeStats *stats, const char *path)
+{
+    gint64 start = g_get_monotonic_time();
+    uint64_t native_duration = gcs_meta_get_mkv_duration(path);
+    gint64 middle = g_get_monotonic_time();
+    uint64_t discoverer_duration = gcs_meta_get_mkv_duration_discoverer(path);
+    gint64 end = g_get_monotonic_time();
+
+    stats->native_time += (middle - start);
+    stats->discoverer_time += (end - middle);
+    ++stats->count;
+
+    uint64_t difference = (native_duration > discoverer_duration) ?
+        native_duration - discoverer_duration :
+        discoverer_duration - native_duration;
+
+    if(difference > MAXIMUM_DURATION_DIFFERENCE) {
+        printf("[wrn] '%s' native: %" PRIu64 "ns, discoverer: %" PRIu64 "ns\n",
+            path, native_duration, discoverer_duration);
+        ++stats->mismatches;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "Usage: chunk-probe [directory]\n");
+        return 1;
+    }
+
+    gst_init(&argc, &argv);
+
+    DIR *d = opendir(argv[1]);
+    if(!d) {
+        fprintf(stderr, "[err] could not open '%s'\n", argv[1]);
+        return 1;
+    }
+
+    char *directory = realpath(argv[1], NULL);
+    GcsProbeStats stats = { 0 };
+
+    struct dirent *dir = NULL;
+    while((dir = readdir(d)) != NULL) {
+        if(dir->d_type != DT_REG || dir->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", directory, dir->d_name);
+
+        probe_file(&stats, path);
+    }
+
+    closedir(d);
+    free(directory);
+
+    if(stats.count == 0) {
+        fprintf(stderr, "[err] did not find any chunks\n");
+        return 1;
+    }
+
+    printf("[inf] probed %i chunks, %i mismatches\n", stats.count,
+        stats.mismatches);
+
+    printf("[inf] native:     %" G_GINT64_FORMAT "us total, %" G_GINT64_FORMAT
+        "us per chunk\n", stats.native_time, stats.native_time / stats.count);
+
+    printf("[inf] discoverer: %" G_GINT64_FORMAT "us total, %" G_GINT64_FORMAT
+        "us per chunk\n", stats.discoverer_time,
+        stats.discoverer_time / stats.count);
+
+    return 0;
+}
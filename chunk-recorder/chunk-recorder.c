@@ -9,6 +9,10 @@
 #include <gcs/dir.h>
 #include <gcs/mem.h>
 #include <gcs/gst.h>
+#include <gcs/meta.h>
+#include <gcs/index.h>
+#include <gcs/mapped.h>
+#include <gcs/time.h>
 
 #if !defined(_WIN32)
 #	include <unistd.h>
@@ -39,6 +43,14 @@ typedef struct {
 
     char *directory;
     int directory_len;
+
+    /* file we're currently writing to and when it was started */
+    char *filename;
+    time_t filename_time;
+
+    /* list of finished chunks that readers map instead of
+    scanning the directory, NULL when it could not be opened */
+    GcsMappedIndex *mapped;
 } GcsPipelineData;
 
 static GMainLoop *loop;
@@ -58,6 +70,9 @@ free_pipeline_data(GcsPipelineData *data)
 	data->buffer_probe = NULL;
 	data->is_switching = FALSE;
 
+	gcs_mapped_index_close(data->mapped);
+	free(data->filename);
+
 	free(data);
 	data = NULL;
 }
@@ -91,9 +106,8 @@ build_pipeline(const char *url)
 }
 
 static char *
-build_filename(char *directory, int directory_len)
+build_filename(char *directory, int directory_len, time_t t)
 {
-	time_t t = time(NULL);
 	struct tm current = *localtime(&t);
 
 	/* 5 times 2 for the month, day, hour, minutes and seconds,
@@ -113,12 +127,83 @@ build_filename(char *directory, int directory_len)
 static void
 set_file_destination(GcsPipelineData *data)
 {
-	char *filename = build_filename(data->directory, data->directory_len);
+	time_t t = time(NULL);
+	char *filename = build_filename(data->directory, data->directory_len, t);
 	g_object_set(data->destination, "location", filename, NULL);
 
 	printf("Writing to: %s\n", filename);
 
-	free(filename);
+	/* remember it, so we can add it to the chunk list once it's done */
+	free(data->filename);
+	data->filename = filename;
+	data->filename_time = t;
+}
+
+static void
+append_chunk(GcsPipelineData *data)
+{
+	if(!data->mapped || !data->filename) {
+		return;
+	}
+
+	/* the file was closed, so the duration is known now */
+	uint64_t start_moment = GCS_TIME_SECONDS_AS_NANO((uint64_t) data->filename_time);
+	uint64_t duration = gcs_meta_get_mkv_duration(data->filename);
+
+	/* nothing was recorded (or the file is unreadable), there's
+	nothing to play back either */
+	if(duration == 0) {
+		return;
+	}
+
+	/* the list only holds the name, relative to the directory */
+	const char *name = data->filename + data->directory_len + 1;
+
+	if(!gcs_mapped_index_append(data->mapped, name, start_moment,
+		start_moment + duration, duration)) {
+		fprintf(stderr, "Could not add '%s' to the chunk list\n", name);
+	}
+}
+
+static void
+open_chunk_list(GcsPipelineData *data)
+{
+	/* readers trust the list for as long as we're recording, so it has
+	to have everything that was recorded before we started, the chunks
+	from before there was a list and the ones the last run didn't get to
+	list (when it crashed), those are newer than its last record, which
+	are the only files the fill looks at when there's a list already */
+	GcsIndex *index = gcs_index_new();
+	gcs_index_fill(index, data->directory);
+
+	data->mapped = gcs_mapped_index_create(data->directory);
+
+	if(data->mapped) {
+		uint64_t record_count = gcs_mapped_index_refresh(data->mapped);
+		uint64_t last_start_moment = record_count > 0 ?
+			gcs_mapped_index_get(data->mapped, record_count - 1)->start_moment : 0;
+
+		int count = gcs_index_count(index);
+		int listed_count = 0;
+		int i;
+
+		for(i = 0; i < count; ++i) {
+			GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk, i);
+			if(gcs_chunk_is_gap(chunk) || chunk->start_moment <= last_start_moment) {
+				continue;
+			}
+
+			if(gcs_mapped_index_append(data->mapped,
+				gcs_index_get_filename(index, chunk), chunk->start_moment,
+				chunk->stop_moment, chunk->duration)) {
+				++listed_count;
+			}
+		}
+
+		printf("Listed %i existing chunks\n", listed_count);
+	}
+
+	gcs_index_free(index);
 }
 
 static gboolean
@@ -143,6 +228,9 @@ on_switch_file(gpointer user_data)
 	gst_element_set_state(data->destination, GST_STATE_NULL);
 	gst_element_set_state(data->muxer, GST_STATE_NULL);
 
+	/* the file we were writing to is closed now, let the readers know */
+	append_chunk(data);
+
 	/* generate a new filename with the current date/time and
 	apply it on the file sink */
 	set_file_destination(data);
@@ -333,6 +421,7 @@ main(int argc, char **argv)
 	data->bin = GST_BIN(pipeline);
 
     set_directory(data, argv[2]);   /* this also assures that the directory exists */
+	open_chunk_list(data);
 	g_object_ref(pipeline);         /* casting to bin, increment ref count */
 
 	data->source = gst_bin_get_by_name(data->bin, "source");
@@ -389,6 +478,9 @@ cleanup:
 		fprintf(stderr, "Failed to get the pipline into the NULL state\n");
 	}
 
+	/* the last file was closed as well */
+	append_chunk(data);
+
 	free_pipeline_data(data);
 
 	printf("Exiting\n");
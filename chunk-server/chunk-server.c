@@ -9,23 +9,37 @@
 #include <gcs/dir.h>
 #include <gcs/chunk.h>
 #include <gcs/index.h>
+#include <gcs/watch.h>
 #include <gcs/mem.h>
 #include <gcs/player.h>
 #include <gcs/gst.h>
+#include <gcs/metrics.h>
 
 #define SERVER_PORT "8554"
 
+/* prometheus scrapes the players' metrics here, on localhost only */
+#define METRICS_PORT 9554
+
 typedef struct {
     GstRTSPServer *server;
     GPtrArray *clients;
     GcsIndex *index;
-    GcsIndexIterator *index_itr;
+
+    /* depth of every client's player */
+    int bin_count;
+
+    /* chunks every client's player reads ahead */
+    int readahead_count;
 } GcsChunkServer;
 
 typedef struct {
     GcsChunkServer *server;
     GstRTSPContext *context;
     GcsPlayer *player;
+
+    /* every client walks through the chunks at its own pace,
+    the iterator reads from a snapshot of the shared index */
+    GcsIndexIterator *index_itr;
 } GcsChunkServerClient;
 
 #define GCS_CHUNK_SERVER_CLIENT(x) (GcsChunkServerClient *) x
@@ -82,10 +96,6 @@ gcs_chunk_server_free(GcsChunkServer *server)
         return;
     }
 
-    if(server->index_itr) {
-        gcs_index_iterator_free(server->index_itr);
-    }
-
     if(server->index) {
         gcs_index_free(server->index);
     }
@@ -101,6 +111,7 @@ gcs_chunk_server_client_free(GcsChunkServerClient *client)
         return;
     }
 
+    gcs_index_iterator_free(client->index_itr);
     GSTREAMER_FREE(client->context);
     free(client);
 }
@@ -140,14 +151,19 @@ gcs_chunk_server_client_init_player(GcsChunkServerClient *client)
     sink element.. this will put the h264 data into a rtp packet..
     it must be named `pay0` so the gst-rtsp-server will link with
     that element */
-    client->player = gcs_player_new(client->server->index_itr, "rtph264pay",
-        "pay0", FALSE);
+    client->index_itr = gcs_index_iterator_new(client->server->index);
+    client->player = gcs_player_new(client->index_itr, "rtph264pay",
+        "pay0", FALSE, client->server->bin_count);
 
     /* pt == payload type, which is 96.. which is the first payload type
     that is dynamic.. meaning that any kind of data will work...
     http://www.iana.org/assignments/rtp-parameters/rtp-parameters.xhtml */
     g_object_set(client->player->sink, "pt", 96, NULL);
 
+    /* every client reads ahead, the total is capped by the budget
+    that all players share */
+    gcs_player_set_readahead(client->player, client->server->readahead_count);
+
     /* hook up a signal so we get notified when switching happens
     between chunks */
     gcs_player_connect_signal(client->player, G_CALLBACK(on_switch), client);
@@ -183,6 +199,13 @@ on_client_options_request(GstRTSPClient *rtsp_client, GstRTSPContext *context,
         return;
     }
 
+    /* clients send options again (as a keep-alive, for example), the
+    player they have keeps playing, seeking is done with a range in
+    the play request */
+    if(client->player) {
+        return;
+    }
+
     /* create new chunk player with no decoder */
     gcs_chunk_server_client_init_player(client);
 
@@ -214,6 +237,37 @@ on_client_options_request(GstRTSPClient *rtsp_client, GstRTSPContext *context,
     g_object_unref(mount_points);
 }
 
+static GstRTSPStatusCode
+on_client_play_request(GstRTSPClient *rtsp_client, GstRTSPContext *context,
+    GcsChunkServerClient *client)
+{
+    gchar *range_header = NULL;
+    if(!client->player || gst_rtsp_message_get_header(context->request,
+        GST_RTSP_HDR_RANGE, &range_header, 0) != GST_RTSP_OK) {
+        return GST_RTSP_STS_OK;
+    }
+
+    /* only wall clock ranges (clock=20200101T120000Z-) are ours, the
+    rest is left to the server, as before */
+    uint64_t start_moment = 0;
+    if(!gcs_gst_parse_clock_range(range_header, &start_moment)) {
+        return GST_RTSP_STS_OK;
+    }
+
+    /* the same player jumps there, which saves building a new
+    pipeline for it */
+    printf("[inf] client seeking to %s\n", range_header);
+
+    if(!gcs_player_seek(client->player, start_moment)) {
+        return GST_RTSP_STS_INVALID_RANGE;
+    }
+
+    /* the server would seek the pipeline as well, which knows
+    nothing about wall clock time */
+    gst_rtsp_message_remove_header(context->request, GST_RTSP_HDR_RANGE, -1);
+    return GST_RTSP_STS_OK;
+}
+
 static void
 on_client_connected(GstRTSPServer *rtsp_server, GstRTSPClient *rtsp_client,
     GcsChunkServer *server)
@@ -229,6 +283,10 @@ on_client_connected(GstRTSPServer *rtsp_server, GstRTSPClient *rtsp_client,
     first RTSP command that is send by the client */
     g_signal_connect(rtsp_client, "options-request",
         G_CALLBACK(on_client_options_request), client);
+
+    /* a play request with a range is how a client seeks */
+    g_signal_connect(rtsp_client, "pre-play-request",
+        G_CALLBACK(on_client_play_request), client);
 }
 
 int
@@ -239,7 +297,8 @@ main(int argc, char **argv)
 
     /* make sure we have enough arguments */
     if(argc < 2) {
-        fprintf(stderr, "Usage: chunk-server [directory]\n");
+        fprintf(stderr, "Usage: chunk-server [directory[:directory...]] [bin count] "
+            "[read-ahead chunks]\n");
         return 1;
     }
 
@@ -258,18 +317,28 @@ main(int argc, char **argv)
 
     /* start indexing, sorting etc of the chunks */
     printf("[inf] indexing chunks in %s\n", argv[1]);
+    server->bin_count = (argc > 2) ? atoi(argv[2]) : GCS_PLAYER_DEFAULT_BIN_COUNT;
+    server->readahead_count = (argc > 3) ? atoi(argv[3]) :
+        GCS_READAHEAD_DEFAULT_CHUNK_COUNT;
     server->index = gcs_index_new();
-    if(gcs_index_fill(server->index, argv[1]) <= 0) {
+    /* only the hours that are played are read, the first
+    seek doesn't wait for the whole archive to be indexed */
+    gcs_index_set_max_loaded_hours(server->index,
+        GCS_INDEX_DEFAULT_MAX_LOADED_HOURS);
+
+    if(gcs_index_fill_directories(server->index, argv[1]) <= 0) {
         fprintf(stderr, "[err] did not find any chunks\n");
         return 1;
     }
     printf("[inf] indexed %i chunks\n", gcs_index_count(server->index));
 
-    /* create new iterator for the index */
-    server->index_itr = gcs_index_iterator_new(server->index);
+    /* pick up chunks that are recorded while we're running, the
+    main loop is the only thing that modifies the index */
+    gcs_index_watch(server->index);
 
     /* start server */
     gst_rtsp_server_attach(server->server, NULL);
+    gcs_metrics_serve(METRICS_PORT);
 
     /* run tha loop, we'll stop it when we run into trouble */
     loop = g_main_loop_new(NULL, FALSE);
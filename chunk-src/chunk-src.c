@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+
+#include <gcs/index.h>
+#include <gcs/mkv.h>
+#include <gcs/gst.h>
+
+#define PACKAGE "gst-chunks"
+#define VERSION "1.0"
+
+/* reads the chunks of a directory back to back and pushes their
+frames as one h264 stream, with timestamps that count from the start
+of the first chunk, so any pipeline can play (or transcode, or serve)
+an archive without the concat and bin switching of GcsPlayer:
+
+    gst-launch-1.0 gcschunksrc location=/recordings ! h264parse !
+        avdec_h264 ! autovideosink
+
+gaps between chunks become GAP events, chunks the reader does not
+understand are skipped */
+
+#define GST_TYPE_GCS_CHUNK_SRC (gst_gcs_chunk_src_get_type())
+#define GST_GCS_CHUNK_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+    GST_TYPE_GCS_CHUNK_SRC, GstGcsChunkSrc))
+
+typedef struct {
+    GstPushSrc parent;
+
+    /* directory of the chunks */
+    char *location;
+
+    GcsIndex *index;
+    GcsIndexIterator *index_itr;
+
+    /* timestamps are relative to the start of the first
+    chunk, the stream lasts until the end of the last one */
+    uint64_t base_moment;
+    uint64_t end_moment;
+
+    /* copy of the chunk being read, the iterator may move to
+    a newer snapshot while we're reading it */
+    GcsChunk chunk;
+    GcsMkvReader *reader;
+
+    /* where in the next chunk to start after a seek */
+    uint64_t seek_offset;
+
+    /* caps of the stream so far, they change with the codec data
+    of the chunks, when the camera's settings were changed */
+    GstCaps *caps;
+
+    /* gap events can only be sent once the segment is out,
+    which is just before the first buffer */
+    int started;
+} GstGcsChunkSrc;
+
+typedef struct {
+    GstPushSrcClass parent_class;
+} GstGcsChunkSrcClass;
+
+enum {
+    PROP_0,
+    PROP_LOCATION
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS("video/x-h264, stream-format=avc, alignment=au"));
+
+G_DEFINE_TYPE(GstGcsChunkSrc, gst_gcs_chunk_src, GST_TYPE_PUSH_SRC);
+
+static void
+gst_gcs_chunk_src_close_chunk(GstGcsChunkSrc *src)
+{
+    if(src->reader) {
+        gcs_mkv_reader_close(src->reader);
+        src->reader = NULL;
+    }
+}
+
+static gboolean
+gst_gcs_chunk_src_start(GstBaseSrc *base_src)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(base_src);
+
+    if(!src->location) {
+        GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND,
+            ("No location set"), (NULL));
+        return FALSE;
+    }
+
+    src->index = gcs_index_new();
+    gcs_index_set_max_loaded_hours(src->index,
+        GCS_INDEX_DEFAULT_MAX_LOADED_HOURS);
+
+    if(gcs_index_fill_directories(src->index, src->location) <= 0) {
+        GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND,
+            ("No chunks in %s", src->location), (NULL));
+
+        gcs_index_free(src->index);
+        src->index = NULL;
+        return FALSE;
+    }
+
+    src->index_itr = gcs_index_iterator_new(src->index);
+
+    GcsChunk *first = gcs_index_iterator_peek(src->index_itr);
+    src->base_moment = first->start_moment;
+
+    /* the last chunk can run past the end of the index (past
+    midnight), the stream lasts until it stops */
+    GcsIndexSnapshot *snapshot = gcs_index_snapshot_acquire(src->index);
+    src->end_moment = gcs_index_snapshot_get(snapshot,
+        snapshot->count - 1)->stop_moment;
+    gcs_index_snapshot_release(snapshot);
+
+    src->seek_offset = 0;
+    src->started = 0;
+
+    printf("[inf] gcschunksrc: %d chunks in %s\n",
+        gcs_index_count(src->index), src->location);
+
+    return TRUE;
+}
+
+static gboolean
+gst_gcs_chunk_src_stop(GstBaseSrc *base_src)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(base_src);
+
+    gst_gcs_chunk_src_close_chunk(src);
+
+    if(src->caps) {
+        gst_caps_unref(src->caps);
+        src->caps = NULL;
+    }
+
+    gcs_index_iterator_free(src->index_itr);
+    src->index_itr = NULL;
+
+    gcs_index_free(src->index);
+    src->index = NULL;
+
+    return TRUE;
+}
+
+/* caps are only known once the first chunk is opened, they're set
+from create, right before the first buffer */
+static gboolean
+gst_gcs_chunk_src_negotiate(GstBaseSrc *base_src)
+{
+    return TRUE;
+}
+
+static gboolean
+gst_gcs_chunk_src_is_seekable(GstBaseSrc *base_src)
+{
+    return TRUE;
+}
+
+static gboolean
+gst_gcs_chunk_src_do_seek(GstBaseSrc *base_src, GstSegment *segment)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(base_src);
+
+    /* chunks are only read front to back, reverse playback
+    is what GcsPlayer is for */
+    if(segment->rate < 0.0) {
+        return FALSE;
+    }
+
+    gst_gcs_chunk_src_close_chunk(src);
+
+    /* a new segment goes out before the next buffer */
+    src->started = 0;
+
+    uint64_t moment = src->base_moment + segment->start;
+    if(!gcs_index_iterator_seek(src->index_itr, moment, &src->seek_offset)) {
+        /* beyond the end, the next create returns EOS */
+        while(gcs_index_iterator_next(src->index_itr));
+        src->seek_offset = 0;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+gst_gcs_chunk_src_query(GstBaseSrc *base_src, GstQuery *query)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(base_src);
+
+    if(GST_QUERY_TYPE(query) == GST_QUERY_DURATION && src->index) {
+        GstFormat format;
+        gst_query_parse_duration(query, &format, NULL);
+
+        if(format == GST_FORMAT_TIME) {
+            gst_query_set_duration(query, GST_FORMAT_TIME,
+                src->end_moment - src->base_moment);
+            return TRUE;
+        }
+    }
+
+    return GST_BASE_SRC_CLASS(gst_gcs_chunk_src_parent_class)->query(
+        base_src, query);
+}
+
+static int
+gst_gcs_chunk_src_update_caps(GstGcsChunkSrc *src)
+{
+    GstCaps *caps = gcs_gst_new_h264_caps(src->reader->codec_private,
+        src->reader->codec_private_size);
+
+    if(src->caps && gst_caps_is_equal(src->caps, caps)) {
+        gst_caps_unref(caps);
+        return 1;
+    }
+
+    if(src->caps) {
+        gst_caps_unref(src->caps);
+    }
+
+    src->caps = caps;
+    return gst_base_src_set_caps(GST_BASE_SRC(src), caps);
+}
+
+/* opens the next chunk, pushing gap events for gaps on the
+way, returns 0 when there are no chunks left */
+static int
+gst_gcs_chunk_src_open_chunk(GstGcsChunkSrc *src)
+{
+    GcsChunk *chunk;
+    while((chunk = gcs_index_iterator_next(src->index_itr)) != NULL) {
+        src->chunk = *chunk;
+
+        uint64_t offset = src->seek_offset;
+        src->seek_offset = 0;
+
+        if(gcs_chunk_is_gap(chunk)) {
+            if(src->started) {
+                gst_pad_push_event(GST_BASE_SRC_PAD(src), gst_event_new_gap(
+                    chunk->start_moment + offset - src->base_moment,
+                    chunk->duration - offset));
+            }
+
+            continue;
+        }
+
+        char full_path[PATH_MAX];
+        if(!gcs_index_iterator_get_full_path(src->index_itr, chunk,
+            full_path, PATH_MAX)) {
+            continue;
+        }
+
+        src->reader = gcs_mkv_reader_open(full_path);
+        if(!src->reader) {
+            printf("[wrn] gcschunksrc: skipping %s, not supported\n",
+                full_path);
+            continue;
+        }
+
+        /* start at the keyframe before the moment that was sought to,
+        the frames before the moment are clipped by the segment */
+        GcsMetaKeyframe keyframe;
+        if(offset && gcs_index_iterator_find_keyframe(src->index_itr,
+            chunk, offset, &keyframe)) {
+            gcs_mkv_reader_seek(src->reader, keyframe.offset);
+        }
+
+        if(!gst_gcs_chunk_src_update_caps(src)) {
+            fprintf(stderr, "[err] gcschunksrc: unable to set caps for %s\n",
+                full_path);
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static GstFlowReturn
+gst_gcs_chunk_src_create(GstPushSrc *push_src, GstBuffer **buffer)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(push_src);
+
+    GcsMkvFrame frame;
+    while(1) {
+        if(!src->reader && !gst_gcs_chunk_src_open_chunk(src)) {
+            return GST_FLOW_EOS;
+        }
+
+        int ret = gcs_mkv_reader_next(src->reader, &frame);
+        if(ret > 0) {
+            break;
+        }
+
+        /* chunks that stop halfway (the recorder got killed) simply end
+        early, anything the reader doesn't know stops the chunk too */
+        if(ret < 0) {
+            printf("[wrn] gcschunksrc: unsupported block in chunk starting "
+                "at %" PRIu64 ", skipping the rest\n",
+                src->chunk.start_moment);
+        }
+
+        gst_gcs_chunk_src_close_chunk(src);
+    }
+
+    /* the frame is not copied, the buffer points into what the
+    reader read, whole clusters at a time */
+    GstBuffer *out = gcs_gst_new_frame_buffer(&frame);
+    GST_BUFFER_PTS(out) = src->chunk.start_moment - src->base_moment +
+        frame.time;
+
+    src->started = 1;
+
+    *buffer = out;
+    return GST_FLOW_OK;
+}
+
+static void
+gst_gcs_chunk_src_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(object);
+
+    switch(prop_id) {
+        case PROP_LOCATION:
+            GST_OBJECT_LOCK(src);
+            g_free(src->location);
+            src->location = g_value_dup_string(value);
+            GST_OBJECT_UNLOCK(src);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+gst_gcs_chunk_src_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(object);
+
+    switch(prop_id) {
+        case PROP_LOCATION:
+            GST_OBJECT_LOCK(src);
+            g_value_set_string(value, src->location);
+            GST_OBJECT_UNLOCK(src);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+gst_gcs_chunk_src_finalize(GObject *object)
+{
+    GstGcsChunkSrc *src = GST_GCS_CHUNK_SRC(object);
+    g_free(src->location);
+
+    G_OBJECT_CLASS(gst_gcs_chunk_src_parent_class)->finalize(object);
+}
+
+static void
+gst_gcs_chunk_src_class_init(GstGcsChunkSrcClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSrcClass *base_src_class = GST_BASE_SRC_CLASS(klass);
+    GstPushSrcClass *push_src_class = GST_PUSH_SRC_CLASS(klass);
+
+    gobject_class->set_property = gst_gcs_chunk_src_set_property;
+    gobject_class->get_property = gst_gcs_chunk_src_get_property;
+    gobject_class->finalize = gst_gcs_chunk_src_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+        g_param_spec_string("location", "Location",
+            "Directory with the chunks to play, or several, separated "
+            "by colons", NULL,
+            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+            GST_PARAM_MUTABLE_READY));
+
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_set_static_metadata(element_class,
+        "Chunk source", "Source/Video",
+        "Reads a directory of chunks as one continuous h264 stream",
+        PACKAGE);
+
+    base_src_class->start = gst_gcs_chunk_src_start;
+    base_src_class->stop = gst_gcs_chunk_src_stop;
+    base_src_class->negotiate = gst_gcs_chunk_src_negotiate;
+    base_src_class->is_seekable = gst_gcs_chunk_src_is_seekable;
+    base_src_class->do_seek = gst_gcs_chunk_src_do_seek;
+    base_src_class->query = gst_gcs_chunk_src_query;
+
+    push_src_class->create = gst_gcs_chunk_src_create;
+}
+
+static void
+gst_gcs_chunk_src_init(GstGcsChunkSrc *src)
+{
+    gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_TIME);
+    gst_base_src_set_live(GST_BASE_SRC(src), FALSE);
+}
+
+static gboolean
+plugin_init(GstPlugin *plugin)
+{
+    return gst_element_register(plugin, "gcschunksrc", GST_RANK_NONE,
+        GST_TYPE_GCS_CHUNK_SRC);
+}
+
+GST_PLUGIN_DEFINE(GST_VERSION_MAJOR, GST_VERSION_MINOR, gcschunksrc,
+    "Chunk source", plugin_init, VERSION, "unknown", PACKAGE,
+    "unknown")
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include <gcs/mem.h>
+#include <gcs/arena.h>
+
+static char *
+get_block(GcsStringArena *arena, uint32_t block)
+{
+    char **table = (char **) g_atomic_pointer_get(
+        &arena->tables[block / GCS_ARENA_TABLE_SIZE]);
+
+    if(!table) {
+        return NULL;
+    }
+
+    return (char *) g_atomic_pointer_get(
+        &table[block % GCS_ARENA_TABLE_SIZE]);
+}
+
+static int
+add_block(GcsStringArena *arena)
+{
+    uint32_t block = arena->block_count;
+    if(block >= GCS_ARENA_TABLE_SIZE * GCS_ARENA_TABLE_SIZE) {
+        return 0;
+    }
+
+    char **table = arena->tables[block / GCS_ARENA_TABLE_SIZE];
+    if(!table) {
+        table = ALLOC_NULL(char **, sizeof(char *) * GCS_ARENA_TABLE_SIZE);
+        g_atomic_pointer_set(&arena->tables[block / GCS_ARENA_TABLE_SIZE],
+            table);
+    }
+
+    g_atomic_pointer_set(&table[block % GCS_ARENA_TABLE_SIZE],
+        ALLOC_NULL(char *, GCS_ARENA_BLOCK_SIZE));
+
+    ++arena->block_count;
+    return 1;
+}
+
+GcsStringArena *
+gcs_arena_new()
+{
+    GcsStringArena *arena = ALLOC_NULL(GcsStringArena *,
+        sizeof(GcsStringArena));
+
+    arena->ref_count = 1;
+    return arena;
+}
+
+uint32_t
+gcs_arena_add(GcsStringArena *arena, const char *str, int str_len)
+{
+    /* include the null terminator */
+    uint32_t needed = (uint32_t) str_len + 1;
+    if(needed > GCS_ARENA_BLOCK_SIZE) {
+        return GCS_ARENA_INVALID_OFFSET;
+    }
+
+    uint32_t used = arena->offset % GCS_ARENA_BLOCK_SIZE;
+
+    /* the string does not fit in the current block, skip the rest
+    of it and start a new one */
+    if(arena->block_count == 0 || used + needed > GCS_ARENA_BLOCK_SIZE) {
+        if(arena->block_count > 0) {
+            arena->offset += (GCS_ARENA_BLOCK_SIZE - used);
+        }
+
+        /* offsets are 32-bit, which gives us 4 GiB of strings */
+        if(arena->offset > UINT32_MAX - GCS_ARENA_BLOCK_SIZE ||
+            !add_block(arena)) {
+            return GCS_ARENA_INVALID_OFFSET;
+        }
+
+        used = 0;
+    }
+
+    uint32_t offset = arena->offset;
+    char *block = get_block(arena, offset / GCS_ARENA_BLOCK_SIZE);
+
+    memcpy(block + used, str, str_len);
+    block[used + str_len] = '\0';
+
+    arena->offset += needed;
+    return offset;
+}
+
+const char *
+gcs_arena_get(GcsStringArena *arena, uint32_t offset)
+{
+    if(offset == GCS_ARENA_INVALID_OFFSET) {
+        return NULL;
+    }
+
+    char *block = get_block(arena, offset / GCS_ARENA_BLOCK_SIZE);
+    if(!block) {
+        return NULL;
+    }
+
+    return block + (offset % GCS_ARENA_BLOCK_SIZE);
+}
+
+uint64_t
+gcs_arena_size(GcsStringArena *arena)
+{
+    return (uint64_t) arena->block_count * GCS_ARENA_BLOCK_SIZE;
+}
+
+GcsStringArena *
+gcs_arena_ref(GcsStringArena *arena)
+{
+    g_atomic_int_inc(&arena->ref_count);
+    return arena;
+}
+
+void
+gcs_arena_free(GcsStringArena *arena)
+{
+    if(!arena) {
+        return;
+    }
+
+    /* drops a reference, the strings stay until the last one */
+    if(!g_atomic_int_dec_and_test(&arena->ref_count)) {
+        return;
+    }
+
+    int i;
+    for(i = 0; i < GCS_ARENA_TABLE_SIZE; ++i) {
+        char **table = arena->tables[i];
+        if(!table) {
+            continue;
+        }
+
+        int j;
+        for(j = 0; j < GCS_ARENA_TABLE_SIZE; ++j) {
+            free(table[j]);
+        }
+
+        free(table);
+    }
+
+    free(arena);
+}
@@ -0,0 +1,48 @@
+#ifndef __gst_chunks_shared_arena_h
+#define __gst_chunks_shared_arena_h
+
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+/* strings are packed into blocks of this size, a string never
+spans two blocks so it can always be used in-place */
+#define GCS_ARENA_BLOCK_SIZE 65536
+
+/* blocks are found through a fixed two-level table instead of
+an array that grows, so the table never moves and readers on
+other threads can look strings up while new ones are added,
+256 tables of 256 blocks covers the whole 32-bit offset range */
+#define GCS_ARENA_TABLE_SIZE 256
+
+/* returned when a string could not be added */
+#define GCS_ARENA_INVALID_OFFSET UINT32_MAX
+
+/* append-only storage for lots of small strings (such as the
+filenames of chunks), strings are referred to by a 32-bit offset
+instead of a pointer, which keeps the structures that refer to
+them small, strings are never moved or freed individually
+
+only one thread may add strings, any thread may get strings
+whose offset was handed to it after they were added, whoever hands
+out offsets to other threads takes a reference for them, the
+arena is freed when the last reference is dropped */
+typedef struct {
+    gint ref_count;
+
+    char **tables[GCS_ARENA_TABLE_SIZE];
+    uint32_t block_count;
+
+    /* offset at which the next string is going to be stored */
+    uint32_t offset;
+} GcsStringArena;
+
+GcsStringArena *    gcs_arena_new();
+uint32_t            gcs_arena_add(GcsStringArena *arena, const char *str,
+                        int str_len);
+const char *        gcs_arena_get(GcsStringArena *arena, uint32_t offset);
+uint64_t            gcs_arena_size(GcsStringArena *arena);
+GcsStringArena *    gcs_arena_ref(GcsStringArena *arena);
+void                gcs_arena_free(GcsStringArena *arena);
+
+#endif /* __gst_chunks_shared_arena_h */
@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <gcs/mem.h>
+#include <gcs/cache.h>
+
+/* the file starts with a small header, followed by `count`
+entries, all values are written in host byte order since the
+cache never leaves the machine it was created on:
+
+    char     magic[4]      "GCSI"
+    uint32_t version
+    uint32_t count
+    uint64_t end           offset right after the last counted entry
+
+    per entry:
+    uint16_t filename_len
+    char     filename[filename_len]
+    int64_t  mtime
+    uint64_t size
+    uint64_t start_moment
+    uint64_t stop_moment
+    uint64_t duration
+*/
+
+static const char CACHE_MAGIC[4] = { 'G', 'C', 'S', 'I' };
+
+/* count and end are next to each other, so appending an entry
+updates both with a single write */
+#define CACHE_COUNT_OFFSET 8
+#define CACHE_HEADER_SIZE 20
+
+static void
+build_cache_path(char *directory, char *path, int path_len)
+{
+    snprintf(path, path_len, "%s/%s", directory, GCS_CACHE_FILENAME);
+}
+
+static int
+read_entry(FILE *file, char *filename, GcsCacheEntry *entry)
+{
+    uint16_t filename_len = 0;
+    if(fread(&filename_len, sizeof(filename_len), 1, file) != 1) {
+        return 0;
+    }
+
+    /* NAME_MAX doesn't count the terminator, the buffer has
+    room for it */
+    if(filename_len == 0 || filename_len > NAME_MAX) {
+        return 0;
+    }
+
+    if(fread(filename, 1, filename_len, file) != filename_len) {
+        return 0;
+    }
+
+    filename[filename_len] = '\0';
+
+    if(fread(&entry->mtime, sizeof(entry->mtime), 1, file) != 1 ||
+        fread(&entry->size, sizeof(entry->size), 1, file) != 1 ||
+        fread(&entry->start_moment, sizeof(entry->start_moment), 1, file) != 1 ||
+        fread(&entry->stop_moment, sizeof(entry->stop_moment), 1, file) != 1 ||
+        fread(&entry->duration, sizeof(entry->duration), 1, file) != 1) {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+write_entry(FILE *file, const char *filename, GcsCacheEntry *entry)
+{
+    uint16_t filename_len = (uint16_t) strlen(filename);
+
+    if(fwrite(&filename_len, sizeof(filename_len), 1, file) != 1 ||
+        fwrite(filename, 1, filename_len, file) != filename_len ||
+        fwrite(&entry->mtime, sizeof(entry->mtime), 1, file) != 1 ||
+        fwrite(&entry->size, sizeof(entry->size), 1, file) != 1 ||
+        fwrite(&entry->start_moment, sizeof(entry->start_moment), 1, file) != 1 ||
+        fwrite(&entry->stop_moment, sizeof(entry->stop_moment), 1, file) != 1 ||
+        fwrite(&entry->duration, sizeof(entry->duration), 1, file) != 1) {
+        return 0;
+    }
+
+    return 1;
+}
+
+GcsCache *
+gcs_cache_new()
+{
+    GcsCache *cache = ALLOC_NULL(GcsCache *, sizeof(GcsCache));
+
+    /* both the keys (filenames) and values (entries) are owned
+    by the hash table */
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+        free, free);
+
+    return cache;
+}
+
+int
+gcs_cache_load(GcsCache *cache, char *directory)
+{
+    char path[PATH_MAX];
+    build_cache_path(directory, path, PATH_MAX);
+
+    /* no cache yet is perfectly fine, we'll create one */
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        return 0;
+    }
+
+    /* keeps appends out while we read, they'd change the count
+    under our feet */
+    flock(fileno(file), LOCK_SH);
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    uint64_t end = 0;
+
+    if(fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        fread(&version, sizeof(version), 1, file) != 1) {
+        fclose(file);
+        return 0;
+    }
+
+    if(memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        version != GCS_CACHE_VERSION ||
+        fread(&count, sizeof(count), 1, file) != 1 ||
+        fread(&end, sizeof(end), 1, file) != 1) {
+        printf("[wrn] ignoring incompatible index cache '%s'\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        char filename[NAME_MAX + 1];
+        GcsCacheEntry *entry = ALLOC_NULL(GcsCacheEntry *,
+            sizeof(GcsCacheEntry));
+
+        /* a truncated cache is not fatal, everything we could
+        not read will simply be probed again */
+        if(!read_entry(file, filename, entry)) {
+            printf("[wrn] index cache '%s' is truncated\n", path);
+            free(entry);
+            break;
+        }
+
+        /* entries appended after a fill can repeat a file, the
+        later one wins and the next save writes it only once */
+        if(!g_hash_table_insert(cache->entries, strdup(filename), entry)) {
+            cache->dirty = 1;
+        }
+    }
+
+    fclose(file);
+    return (int) g_hash_table_size(cache->entries);
+}
+
+int
+gcs_cache_save(GcsCache *cache, char *directory)
+{
+    /* count the entries we're going to write, entries for files
+    that disappeared are dropped, which also makes the cache dirty */
+    uint32_t count = 0;
+
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, cache->entries);
+    while(g_hash_table_iter_next(&iter, &key, &value)) {
+        GcsCacheEntry *entry = (GcsCacheEntry *) value;
+        if(entry->seen) {
+            ++count;
+        }
+    }
+
+    if(!cache->dirty && count == g_hash_table_size(cache->entries)) {
+        return 1;
+    }
+
+    /* write to a temporary file first and then rename it over
+    the old one, so readers never see a half written cache */
+    char path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    build_cache_path(directory, path, PATH_MAX);
+    snprintf(temp_path, PATH_MAX, "%s.tmp", path);
+
+    /* appends wait on the lock of the old file until it was
+    replaced, and then go to the new one */
+    int lock_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(lock_fd >= 0) {
+        flock(lock_fd, LOCK_EX);
+    }
+
+    FILE *file = fopen(temp_path, "wb");
+    if(!file) {
+        /* the recording directory might be read-only for us,
+        that only costs us a slower start next time */
+        printf("[wrn] could not write index cache '%s'\n", path);
+        if(lock_fd >= 0) {
+            close(lock_fd);
+        }
+        return 0;
+    }
+
+    /* end is filled in once we know it */
+    uint32_t version = GCS_CACHE_VERSION;
+    uint64_t end = 0;
+    int result = (fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), file) == sizeof(CACHE_MAGIC) &&
+        fwrite(&version, sizeof(version), 1, file) == 1 &&
+        fwrite(&count, sizeof(count), 1, file) == 1 &&
+        fwrite(&end, sizeof(end), 1, file) == 1);
+
+    g_hash_table_iter_init(&iter, cache->entries);
+    while(result && g_hash_table_iter_next(&iter, &key, &value)) {
+        GcsCacheEntry *entry = (GcsCacheEntry *) value;
+        if(!entry->seen) {
+            continue;
+        }
+
+        result = write_entry(file, (const char *) key, entry);
+    }
+
+    if(result) {
+        long position = ftell(file);
+        end = (uint64_t) position;
+        result = (position > 0 &&
+            fseek(file, CACHE_COUNT_OFFSET + sizeof(count), SEEK_SET) == 0 &&
+            fwrite(&end, sizeof(end), 1, file) == 1);
+    }
+
+    if(fclose(file) != 0) {
+        result = 0;
+    }
+
+    if(!result || rename(temp_path, path) != 0) {
+        printf("[wrn] could not write index cache '%s'\n", path);
+        remove(temp_path);
+        result = 0;
+    }
+
+    if(lock_fd >= 0) {
+        close(lock_fd);
+    }
+
+    if(!result) {
+        return 0;
+    }
+
+    cache->dirty = 0;
+    return 1;
+}
+
+GcsCacheEntry *
+gcs_cache_lookup(GcsCache *cache, const char *filename,
+    struct stat *file_info)
+{
+    GcsCacheEntry *entry = (GcsCacheEntry *) g_hash_table_lookup(
+        cache->entries, filename);
+
+    if(!entry) {
+        return NULL;
+    }
+
+    /* the file changed since we probed it (for example, it was
+    still being written), the entry is useless */
+    if(entry->mtime != (int64_t) file_info->st_mtime ||
+        entry->size != (uint64_t) file_info->st_size) {
+        return NULL;
+    }
+
+    entry->seen = 1;
+    return entry;
+}
+
+void
+gcs_cache_store(GcsCache *cache, const char *filename,
+    struct stat *file_info, uint64_t start_moment, uint64_t stop_moment,
+    uint64_t duration)
+{
+    /* the same bound read_entry has, a longer name would make
+    the whole cache unreadable the next time */
+    if(strlen(filename) > NAME_MAX) {
+        return;
+    }
+
+    GcsCacheEntry *entry = ALLOC_NULL(GcsCacheEntry *, sizeof(GcsCacheEntry));
+    entry->mtime = (int64_t) file_info->st_mtime;
+    entry->size = (uint64_t) file_info->st_size;
+    entry->start_moment = start_moment;
+    entry->stop_moment = stop_moment;
+    entry->duration = duration;
+    entry->seen = 1;
+
+    /* replaces (and frees) an existing entry for this file */
+    g_hash_table_insert(cache->entries, strdup(filename), entry);
+    cache->dirty = 1;
+}
+
+int
+gcs_cache_append(char *directory, const char *filename,
+    struct stat *file_info, uint64_t start_moment, uint64_t stop_moment,
+    uint64_t duration)
+{
+    if(strlen(filename) > NAME_MAX) {
+        return 0;
+    }
+
+    char path[PATH_MAX];
+    build_cache_path(directory, path, PATH_MAX);
+
+    /* the recorder and every reader of the directory append to
+    the same file, the lock serializes them, a save renames a new
+    file over the one we locked, in which case we start over on
+    the new one */
+    int fd = -1;
+    for(;;) {
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            return 0;
+        }
+
+        flock(fd, LOCK_EX);
+
+        struct stat locked_info;
+        struct stat path_info;
+        if(fstat(fd, &locked_info) == 0 && stat(path, &path_info) == 0 &&
+            locked_info.st_ino == path_info.st_ino &&
+            locked_info.st_dev == path_info.st_dev) {
+            break;
+        }
+
+        close(fd);
+    }
+
+    FILE *file = fdopen(fd, "r+b");
+    if(!file) {
+        close(fd);
+        return 0;
+    }
+
+    uint32_t version = GCS_CACHE_VERSION;
+    uint32_t count = 0;
+    uint64_t end = CACHE_HEADER_SIZE;
+
+    char magic[4];
+    size_t header_read = fread(magic, 1, sizeof(magic), file);
+    if(header_read == 0) {
+        /* we just created it */
+        if(fseek(file, 0, SEEK_SET) != 0 ||
+            fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), file) != sizeof(CACHE_MAGIC) ||
+            fwrite(&version, sizeof(version), 1, file) != 1 ||
+            fwrite(&count, sizeof(count), 1, file) != 1 ||
+            fwrite(&end, sizeof(end), 1, file) != 1) {
+            fclose(file);
+            return 0;
+        }
+    } else if(header_read != sizeof(magic) ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        version != GCS_CACHE_VERSION ||
+        fread(&count, sizeof(count), 1, file) != 1 ||
+        fread(&end, sizeof(end), 1, file) != 1 ||
+        end < CACHE_HEADER_SIZE) {
+        /* the next fill rewrites it anyway */
+        fclose(file);
+        return 0;
+    }
+
+    GcsCacheEntry entry;
+    entry.mtime = (int64_t) file_info->st_mtime;
+    entry.size = (uint64_t) file_info->st_size;
+    entry.start_moment = start_moment;
+    entry.stop_moment = stop_moment;
+    entry.duration = duration;
+
+    /* the entry goes right after the counted ones, not at the end
+    of the file, so whatever an earlier append left behind when it
+    crashed before updating the header is simply overwritten, the
+    header is only updated once the entry is complete */
+    int result = (fseeko(file, (off_t) end, SEEK_SET) == 0 &&
+        write_entry(file, filename, &entry));
+
+    if(result) {
+        off_t position = ftello(file);
+        ++count;
+        end = (uint64_t) position;
+        result = (position > 0 && fflush(file) == 0 &&
+            fseek(file, CACHE_COUNT_OFFSET, SEEK_SET) == 0 &&
+            fwrite(&count, sizeof(count), 1, file) == 1 &&
+            fwrite(&end, sizeof(end), 1, file) == 1);
+    }
+
+    /* closing the stream closes the descriptor and drops the lock */
+    if(fclose(file) != 0) {
+        result = 0;
+    }
+
+    return result;
+}
+
+void
+gcs_cache_free(GcsCache *cache)
+{
+    if(!cache) {
+        return;
+    }
+
+    if(cache->entries) {
+        g_hash_table_destroy(cache->entries);
+    }
+
+    free(cache);
+}
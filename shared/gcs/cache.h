@@ -0,0 +1,59 @@
+#ifndef __gst_chunks_shared_cache_h
+#define __gst_chunks_shared_cache_h
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <gst/gst.h>
+
+/* name of the file (inside the recording directory) that the
+cache is persisted to, starts with a dot so the indexer skips it */
+#define GCS_CACHE_FILENAME ".gcs-index"
+
+/* bump this whenever the layout of an entry changes, caches
+with a different version are discarded and rebuilt */
+#define GCS_CACHE_VERSION 2
+
+/* what we remember about a single chunk file, mtime and size
+are used to detect that a file changed since it was probed */
+typedef struct {
+    int64_t mtime;
+    uint64_t size;
+
+    uint64_t start_moment;
+    uint64_t stop_moment;
+    uint64_t duration;
+
+    /* set when the file was seen during the last fill, only
+    seen entries are written back so deleted files drop out */
+    int seen;
+} GcsCacheEntry;
+
+typedef struct {
+    /* filename -> GcsCacheEntry */
+    GHashTable *entries;
+
+    /* set when something was added or updated, so we don't
+    rewrite the file when nothing changed */
+    int dirty;
+} GcsCache;
+
+GcsCache *      gcs_cache_new();
+int             gcs_cache_load(GcsCache *cache, char *directory);
+int             gcs_cache_save(GcsCache *cache, char *directory);
+GcsCacheEntry * gcs_cache_lookup(GcsCache *cache, const char *filename,
+                    struct stat *file_info);
+void            gcs_cache_store(GcsCache *cache, const char *filename,
+                    struct stat *file_info, uint64_t start_moment,
+                    uint64_t stop_moment, uint64_t duration);
+
+/* adds a single entry to the cache file in the directory without
+loading it, for chunks that show up after the index was filled, an
+older entry for the same file is replaced when the cache is loaded,
+safe to call from several processes at once */
+int             gcs_cache_append(char *directory, const char *filename,
+                    struct stat *file_info, uint64_t start_moment,
+                    uint64_t stop_moment, uint64_t duration);
+void            gcs_cache_free(GcsCache *cache);
+
+#endif /* __gst_chunks_shared_cache_h */
@@ -1,42 +1,208 @@
 #include <string.h>
 #include <stdio.h>
-#include <unistd.h>
+#include <limits.h>
 
 #include <gcs/chunk.h>
 #include <gcs/meta.h>
 #include <gcs/mem.h>
 #include <gcs/time.h>
 
-static void
-update_full_path(GcsChunk *chunk, int directory_len, int filename_len)
+/* "DD-MM-YYYY_HH-MM-SS", the legacy format uses ';' between the
+hours, minutes and seconds instead */
+#define FILENAME_TIMESTAMP_LEN 19
+
+/* amount of days each thread remembers the utc offset of */
+#define DAY_OFFSET_CACHE_SIZE 16
+
+#define SECONDS_PER_DAY 86400
+
+/* utc offset of a single (local) day, a day has two offsets when
+daylight saving starts or ends on it */
+typedef struct {
+    int64_t day;
+    int64_t offset;
+    int64_t end_offset;
+
+    /* utc moment (in seconds) the end offset applies from */
+    int64_t transition;
+
+    int used;
+} GcsChunkDayOffset;
+
+/* the index parses names on many threads at once, each of them
+gets its own cache so no locking is needed */
+static __thread GcsChunkDayOffset day_offsets[DAY_OFFSET_CACHE_SIZE];
+
+static int
+parse_digits(const char *str, int len, int *value)
 {
-    /* todo: add proper path joining, if the directory ends with a /
-    or the filename starts with a / you'll have // */
+    int result = 0;
 
-    char *cwd = getcwd (NULL, 0);
+    int i;
+    for(i = 0; i < len; ++i) {
+        if(str[i] < '0' || str[i] > '9') {
+            return 0;
+        }
 
-    char temp[PATH_MAX];
-    snprintf(temp, PATH_MAX, "%s/%s/%s",
-        cwd, chunk->directory, chunk->filename);
+        result = result * 10 + (str[i] - '0');
+    }
 
-    /* resolve symlinks and ./ and ../ */
-    realpath(temp, chunk->full_path);
+    *value = result;
+    return 1;
 }
 
-static void
-update_start_moment(GcsChunk *chunk)
+static int64_t
+days_from_civil(int year, int month, int day)
+{
+    /* days since 1970-01-01 of a date in the (proleptic) gregorian
+    calendar, without going through mktime, see
+    http://howardhinnant.github.io/date_algorithms.html */
+    year -= (month <= 2);
+
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 +
+        day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+        year_of_era / 100 + day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+static int64_t
+get_utc_offset(time_t moment)
+{
+    struct tm local_time;
+    localtime_r(&moment, &local_time);
+
+    return (int64_t) local_time.tm_gmtoff;
+}
+
+static time_t
+get_local_midnight(int year, int month, int day)
+{
+    struct tm date_time;
+    memset(&date_time, 0, sizeof(date_time));
+
+    date_time.tm_year = year - 1900;
+    date_time.tm_mon = month - 1;
+    date_time.tm_mday = day;
+    date_time.tm_isdst = -1;
+
+    return mktime(&date_time);
+}
+
+static GcsChunkDayOffset *
+get_day_offset(int year, int month, int day)
+{
+    int64_t day_number = days_from_civil(year, month, day);
+
+    GcsChunkDayOffset *day_offset = &day_offsets[
+        (uint64_t) day_number % DAY_OFFSET_CACHE_SIZE];
+
+    if(day_offset->used && day_offset->day == day_number) {
+        return day_offset;
+    }
+
+    /* this is the only place we ask the c library, once per
+    day instead of once per chunk */
+    time_t start = get_local_midnight(year, month, day);
+    time_t end = get_local_midnight(year, month, day + 1);
+
+    day_offset->day = day_number;
+    day_offset->offset = get_utc_offset(start);
+    day_offset->end_offset = get_utc_offset(end - 1);
+    day_offset->transition = INT64_MAX;
+    day_offset->used = 1;
+
+    /* the clocks changed on this day, find the exact moment */
+    if(day_offset->offset != day_offset->end_offset) {
+        time_t low = start;
+        time_t high = end - 1;
+
+        while(low < high) {
+            time_t middle = low + (high - low) / 2;
+
+            if(get_utc_offset(middle) == day_offset->end_offset) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+
+        day_offset->transition = (int64_t) low;
+    }
+
+    return day_offset;
+}
+
+static int
+parse_fixed_width(const char *filename, uint64_t *start_moment)
+{
+    /* the name is fixed width, so every field is at a known
+    position, anything that doesn't match exactly is left to the
+    slow path */
+    if(strlen(filename) < FILENAME_TIMESTAMP_LEN) {
+        return 0;
+    }
+
+    char separator = filename[13];
+    if(filename[2] != '-' || filename[5] != '-' || filename[10] != '_' ||
+        (separator != '-' && separator != ';') || filename[16] != separator) {
+        return 0;
+    }
+
+    int day, month, year, hour, minute, second;
+    if(!parse_digits(filename, 2, &day) ||
+        !parse_digits(filename + 3, 2, &month) ||
+        !parse_digits(filename + 6, 4, &year) ||
+        !parse_digits(filename + 11, 2, &hour) ||
+        !parse_digits(filename + 14, 2, &minute) ||
+        !parse_digits(filename + 17, 2, &second)) {
+        return 0;
+    }
+
+    if(day < 1 || day > 31 || month < 1 || month > 12 || hour > 23 ||
+        minute > 59 || second > 60) {
+        return 0;
+    }
+
+    GcsChunkDayOffset *day_offset = get_day_offset(year, month, day);
+
+    /* the local time as if it were utc, minus the offset of that
+    day, which is the second offset once the clocks changed */
+    int64_t local_moment = day_offset->day * SECONDS_PER_DAY +
+        hour * 3600 + minute * 60 + second;
+
+    int64_t moment = local_moment - day_offset->offset;
+    if(moment >= day_offset->transition) {
+        moment = local_moment - day_offset->end_offset;
+    }
+
+    *start_moment = GCS_TIME_SECONDS_AS_NANO((uint64_t) moment);
+    return 1;
+}
+
+uint64_t
+gcs_chunk_parse_start_moment(const char *filename)
 {
+    uint64_t start_moment = 0;
+    if(parse_fixed_width(filename, &start_moment)) {
+        return start_moment;
+    }
+
     /* when I started developing this, I used a different
     filename format, detect that and fall back to the old one */
     char *format = "%d-%d-%d_%d-%d-%d";
-    if(strstr(chunk->filename, ";") != NULL) {
+    if(strstr(filename, ";") != NULL) {
         printf("[wrn] falling back to old filename format\n");
         format = "%d-%d-%d_%d;%d;%d";
     }
 
     struct tm time_info;
+    memset(&time_info, 0, sizeof(time_info));
 
-    sscanf(chunk->filename, format,
+    sscanf(filename, format,
         &time_info.tm_mday,
         &time_info.tm_mon,
         &time_info.tm_year,
@@ -45,37 +211,55 @@ update_start_moment(GcsChunk *chunk)
         &time_info.tm_sec);
 
     /* year is since 1900 (2015 == 1015) and month
-    is zero-based */
+    is zero-based, let mktime figure out daylight saving */
     time_info.tm_year -= 1900;
     time_info.tm_mon -= 1;
+    time_info.tm_isdst = -1;
 
     /* convert seconds to nano seconds */
-    chunk->start_moment = (uint64_t) mktime(&time_info);
-    chunk->start_moment = GCS_TIME_SECONDS_AS_NANO(chunk->start_moment);
+    start_moment = (uint64_t) mktime(&time_info);
+    return GCS_TIME_SECONDS_AS_NANO(start_moment);
 }
 
 static void
-update_stop_moment(GcsChunk *chunk)
+update_stop_moment(GcsChunk *chunk, const char *full_path)
 {
-    chunk->duration = gcs_meta_get_mkv_duration(chunk->full_path);
+    chunk->duration = gcs_meta_get_mkv_duration(full_path);
     chunk->stop_moment = chunk->start_moment + chunk->duration;
 }
 
 GcsChunk
-gcs_chunk_new(char *directory, int directory_len, char *filename,
-    int filename_len)
+gcs_chunk_new(const char *directory, const char *filename,
+    uint32_t filename_offset)
 {
     GcsChunk new_chunk;
+    new_chunk.filename = filename_offset;
+    new_chunk.directory = 0;
 
-    memcpy(new_chunk.directory, directory, directory_len);
-    new_chunk.directory[directory_len] = '\0';
+    /* the full path is only needed to probe the file, so it
+    is built on the stack instead of being stored */
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s", directory, filename);
 
-    memcpy(new_chunk.filename, filename, filename_len);
-    new_chunk.filename[filename_len] = '\0';
+    new_chunk.start_moment = gcs_chunk_parse_start_moment(filename);
+    update_stop_moment(&new_chunk, full_path);
 
-    update_full_path(&new_chunk, directory_len, filename_len);
-    update_start_moment(&new_chunk);
-    update_stop_moment(&new_chunk);
+    return new_chunk;
+}
+
+GcsChunk
+gcs_chunk_new_with_times(uint32_t filename_offset, uint64_t start,
+    uint64_t stop, uint64_t duration)
+{
+    GcsChunk new_chunk;
+    new_chunk.filename = filename_offset;
+    new_chunk.directory = 0;
+
+    /* times come from somewhere we trust (the index cache), so
+    skip parsing the filename and probing the file */
+    new_chunk.start_moment = start;
+    new_chunk.stop_moment = stop;
+    new_chunk.duration = duration;
 
     return new_chunk;
 }
@@ -89,9 +273,9 @@ gcs_chunk_new_gap(uint64_t start, uint64_t stop)
     new_chunk.stop_moment = stop;
     new_chunk.duration = (stop - start);
 
-    /* although we allocate using calloc, just be sure
-    this is recognized as a gap */
-    new_chunk.filename[0] = 0;
+    /* gaps have no file */
+    new_chunk.filename = GCS_CHUNK_NO_FILENAME;
+    new_chunk.directory = 0;
 
     return new_chunk;
 }
@@ -103,12 +287,12 @@ gcs_chunk_is_gap(GcsChunk *chunk)
         return 0;
     }
 
-    int is_gap = (chunk->filename[0] == 0);
+    int is_gap = (chunk->filename == GCS_CHUNK_NO_FILENAME);
     return is_gap;
 }
 
 void
-gcs_chunk_print(GcsChunk *chunk)
+gcs_chunk_print(GcsChunk *chunk, const char *filename)
 {
     if(!chunk) {
         return;
@@ -123,7 +307,7 @@ gcs_chunk_print(GcsChunk *chunk)
     struct tm start_info = *localtime(&start);
     struct tm stop_info = *localtime(&stop);
 
-    printf("%s - %i:%i:%i - %i:%i:%i\n", chunk->filename, start_info.tm_hour,
-        start_info.tm_min, start_info.tm_sec, stop_info.tm_hour,
-        stop_info.tm_min, stop_info.tm_sec);
+    printf("%s - %i:%i:%i - %i:%i:%i\n", filename ? filename : "gap",
+        start_info.tm_hour, start_info.tm_min, start_info.tm_sec,
+        stop_info.tm_hour, stop_info.tm_min, stop_info.tm_sec);
 }
@@ -5,13 +5,13 @@
 #include <dirent.h>
 #include <time.h>
 
-/* explictly made all strings array so the whole
-structure can be freed easily */
-typedef struct {
-    char filename[PATH_MAX];
-    char directory[PATH_MAX];
-    char full_path[PATH_MAX];
+/* filename offset of chunks that have no file (gaps) */
+#define GCS_CHUNK_NO_FILENAME UINT32_MAX
 
+/* kept as small as possible, indexes hold hundreds of thousands
+of these and sort them, the filename and directory live in the
+index the chunk belongs to (see gcs_index_get_filename) */
+typedef struct {
     /* start and stop moments are UNIX EPOCH timestamps
     in nanoseconds, so the amount of nanoseconds from
     1st of January 1970 */
@@ -20,13 +20,23 @@ typedef struct {
 
     /* nano seconds (stop_moment = start_moment + duration) */
     uint64_t duration;
+
+    /* offset of the filename in the index's string arena */
+    uint32_t filename;
+
+    /* directory of the chunk in the index's directory table */
+    uint16_t directory;
 } GcsChunk;
 
-GcsChunk    gcs_chunk_new(char *directory, int directory_len, char *filename,
-                int filename_len);
+GcsChunk    gcs_chunk_new(const char *directory, const char *filename,
+                uint32_t filename_offset);
+
+GcsChunk    gcs_chunk_new_with_times(uint32_t filename_offset, uint64_t start,
+                uint64_t stop, uint64_t duration);
 
 GcsChunk    gcs_chunk_new_gap(uint64_t start, uint64_t stop);
+uint64_t    gcs_chunk_parse_start_moment(const char *filename);
 int         gcs_chunk_is_gap(GcsChunk *chunk);
-void        gcs_chunk_print(GcsChunk *chunk);
+void        gcs_chunk_print(GcsChunk *chunk, const char *filename);
 
 #endif /* __gst_chunks_shared_chunk_h */
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <gcs/ebml.h>
+
+int
+gcs_ebml_read_vint(const uint8_t *data, int data_len, int keep_marker,
+    uint64_t *value)
+{
+    if(data_len <= 0 || data[0] == 0) {
+        return 0;
+    }
+
+    /* the number of leading zero bits determines the length */
+    int len = 1;
+    uint8_t mask = 0x80;
+    while(!(data[0] & mask)) {
+        mask >>= 1;
+        ++len;
+    }
+
+    if(len > 8 || len > data_len) {
+        return 0;
+    }
+
+    uint64_t result = keep_marker ? data[0] : (data[0] & (mask - 1));
+    int all_ones = ((data[0] & (mask - 1)) == (mask - 1));
+
+    int i;
+    for(i = 1; i < len; ++i) {
+        result = (result << 8) | data[i];
+        all_ones = all_ones && (data[i] == 0xFF);
+    }
+
+    /* a size with all data bits set means "unknown" */
+    if(!keep_marker && all_ones) {
+        result = GCS_MKV_UNKNOWN_SIZE;
+    }
+
+    *value = result;
+    return len;
+}
+
+uint64_t
+gcs_ebml_read_uint(const uint8_t *data, uint64_t size)
+{
+    uint64_t result = 0;
+
+    uint64_t i;
+    for(i = 0; i < size && i < 8; ++i) {
+        result = (result << 8) | data[i];
+    }
+
+    return result;
+}
+
+double
+gcs_ebml_read_float(const uint8_t *data, uint64_t size)
+{
+    uint64_t bits = gcs_ebml_read_uint(data, size);
+
+    if(size == 4) {
+        uint32_t bits32 = (uint32_t) bits;
+        float value;
+        memcpy(&value, &bits32, sizeof(value));
+        return (double) value;
+    }
+
+    if(size == 8) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    return 0.0;
+}
+
+const uint8_t *
+gcs_ebml_read_child(const uint8_t *data, int data_len, int *position,
+    uint64_t *id, uint64_t *size)
+{
+    /* reads the header of the element at `position` in an element
+    that was read into memory completely, returns its data */
+    int id_len = gcs_ebml_read_vint(data + *position, data_len - *position,
+        1, id);
+    if(id_len <= 0) {
+        return NULL;
+    }
+
+    int size_len = gcs_ebml_read_vint(data + *position + id_len,
+        data_len - *position - id_len, 0, size);
+
+    if(size_len <= 0 ||
+        *size > (uint64_t) (data_len - *position - id_len - size_len)) {
+        return NULL;
+    }
+
+    const uint8_t *child = data + *position + id_len + size_len;
+    *position += id_len + size_len + (int) *size;
+
+    return child;
+}
+
+int
+gcs_ebml_is_level1_id(uint64_t id)
+{
+    return id == GCS_MKV_ID_CLUSTER || id == GCS_MKV_ID_CUES ||
+        id == GCS_MKV_ID_SEEK_HEAD || id == GCS_MKV_ID_INFO ||
+        id == GCS_MKV_ID_TRACKS || id == GCS_MKV_ID_TAGS ||
+        id == GCS_MKV_ID_CHAPTERS || id == GCS_MKV_ID_ATTACHMENTS;
+}
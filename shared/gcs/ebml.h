@@ -0,0 +1,81 @@
+#ifndef __gst_chunks_shared_ebml_h
+#define __gst_chunks_shared_ebml_h
+
+#include <stdint.h>
+
+/* matroska element id's that we care about, id's are stored
+including their length marker, as in the specification */
+#define GCS_MKV_ID_EBML                 0x1A45DFA3
+#define GCS_MKV_ID_SEGMENT              0x18538067
+#define GCS_MKV_ID_INFO                 0x1549A966
+#define GCS_MKV_ID_TIMECODE_SCALE       0x2AD7B1
+#define GCS_MKV_ID_DURATION             0x4489
+#define GCS_MKV_ID_CLUSTER              0x1F43B675
+#define GCS_MKV_ID_CLUSTER_TIMECODE     0xE7
+#define GCS_MKV_ID_SIMPLE_BLOCK         0xA3
+#define GCS_MKV_ID_BLOCK_GROUP          0xA0
+#define GCS_MKV_ID_BLOCK                0xA1
+#define GCS_MKV_ID_BLOCK_DURATION       0x9B
+
+/* level 1 elements (children of the segment), used to detect the
+end of a cluster that was written with an unknown size */
+#define GCS_MKV_ID_SEEK_HEAD            0x114D9B74
+#define GCS_MKV_ID_TRACKS               0x1654AE6B
+#define GCS_MKV_ID_CUES                 0x1C53BB6B
+#define GCS_MKV_ID_TAGS                 0x1254C367
+#define GCS_MKV_ID_CHAPTERS             0x1043A770
+#define GCS_MKV_ID_ATTACHMENTS          0x1941A469
+
+/* seek head and cues, used to find the keyframes */
+#define GCS_MKV_ID_SEEK                 0x4DBB
+#define GCS_MKV_ID_SEEK_ID              0x53AB
+#define GCS_MKV_ID_SEEK_POSITION        0x53AC
+#define GCS_MKV_ID_CUE_POINT            0xBB
+#define GCS_MKV_ID_CUE_TIME             0xB3
+#define GCS_MKV_ID_CUE_TRACK_POSITIONS  0xB7
+#define GCS_MKV_ID_CUE_CLUSTER_POSITION 0xF1
+
+/* tracks, what's in the chunk and how to decode it */
+#define GCS_MKV_ID_TRACK_ENTRY          0xAE
+#define GCS_MKV_ID_TRACK_NUMBER         0xD7
+#define GCS_MKV_ID_TRACK_TYPE           0x83
+#define GCS_MKV_ID_CODEC_ID             0x86
+#define GCS_MKV_ID_CODEC_PRIVATE        0x63A2
+#define GCS_MKV_ID_VIDEO                0xE0
+#define GCS_MKV_ID_PIXEL_WIDTH          0xB0
+#define GCS_MKV_ID_PIXEL_HEIGHT         0xBA
+
+/* in a block group, a block that refers to another one is
+not a keyframe */
+#define GCS_MKV_ID_REFERENCE_BLOCK      0xFB
+
+/* default timecode scale, 1 millisecond in nanoseconds */
+#define GCS_MKV_DEFAULT_TIMECODE_SCALE 1000000
+
+/* all bits set in the size, means the size is unknown (happens
+with live streams or when the muxer never finished the file) */
+#define GCS_MKV_UNKNOWN_SIZE UINT64_MAX
+
+/* matroska track type of video tracks */
+#define GCS_MKV_TRACK_TYPE_VIDEO 1
+
+/* reads a variable length integer, returns the number of bytes it
+took, or 0 when there's not enough data, id's keep their length
+marker, sizes don't */
+int      gcs_ebml_read_vint(const uint8_t *data, int data_len,
+             int keep_marker, uint64_t *value);
+
+uint64_t gcs_ebml_read_uint(const uint8_t *data, uint64_t size);
+double   gcs_ebml_read_float(const uint8_t *data, uint64_t size);
+
+/* reads the header of the child element at `position` of an element
+that was read into memory completely, returns its data and moves
+`position` to the next child, or returns NULL at the end */
+const uint8_t * gcs_ebml_read_child(const uint8_t *data, int data_len,
+                    int *position, uint64_t *id, uint64_t *size);
+
+/* whether the id is that of a child of the segment, used to detect
+the end of a cluster that was written with an unknown size */
+int      gcs_ebml_is_level1_id(uint64_t id);
+
+#endif /* __gst_chunks_shared_ebml_h */
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+#include <gcs/mem.h>
+#include <gcs/gst.h>
+#include <gcs/gap.h>
+
+static GMutex gap_lock;
+
+/* one for every size that was asked for, a camera hardly ever
+changes size, so there's only a couple */
+static GPtrArray *encoded_frames;
+
+static GcsGapFrame *
+encoded_frame_new(int width, int height)
+{
+    /* encode a single black frame, once, every frame of every gap
+    is a copy of this one, since it's an IDR frame, it can be decoded
+    on its own, so clients can start decoding in the middle of a gap */
+    char description[512];
+    snprintf(description, sizeof(description),
+        "videotestsrc pattern=black num-buffers=1 "
+        "! video/x-raw,format=I420,width=%i,height=%i,framerate=1/1 "
+        "! x264enc key-int-max=1 "
+        "! video/x-h264,stream-format=avc,alignment=au "
+        "! appsink name=sink", width, height);
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(description, &error);
+    if(!pipeline) {
+        fprintf(stderr, "[err] could not encode a gap frame: %s\n",
+            error ? error->message : "unknown error");
+        g_clear_error(&error);
+        return NULL;
+    }
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GcsGapFrame *frame = NULL;
+    GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+
+    if(sample) {
+        frame = ALLOC_NULL(GcsGapFrame *, sizeof(GcsGapFrame));
+        frame->width = width;
+        frame->height = height;
+        frame->buffer = gst_buffer_ref(gst_sample_get_buffer(sample));
+        frame->caps = gst_caps_ref(gst_sample_get_caps(sample));
+
+        gst_sample_unref(sample);
+    } else {
+        fprintf(stderr, "[err] could not encode a %ix%i gap frame\n",
+            width, height);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    GSTREAMER_FREE(sink);
+    GSTREAMER_FREE(pipeline);
+
+    return frame;
+}
+
+GcsGapFrame *
+gcs_gap_frame_get(int width, int height)
+{
+    if(width <= 0 || height <= 0) {
+        width = GCS_GAP_WIDTH;
+        height = GCS_GAP_HEIGHT;
+    }
+
+    /* players can be created from any thread */
+    g_mutex_lock(&gap_lock);
+
+    if(!encoded_frames) {
+        encoded_frames = g_ptr_array_new();
+    }
+
+    GcsGapFrame *frame = NULL;
+
+    guint i;
+    for(i = 0; i < encoded_frames->len; ++i) {
+        GcsGapFrame *encoded_frame = g_ptr_array_index(encoded_frames, i);
+
+        if(encoded_frame->width == width && encoded_frame->height == height) {
+            frame = encoded_frame;
+            break;
+        }
+    }
+
+    /* a size that failed to encode is tried again next time */
+    if(!frame) {
+        frame = encoded_frame_new(width, height);
+
+        if(frame) {
+            g_ptr_array_add(encoded_frames, frame);
+        }
+    }
+
+    g_mutex_unlock(&gap_lock);
+    return frame;
+}
+
+GstBuffer *
+gcs_gap_frame_new_buffer(GcsGapFrame *frame, uint64_t time,
+    uint64_t duration)
+{
+    /* the copy shares the frame's memory, only the timestamps
+    are its own */
+    GstBuffer *buffer = gst_buffer_copy(frame->buffer);
+
+    GST_BUFFER_PTS(buffer) = time;
+    GST_BUFFER_DTS(buffer) = time;
+    GST_BUFFER_DURATION(buffer) = duration;
+
+    return buffer;
+}
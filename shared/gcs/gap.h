@@ -0,0 +1,41 @@
+#ifndef __gst_chunks_shared_gap_h
+#define __gst_chunks_shared_gap_h
+
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+/* size of the black frame that fills gaps before any chunk
+said what size its video is */
+#define GCS_GAP_WIDTH 320
+#define GCS_GAP_HEIGHT 240
+
+/* a gap is filled by repeating one frame at this interval, often
+enough for the sink and clients not to time out, and rare enough
+to cost nothing */
+#define GCS_GAP_FRAME_INTERVAL 1000000000
+
+/* a single black frame, encoded as an IDR frame, made once for
+every size and shared by every player in the process, it's never
+changed or freed after it was made, the decoder after concat decodes
+it like the frames of any chunk
+
+it's encoded at the size of the chunks around the gap and, like
+them, in avc with codec_data, so a gap doesn't change the resolution
+or stream format for whatever comes after concat, the codec_data is
+the encoder's and not the camera's, which still makes the parser and
+decoder start over at either end of the gap */
+typedef struct {
+    int width;
+    int height;
+
+    GstCaps *caps;
+    GstBuffer *buffer;
+} GcsGapFrame;
+
+/* a size of 0 is the default size */
+GcsGapFrame *   gcs_gap_frame_get(int width, int height);
+GstBuffer *     gcs_gap_frame_new_buffer(GcsGapFrame *frame, uint64_t time,
+                    uint64_t duration);
+
+#endif /* __gst_chunks_shared_gap_h */
@@ -2,9 +2,15 @@
 #include <stdint.h>
 
 #include <gst/gst.h>
+#include <gst/rtsp/gstrtsprange.h>
 
 #include <gcs/mem.h>
 #include <gcs/gst.h>
+#include <gcs/time.h>
+
+/* times of a clock range are counted from the start of 1900, like
+NTP does, this many seconds before the epoch */
+#define RTSP_CLOCK_EPOCH_OFFSET G_GUINT64_CONSTANT(2208988800)
 
 int
 gcs_gst_replace_element(GstElement *bin, GstElement *left_element,
@@ -32,3 +38,66 @@ gcs_gst_replace_element(GstElement *bin, GstElement *left_element,
 
     return 1;
 }
+
+GstCaps *
+gcs_gst_new_h264_caps(const uint8_t *codec_data, size_t codec_data_size)
+{
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, codec_data_size, NULL);
+    gst_buffer_fill(buffer, 0, codec_data, codec_data_size);
+
+    GstCaps *caps = gst_caps_new_simple("video/x-h264",
+        "stream-format", G_TYPE_STRING, "avc",
+        "alignment", G_TYPE_STRING, "au",
+        "codec_data", GST_TYPE_BUFFER, buffer,
+        NULL);
+
+    gst_buffer_unref(buffer);
+    return caps;
+}
+
+GstBuffer *
+gcs_gst_new_frame_buffer(GcsMkvFrame *frame)
+{
+    GcsMkvBlock *block = frame->block;
+
+    /* the block is read-only from here on, the reader reads into
+    a new one as long as any frame in it is still around */
+    GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+        block->data, block->size, (gsize) (frame->data - block->data),
+        frame->size, gcs_mkv_block_ref(block),
+        (GDestroyNotify) gcs_mkv_block_unref);
+
+    if(!frame->keyframe) {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+
+    return buffer;
+}
+
+int
+gcs_gst_parse_clock_range(const char *range_header, uint64_t *start_moment)
+{
+    GstRTSPTimeRange *range = NULL;
+    if(gst_rtsp_range_parse(range_header, &range) != GST_RTSP_OK) {
+        return 0;
+    }
+
+    GstClockTime start = GST_CLOCK_TIME_NONE;
+    GstClockTime stop = GST_CLOCK_TIME_NONE;
+
+    int is_clock = (range->unit == GST_RTSP_RANGE_CLOCK &&
+        gst_rtsp_range_get_times(range, &start, &stop) &&
+        GST_CLOCK_TIME_IS_VALID(start) &&
+        start >= GCS_TIME_SECONDS_AS_NANO(RTSP_CLOCK_EPOCH_OFFSET));
+
+    gst_rtsp_range_free(range);
+
+    if(!is_clock) {
+        return 0;
+    }
+
+    *start_moment = (uint64_t) start -
+        GCS_TIME_SECONDS_AS_NANO(RTSP_CLOCK_EPOCH_OFFSET);
+
+    return 1;
+}
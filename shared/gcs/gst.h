@@ -1,6 +1,8 @@
 #ifndef __gst_chunks_shared_gst_h
 #define __gst_chunks_shared_gst_h
 
+#include <gcs/mkv.h>
+
 #define GSTREAMER_FREE(ptr)  \
     if(ptr != NULL) {        \
         g_object_unref(ptr); \
@@ -14,4 +16,18 @@ int gcs_gst_replace_element(GstElement *bin, GstElement *left_element,
     GstElement *right_element, GstElement *old_element,
     GstElement *new_element);
 
+/* caps of the frames of a chunk, as matroskademux would have them */
+GstCaps *   gcs_gst_new_h264_caps(const uint8_t *codec_data,
+                size_t codec_data_size);
+
+/* the start of a wall clock range (clock=20200101T120000Z-) as it
+comes with a play request, in nanoseconds since the epoch, like the
+moments of the chunks, returns 0 for any other kind of range */
+int         gcs_gst_parse_clock_range(const char *range_header,
+                uint64_t *start_moment);
+
+/* wraps the frame without copying it, the buffer holds a reference
+to the block the frame is in, timestamps are left to the caller */
+GstBuffer * gcs_gst_new_frame_buffer(GcsMkvFrame *frame);
+
 #endif /* __gst_chunks_shared_gst_h */
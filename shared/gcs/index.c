@@ -1,204 +1,2315 @@
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <dirent.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <gcs/mem.h>
 #include <gcs/index.h>
 #include <gcs/chunk.h>
+#include <gcs/cache.h>
+#include <gcs/mapped.h>
+#include <gcs/watch.h>
 #include <gcs/time.h>
 
 /* 1.1 seconds / 1100 milliseconds */
 #define MAXIMUM_GAP_TIME 1100000000
 
+/* files probed since the fill that we keep the mtime and size
+of, older ones are forgotten once there are more than that, they
+are done being written by then */
+#define MAXIMUM_PROBED_COUNT 256
+#define PROBED_KEEP_TIME 3600
+
+/* a file that was found while scanning the directory and
+still has to be turned into a chunk */
+typedef struct {
+    uint32_t filename;
+    struct stat file_info;
+
+    /* set when the file was not in the cache */
+    int probed;
+
+    /* time it took to parse the name and probe the file */
+    gint64 parse_time;
+    gint64 probe_time;
+} GcsIndexEntry;
+
+/* a chunk of an hour that is being loaded, the name is added
+to the arena once the chunks are in order */
+typedef struct {
+    GcsChunk chunk;
+    char filename[NAME_MAX + 1];
+} GcsIndexLoadEntry;
+
+/* shared by all workers that probe chunks */
+typedef struct {
+    GcsIndex *index;
+    GArray *entries;
+
+    /* the directory the entries were found in */
+    uint16_t directory;
+
+    /* offset of the first entry's slot in the index */
+    int first_slot;
+} GcsIndexProbeJob;
+
 static gint
-compare_chunks_start_moment(gconstpointer a, gconstpointer b)
+compare_chunks_start_moment(gconstpointer a, gconstpointer b,
+    gpointer user_data)
 {
     const GcsChunk *chunk_a = (GcsChunk *) a;
     const GcsChunk *chunk_b = (GcsChunk *) b;
+    GcsStringArena *filenames = (GcsStringArena *) user_data;
+
+    if(chunk_a->start_moment < chunk_b->start_moment) {
+        return -1;
+    }
+
+    if(chunk_a->start_moment > chunk_b->start_moment) {
+        return 1;
+    }
+
+    /* two chunks that start at the same moment, order by filename
+    so the index is the same no matter the order we found them in */
+    if(chunk_a->filename == chunk_b->filename) {
+        return 0;
+    }
+
+    /* gaps (and hours that aren't loaded) have no filename, they
+    go first, a chunk starting where one starts cuts it short */
+    int gap_a = gcs_chunk_is_gap((GcsChunk *) chunk_a);
+    int gap_b = gcs_chunk_is_gap((GcsChunk *) chunk_b);
+
+    if(gap_a || gap_b) {
+        return gap_b - gap_a;
+    }
+
+    return strcmp(gcs_arena_get(filenames, chunk_a->filename),
+        gcs_arena_get(filenames, chunk_b->filename));
+}
+
+static int
+find_last_chunk_starting_before(GcsChunk *chunks, int count, uint64_t moment)
+{
+    /* binary search for the last chunk that starts at or before
+    the specified moment, -1 if all chunks start after it */
+    int low = 0;
+    int high = count - 1;
+    int result = -1;
+
+    while(low <= high) {
+        int middle = low + (high - low) / 2;
+        GcsChunk *chunk = &chunks[middle];
+
+        if(chunk->start_moment <= moment) {
+            result = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return result;
+}
+
+static uint64_t
+get_midnight(uint64_t moment, int day_offset)
+{
+    /* convert back to seconds (from nanoseconds) */
+    time_t seconds = (time_t) GCS_TIME_NANO_AS_SECONDS(moment);
+
+    /* convert time_t to tm structure, in local time */
+    struct tm date_time = *localtime(&seconds);
+
+    /* zero out all the time related stuff, so we're left
+    with the date, let mktime figure out daylight saving */
+    date_time.tm_sec = 0;
+    date_time.tm_min = 0;
+    date_time.tm_hour = 0;
+    date_time.tm_mday += day_offset;
+    date_time.tm_isdst = -1;
+
+    /* convert to time_t and then to nanoseconds */
+    uint64_t date = (uint64_t) mktime(&date_time);
+    date = GCS_TIME_SECONDS_AS_NANO(date);
+
+    return date;
+}
+
+static void
+mark_changed(GcsIndex *index, int from, int to)
+{
+    /* two changes before a publish don't happen, but if they
+    did, everything from the first one on is taken as changed */
+    if(index->changed_from >= 0) {
+        from = MIN(from, index->changed_from);
+        to = index->snapshot ? index->snapshot->count : 0;
+    }
+
+    index->changed_from = from;
+    index->changed_to = to;
+}
+
+static void
+mark_all_changed(GcsIndex *index)
+{
+    mark_changed(index, 0, index->snapshot ? index->snapshot->count : 0);
+}
+
+static int
+is_unloaded(GcsChunk *chunk)
+{
+    return gcs_chunk_is_gap(chunk) && chunk->directory == GCS_INDEX_UNLOADED;
+}
+
+static uint64_t
+get_hour(uint64_t moment)
+{
+    return moment - (moment % GCS_INDEX_HOUR);
+}
+
+static GcsIndexPartition *
+get_partition(GcsIndex *index, int partition)
+{
+    return &g_array_index(index->partitions, GcsIndexPartition, partition);
+}
+
+static int
+find_partition(GcsIndex *index, uint64_t moment)
+{
+    /* the partition the moment falls in, which is the last one
+    that started at or before it, -1 when there's none, first the
+    day it's on, then the hour */
+    if(!index->days || index->days->len == 0) {
+        return -1;
+    }
+
+    int low = 0;
+    int high = (int) index->days->len - 1;
+    int day = -1;
+
+    while(low <= high) {
+        int middle = low + (high - low) / 2;
+
+        if(g_array_index(index->days, GcsIndexDay, middle).start_moment <=
+            moment) {
+            day = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    if(day < 0) {
+        return -1;
+    }
+
+    /* before the first partition of the day, it's in the
+    last one of the day before */
+    GcsIndexDay *found_day = &g_array_index(index->days, GcsIndexDay, day);
+    int result = found_day->first_partition - 1;
+
+    low = found_day->first_partition;
+    high = found_day->first_partition + found_day->partition_count - 1;
+
+    while(low <= high) {
+        int middle = low + (high - low) / 2;
+
+        if(get_partition(index, middle)->start_moment <= moment) {
+            result = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return result;
+}
+
+static int
+find_hour(GcsIndex *index, uint64_t hour, int *position)
+{
+    /* the partition of the hour, or where it would go */
+    int low = 0;
+    int high = (int) index->partitions->len;
+
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+
+        if(get_partition(index, middle)->hour < hour) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *position = low;
+    return low < (int) index->partitions->len &&
+        get_partition(index, low)->hour == hour;
+}
+
+static int
+add_hour(GcsIndex *index, uint64_t start_moment, int unlisted)
+{
+    int position;
+    if(find_hour(index, get_hour(start_moment), &position)) {
+        GcsIndexPartition *partition = get_partition(index, position);
+        partition->start_moment = MIN(partition->start_moment, start_moment);
+        partition->unlisted |= unlisted;
+
+        return position;
+    }
+
+    GcsIndexPartition partition;
+    memset(&partition, 0, sizeof(partition));
+
+    partition.hour = get_hour(start_moment);
+    partition.start_moment = start_moment;
+    partition.unlisted = unlisted;
+
+    g_array_insert_val(index->partitions, position, partition);
+    return position;
+}
+
+static void
+update_days(GcsIndex *index)
+{
+    g_array_set_size(index->days, 0);
+
+    guint i;
+    for(i = 0; i < index->partitions->len; ++i) {
+        uint64_t midnight = get_midnight(get_partition(index,
+            i)->start_moment, 0);
+
+        GcsIndexDay *last_day = index->days->len == 0 ? NULL :
+            &g_array_index(index->days, GcsIndexDay, index->days->len - 1);
+
+        if(last_day && last_day->start_moment == midnight) {
+            last_day->partition_count++;
+            continue;
+        }
+
+        GcsIndexDay day;
+        day.start_moment = midnight;
+        day.first_partition = (int) i;
+        day.partition_count = 1;
+
+        g_array_append_val(index->days, day);
+    }
+}
+
+static uint64_t
+get_partition_stop(GcsIndex *index, int partition)
+{
+    /* the last one goes on until the end of its day, like
+    the index itself */
+    if(partition + 1 < (int) index->partitions->len) {
+        return get_partition(index, partition + 1)->start_moment;
+    }
+
+    return get_midnight(get_partition(index, partition)->start_moment, 1);
+}
+
+static void
+add_gap(GcsIndex *index, GArray *chunks, uint64_t start, uint64_t stop)
+{
+    /* a gap that runs into the next partition is split where it
+    starts, so every partition has its own, and can be unloaded
+    and loaded again without touching the others */
+    while(start < stop) {
+        uint64_t gap_stop = stop;
+
+        if(index->partitions) {
+            int partition = find_partition(index, start);
+
+            if(partition + 1 < (int) index->partitions->len) {
+                gap_stop = MIN(stop, get_partition(index,
+                    partition + 1)->start_moment);
+            }
+        }
+
+        if((gap_stop - start) > MAXIMUM_GAP_TIME) {
+            GcsChunk new_gap = gcs_chunk_new_gap(start, gap_stop);
+            g_array_append_val(chunks, new_gap);
+        }
+
+        start = gap_stop;
+    }
+}
+
+static void
+detect_and_insert_gaps(GcsIndex *index)
+{
+    /* create a new array to store our newly build
+    index in */
+    GArray *new_index = g_array_new(0, 1, sizeof(GcsChunk));
+
+    /* get the start time of the index */
+    uint64_t prev_chunk_stop_time = gcs_index_get_start_time(index);
+
+    guint i;
+    for(i = 0; i < index->chunks->len; ++i) {
+        GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk, i);
+
+        /* gaps from a previous fill are recalculated, hours that
+        aren't loaded stay, they stand in for their chunks */
+        if(gcs_chunk_is_gap(chunk) && !is_unloaded(chunk)) {
+            continue;
+        }
+
+        /* insert gaps into the index that are as long as the gap
+        between the previous chunk and the next one, when it's more
+        than a second */
+        add_gap(index, new_index, prev_chunk_stop_time, chunk->start_moment);
+
+        /* insert the chunk into the new index */
+        g_array_append_val(new_index, *chunk);
+        prev_chunk_stop_time = chunk->stop_moment;
+    }
+
+    /* get the end time of this index (end of the day) */
+    uint64_t next_day_time = gcs_index_get_end_time(index);
+
+    /* and between the last chunk and the end of the day, the last
+    chunk can run past the end, for example when it was started just
+    before midnight, in which case there's none */
+    add_gap(index, new_index, prev_chunk_stop_time, next_day_time);
+
+    /* free old index and replace with new index, which also
+    contains all the gaps */
+    g_array_free(index->chunks, TRUE);
+    index->chunks = new_index;
+
+    mark_all_changed(index);
+}
+
+static GcsIndexBlock *
+block_new(GcsChunk *chunks, int count)
+{
+    GcsIndexBlock *block = ALLOC_NULL(GcsIndexBlock *,
+        sizeof(GcsIndexBlock) + sizeof(GcsChunk) * count);
+
+    block->ref_count = 1;
+    block->count = count;
+    memcpy(block->chunks, chunks, sizeof(GcsChunk) * count);
+
+    return block;
+}
+
+static void
+block_release(GcsIndexBlock *block)
+{
+    if(g_atomic_int_dec_and_test(&block->ref_count)) {
+        free(block);
+    }
+}
+
+static void
+snapshot_add_block(GcsIndexSnapshot *snapshot, GcsIndexBlock *block)
+{
+    snapshot->blocks[snapshot->block_count] = block;
+    snapshot->block_starts[snapshot->block_count] = snapshot->count;
+
+    snapshot->block_count++;
+    snapshot->count += block->count;
+}
+
+static GcsIndexSnapshot *
+snapshot_new(GcsIndex *index)
+{
+    GcsIndexSnapshot *old_snapshot = index->snapshot;
+
+    GcsIndexSnapshot *snapshot = ALLOC_NULL(GcsIndexSnapshot *,
+        sizeof(GcsIndexSnapshot));
+
+    /* the reference held by the index */
+    snapshot->ref_count = 1;
+    snapshot->filenames = gcs_arena_ref(index->filenames);
+    snapshot->index = index;
+
+    int old_count = old_snapshot ? old_snapshot->count : 0;
+    int old_block_count = old_snapshot ? old_snapshot->block_count : 0;
+    int count = (int) index->chunks->len;
+
+    int from = CLAMP(index->changed_from, 0, old_count);
+    int to = CLAMP(index->changed_to, from, old_count);
+
+    /* blocks that end before the change are kept as they are, so
+    are blocks that start after it, all that is copied are the
+    blocks the change falls in, and the block before them when
+    it isn't full, so appending doesn't leave tiny blocks behind */
+    int first = 0;
+    while(first < old_block_count &&
+        old_snapshot->block_starts[first] +
+        old_snapshot->blocks[first]->count <= from) {
+        ++first;
+    }
+
+    if(first > 0 &&
+        old_snapshot->blocks[first - 1]->count < GCS_INDEX_BLOCK_SIZE) {
+        --first;
+    }
+
+    int after = first;
+    while(after < old_block_count && old_snapshot->block_starts[after] < to) {
+        ++after;
+    }
+
+    /* the range of chunks that is copied into new blocks, in
+    positions of the new chunks */
+    int copy_start = first < old_block_count ?
+        old_snapshot->block_starts[first] : old_count;
+    int copy_stop = (after < old_block_count ?
+        old_snapshot->block_starts[after] : old_count) + (count - old_count);
+
+    int copy_block_count = (copy_stop - copy_start + GCS_INDEX_BLOCK_SIZE - 1) /
+        GCS_INDEX_BLOCK_SIZE;
+
+    int block_count = first + copy_block_count + (old_block_count - after);
+    snapshot->blocks = ALLOC_NULL(GcsIndexBlock **,
+        sizeof(GcsIndexBlock *) * MAX(block_count, 1));
+    snapshot->block_starts = ALLOC_NULL(int *,
+        sizeof(int) * MAX(block_count, 1));
+
+    int i;
+    for(i = 0; i < first; ++i) {
+        g_atomic_int_inc(&old_snapshot->blocks[i]->ref_count);
+        snapshot_add_block(snapshot, old_snapshot->blocks[i]);
+    }
+
+    int position;
+    for(position = copy_start; position < copy_stop;
+        position += GCS_INDEX_BLOCK_SIZE) {
+        int block_size = MIN(copy_stop - position, GCS_INDEX_BLOCK_SIZE);
+
+        snapshot_add_block(snapshot, block_new(&g_array_index(index->chunks,
+            GcsChunk, position), block_size));
+    }
+
+    for(i = after; i < old_block_count; ++i) {
+        g_atomic_int_inc(&old_snapshot->blocks[i]->ref_count);
+        snapshot_add_block(snapshot, old_snapshot->blocks[i]);
+    }
+
+    snapshot->directory_count = (int) index->directories->len;
+    if(snapshot->directory_count > 0) {
+        snapshot->directories = ALLOC_NULL(char **,
+            sizeof(char *) * snapshot->directory_count);
+
+        memcpy(snapshot->directories, index->directories->pdata,
+            sizeof(char *) * snapshot->directory_count);
+    }
+
+    index->changed_from = -1;
+    index->changed_to = -1;
+
+    return snapshot;
+}
+
+static void
+snapshot_unref(GcsIndexSnapshot *snapshot)
+{
+    if(!g_atomic_int_dec_and_test(&snapshot->ref_count)) {
+        return;
+    }
+
+    int i;
+    for(i = 0; i < snapshot->block_count; ++i) {
+        block_release(snapshot->blocks[i]);
+    }
+
+    /* the last snapshot of an index that was freed already
+    takes the strings with it */
+    gcs_arena_free(snapshot->filenames);
+
+    free(snapshot->blocks);
+    free(snapshot->block_starts);
+    free(snapshot->directories);
+    free(snapshot);
+}
+
+static void
+index_unref(GcsIndex *index)
+{
+    if(!g_atomic_int_dec_and_test(&index->users)) {
+        return;
+    }
+
+    /* gcs_index_free let go of everything else already */
+    snapshot_unref(index->snapshot);
+    g_ptr_array_free(index->iterators, TRUE);
+    g_rec_mutex_clear(&index->write_lock);
+    g_mutex_clear(&index->readers_lock);
+    g_cond_clear(&index->readers_cond);
+    free(index);
+}
+
+static void
+wait_for_readers(GcsIndex *index)
+{
+    /* readers that come in from now on count themselves in the
+    other parity, so the one we're waiting for can only drain */
+    int parity = g_atomic_int_add(&index->epoch, 1) & 1;
+
+    if(g_atomic_int_get(&index->readers[parity]) == 0) {
+        return;
+    }
+
+    /* a reader that drops the count to zero after we set `waiting`
+    sees it and signals us, it takes the lock to do so, which we
+    only give up while waiting */
+    g_mutex_lock(&index->readers_lock);
+    g_atomic_int_set(&index->waiting, 1);
+
+    while(g_atomic_int_get(&index->readers[parity]) != 0) {
+        g_cond_wait(&index->readers_cond, &index->readers_lock);
+    }
+
+    g_atomic_int_set(&index->waiting, 0);
+    g_mutex_unlock(&index->readers_lock);
+}
+
+static void
+publish(GcsIndex *index)
+{
+    GcsIndexSnapshot *old_snapshot = index->snapshot;
+    g_atomic_pointer_set(&index->snapshot, snapshot_new(index));
+
+    /* a reader that is still acquiring might have loaded the old
+    snapshot but not referenced it yet, those are all counted in one
+    of the parities, it could have read the epoch before the previous
+    flip, so wait for both */
+    wait_for_readers(index);
+    wait_for_readers(index);
+
+    /* readers that got the old one hold their own reference */
+    if(old_snapshot) {
+        snapshot_unref(old_snapshot);
+    }
+}
+
+GcsIndex *
+gcs_index_new()
+{
+    GcsIndex *index = ALLOC_NULL(GcsIndex *, sizeof(GcsIndex));
+    index->chunks = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+    index->filenames = gcs_arena_new();
+    index->directories = g_ptr_array_new();
+    index->lists = g_array_new(FALSE, TRUE, sizeof(GcsIndexList));
+    index->probed = gcs_cache_new();
+    index->iterators = g_ptr_array_new();
+    index->changed_from = -1;
+    g_rec_mutex_init(&index->write_lock);
+
+    /* the reference gcs_index_free drops */
+    index->users = 1;
+    g_mutex_init(&index->readers_lock);
+    g_cond_init(&index->readers_cond);
+    index->changed_to = -1;
+
+    /* readers always find a snapshot, even an empty one */
+    publish(index);
+    return index;
+}
+
+static void
+probe_entry(gpointer data, gpointer user_data)
+{
+    GcsIndexProbeJob *job = (GcsIndexProbeJob *) user_data;
+
+    /* tasks can't be NULL, so they're offset by one */
+    int i = GPOINTER_TO_INT(data) - 1;
+
+    GcsIndex *index = job->index;
+    GcsIndexEntry *entry = &g_array_index(job->entries, GcsIndexEntry, i);
+
+    /* every entry has its own slot in the index, so workers never
+    touch the same memory and the order does not depend on which
+    worker finishes first, the arena is only read here */
+    GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk,
+        job->first_slot + i);
+
+    const char *filename = gcs_arena_get(index->filenames, entry->filename);
+
+    /* what gcs_chunk_new does, split up so we can tell the time
+    spent on the name from the time spent on the file */
+    gint64 start_time = g_get_monotonic_time();
+    uint64_t start_moment = gcs_chunk_parse_start_moment(filename);
+    gint64 parse_done_time = g_get_monotonic_time();
+
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s",
+        (char *) g_ptr_array_index(index->directories, job->directory),
+        filename);
+
+    uint64_t duration = gcs_meta_get_mkv_duration(full_path);
+
+    entry->parse_time = parse_done_time - start_time;
+    entry->probe_time = g_get_monotonic_time() - parse_done_time;
+
+    *chunk = gcs_chunk_new_with_times(entry->filename, start_moment,
+        start_moment + duration, duration);
+
+    chunk->directory = job->directory;
+}
+
+static int
+get_thread_count(GcsIndex *index)
+{
+    if(index->thread_count > 0) {
+        return index->thread_count;
+    }
+
+    return (int) g_get_num_processors();
+}
+
+static int
+add_record(GcsIndex *index, int directory, GcsMappedRecord *record)
+{
+    /* the recorder terminates the names, it never lists a name
+    that doesn't fit */
+    uint32_t filename_offset = gcs_arena_add(index->filenames,
+        record->filename, strnlen(record->filename, GCS_MAPPED_FILENAME_LEN));
+
+    if(filename_offset == GCS_ARENA_INVALID_OFFSET) {
+        return 0;
+    }
+
+    GcsChunk new_chunk = gcs_chunk_new_with_times(filename_offset,
+        record->start_moment, record->stop_moment, record->duration);
+
+    new_chunk.directory = (uint16_t) directory;
+    g_array_append_val(index->chunks, new_chunk);
+
+    return 1;
+}
+
+static uint64_t
+find_first_existing_record(GcsIndexList *list, int directory_fd,
+    uint64_t low, uint64_t high)
+{
+    /* the list doesn't know about chunks deleted to free up space,
+    those are the oldest, so the records of files that are gone are
+    all at the start, a handful of files tells where they end */
+
+    while(low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        GcsMappedRecord *record = gcs_mapped_index_get(list->mapped, middle);
+
+        struct stat file_info;
+        if(fstatat(directory_fd, record->filename, &file_info, 0) == 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    return low;
+}
+
+static uint64_t
+find_record(GcsIndexList *list, uint64_t low, uint64_t high, uint64_t moment)
+{
+    /* the first record that starts at or after the moment, the
+    recorder lists its chunks in the order it recorded them */
+    while(low < high) {
+        uint64_t middle = low + (high - low) / 2;
+
+        if(gcs_mapped_index_get(list->mapped, middle)->start_moment <
+            moment) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static int
+add_directory_hours(GcsIndex *index, GcsIndexList *list, int directory_fd,
+    int recording)
+{
+    /* only which hours have chunks, and when the first of them
+    started, the chunks themselves are read when the hour is loaded,
+    the records are skipped through an hour at a time */
+    uint64_t position = list->first_record;
+
+    while(list->mapped && position < list->record_count) {
+        uint64_t start_moment = gcs_mapped_index_get(list->mapped,
+            position)->start_moment;
+
+        add_hour(index, start_moment, 0);
+
+        position = MAX(position + 1, find_record(list, position,
+            list->record_count, get_hour(start_moment) + GCS_INDEX_HOUR));
+    }
+
+    /* the files the list doesn't have, by their names, without
+    looking at the files themselves */
+    DIR *d = recording ? NULL : fdopendir(dup(directory_fd));
+
+    struct dirent *dir = NULL;
+    while(d && (dir = readdir(d)) != NULL) {
+        if(dir->d_type != DT_REG || dir->d_name[0] == '.') {
+            continue;
+        }
+
+        uint64_t start_moment = gcs_chunk_parse_start_moment(dir->d_name);
+
+        if(list->mapped && start_moment <= list->last_start_moment) {
+            continue;
+        }
+
+        add_hour(index, start_moment, 1);
+        ++list->unlisted;
+    }
+
+    if(d) {
+        closedir(d);
+    }
+
+    int listed_count = (int) (list->record_count - list->first_record);
+
+    if(list->mapped) {
+        printf("[inf] found %i chunks in the chunk list\n", listed_count);
+    }
+
+    if(list->unlisted > 0) {
+        printf("[inf] found %i chunks that are not in a chunk list\n",
+            list->unlisted);
+    }
+
+    return listed_count + list->unlisted;
+}
+
+static int
+add_directory(GcsIndex *index, char *directory)
+{
+    /* chunks refer to their directory with a 16-bit number */
+    if(index->directories->len >= UINT16_MAX) {
+        return -1;
+    }
+
+    /* resolve the directory once, full paths of chunks are
+    built from it whenever they're needed */
+    char resolved_directory[PATH_MAX];
+    if(!realpath(directory, resolved_directory)) {
+        return -1;
+    }
+
+    gint64 readdir_start_time = g_get_monotonic_time();
+
+    int directory_fd = open(resolved_directory,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(directory_fd < 0) {
+        return -1;
+    }
+
+    /* kept in the arena, so snapshots can use it for as long
+    as they use the filenames */
+    uint32_t directory_offset = gcs_arena_add(index->filenames,
+        resolved_directory, strlen(resolved_directory));
+
+    if(directory_offset == GCS_ARENA_INVALID_OFFSET) {
+        close(directory_fd);
+        return -1;
+    }
+
+    uint16_t directory_id = (uint16_t) index->directories->len;
+    g_ptr_array_add(index->directories, (char *) gcs_arena_get(
+        index->filenames, directory_offset));
+
+    /* the recorder keeps a list of the chunks it recorded, in the
+    order it recorded them, and fills in what was recorded before
+    (or while it wasn't running) when it starts, so while it runs
+    the list is all there is, the file it's writing is added by the
+    watcher once it's done, otherwise the files newer than the last
+    record are looked for as well, the ones it didn't get to list */
+    GcsIndexList list;
+    list.mapped = gcs_mapped_index_open(resolved_directory);
+    list.record_count = 0;
+    list.last_start_moment = 0;
+
+    int listed_count = 0;
+    uint64_t first_record = 0;
+    int recording = 0;
+
+    if(list.mapped) {
+        list.record_count = gcs_mapped_index_refresh(list.mapped);
+        recording = gcs_mapped_index_is_in_use(list.mapped);
+
+        if(list.record_count > 0) {
+            list.last_start_moment = gcs_mapped_index_get(list.mapped,
+                list.record_count - 1)->start_moment;
+        }
+
+        /* the records are read where they are, the mapping doesn't
+        move until the next refresh */
+        first_record = find_first_existing_record(&list, directory_fd, 0,
+            list.record_count);
+
+        /* lazy indexes read the records of an hour once it's loaded */
+        uint64_t i;
+        for(i = first_record; !index->partitions && i < list.record_count;
+            ++i) {
+            listed_count += add_record(index, directory_id,
+                gcs_mapped_index_get(list.mapped, i));
+        }
+    }
+
+    list.first_record = first_record;
+    list.unlisted = 0;
+    list.cache = NULL;
+
+    if(index->partitions) {
+        int count = add_directory_hours(index, &list, directory_fd,
+            recording);
+
+        g_array_append_val(index->lists, list);
+        close(directory_fd);
+
+        index->stats.readdir_time += g_get_monotonic_time() -
+            readdir_start_time;
+
+        return count;
+    }
+
+    g_array_append_val(index->lists, list);
+
+    int unlisted_count = 0;
+    GArray *entries = g_array_new(FALSE, TRUE, sizeof(GcsIndexEntry));
+
+    DIR *d = recording ? NULL : fdopendir(dup(directory_fd));
+
+    struct dirent *dir = NULL;
+    while(d && (dir = readdir(d)) != NULL) {
+        /* skip non-files */
+        if(dir->d_type != DT_REG) {
+            continue;
+        }
+
+        char *filename = &dir->d_name[0];
+
+        /* skip hidden files, such as our own cache */
+        if(filename[0] == '.') {
+            continue;
+        }
+
+        if(list.mapped &&
+            gcs_chunk_parse_start_moment(filename) <= list.last_start_moment) {
+            continue;
+        }
+
+        /* stat relative to the directory we're reading, saves
+        us from building the full path for every file */
+        GcsIndexEntry entry;
+        if(fstatat(directory_fd, filename, &entry.file_info, 0) != 0) {
+            continue;
+        }
+
+        entry.filename = gcs_arena_add(index->filenames, filename,
+            strlen(filename));
+
+        if(entry.filename == GCS_ARENA_INVALID_OFFSET) {
+            continue;
+        }
+
+        entry.probed = 0;
+        entry.parse_time = 0;
+        entry.probe_time = 0;
+        g_array_append_val(entries, entry);
+
+        ++unlisted_count;
+    }
+
+    if(d) {
+        closedir(d);
+    }
+
+    close(directory_fd);
+    index->stats.readdir_time += g_get_monotonic_time() - readdir_start_time;
+
+    /* load what we probed the last time, so we only have to
+    probe chunks that are new or changed since then, not needed
+    when the recorder listed every file */
+    gint64 cache_start_time = g_get_monotonic_time();
+    GcsCache *cache = gcs_cache_new();
+
+    if(unlisted_count > 0) {
+        gcs_cache_load(cache, resolved_directory);
+    }
+
+    index->stats.cache_time += g_get_monotonic_time() - cache_start_time;
+
+    /* make room for all chunks at once, every entry gets the
+    slot with the same offset */
+    int first_slot = (int) index->chunks->len;
+    g_array_set_size(index->chunks, first_slot + entries->len);
+
+    GcsIndexProbeJob job;
+    job.index = index;
+    job.entries = entries;
+    job.first_slot = first_slot;
+    job.directory = directory_id;
+
+    /* chunks we already know are filled in right away, the rest
+    is handed to a pool of workers, which is where the time goes
+    as probing means waiting for the disk */
+    GThreadPool *pool = NULL;
+    int probe_count = 0;
+
+    gint64 probe_start_time = g_get_monotonic_time();
+
+    guint i;
+    for(i = 0; i < entries->len; ++i) {
+        GcsIndexEntry *entry = &g_array_index(entries, GcsIndexEntry, i);
+
+        GcsCacheEntry *cache_entry = gcs_cache_lookup(cache,
+            gcs_arena_get(index->filenames, entry->filename),
+            &entry->file_info);
+
+        if(cache_entry) {
+            GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk,
+                first_slot + i);
+
+            *chunk = gcs_chunk_new_with_times(entry->filename,
+                cache_entry->start_moment, cache_entry->stop_moment,
+                cache_entry->duration);
+
+            chunk->directory = directory_id;
+            continue;
+        }
+
+        entry->probed = 1;
+        ++probe_count;
+
+        if(!pool) {
+            pool = g_thread_pool_new(probe_entry, &job,
+                get_thread_count(index), TRUE, NULL);
+        }
+
+        g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+    }
+
+    /* wait for all probes to finish */
+    if(pool) {
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    index->stats.probe_wall_time += g_get_monotonic_time() - probe_start_time;
+    cache_start_time = g_get_monotonic_time();
+
+    /* the cache is not thread-safe, update it now that all
+    the workers are done */
+    for(i = 0; i < entries->len; ++i) {
+        GcsIndexEntry *entry = &g_array_index(entries, GcsIndexEntry, i);
+
+        index->stats.parse_time += entry->parse_time;
+        index->stats.probe_time += entry->probe_time;
+
+        if(entry->probed) {
+            GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk,
+                first_slot + i);
+
+            gcs_cache_store(cache,
+                gcs_arena_get(index->filenames, entry->filename),
+                &entry->file_info, chunk->start_moment, chunk->stop_moment,
+                chunk->duration);
+        }
+    }
+
+    /* files that are empty, or were cut off before anything was
+    recorded, have nothing to play, they stay in the cache so they
+    aren't probed again, but not in the index */
+    int entry_count = 0;
+    for(i = 0; i < entries->len; ++i) {
+        GcsChunk *chunk = &g_array_index(index->chunks, GcsChunk,
+            first_slot + i);
+
+        if(chunk->duration > 0) {
+            g_array_index(index->chunks, GcsChunk, first_slot + entry_count) =
+                *chunk;
+            ++entry_count;
+        }
+    }
+
+    g_array_set_size(index->chunks, first_slot + entry_count);
+
+    if(list.mapped) {
+        printf("[inf] read %i chunks from the chunk list\n", listed_count);
+
+        if(first_record > 0) {
+            printf("[inf] skipped %i listed chunks that were deleted\n",
+                (int) first_record);
+        }
+    }
+
+    printf("[inf] probed %i chunks, %i from cache\n", probe_count,
+        unlisted_count - probe_count);
+
+    if(entry_count < (int) entries->len) {
+        printf("[inf] skipped %i chunks without a duration\n",
+            (int) entries->len - entry_count);
+    }
+
+    g_array_free(entries, TRUE);
+
+    /* persist the cache for the next time we start */
+    gcs_cache_save(cache, resolved_directory);
+    gcs_cache_free(cache);
+
+    index->stats.cache_time += g_get_monotonic_time() - cache_start_time;
+    index->stats.probed += probe_count;
+    index->stats.cached += unlisted_count - probe_count;
+
+    return listed_count + entry_count;
+}
+
+static int
+compare_loaded_entries(gconstpointer a, gconstpointer b)
+{
+    const GcsIndexLoadEntry *entry_a = (GcsIndexLoadEntry *) a;
+    const GcsIndexLoadEntry *entry_b = (GcsIndexLoadEntry *) b;
+
+    if(entry_a->chunk.start_moment != entry_b->chunk.start_moment) {
+        return entry_a->chunk.start_moment < entry_b->chunk.start_moment ?
+            -1 : 1;
+    }
+
+    return strcmp(entry_a->filename, entry_b->filename);
+}
+
+static uint64_t
+find_listed_hour(GcsIndex *index, int directory, uint64_t hour,
+    uint64_t *last)
+{
+    GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, directory);
+
+    uint64_t first = find_record(list, list->first_record, list->record_count,
+        hour);
+    *last = find_record(list, first, list->record_count,
+        hour + GCS_INDEX_HOUR);
+
+    if(first >= *last) {
+        return first;
+    }
+
+    /* the oldest hours lose their chunks when space is freed up,
+    after the index was filled */
+    int directory_fd = open(g_ptr_array_index(index->directories, directory),
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(directory_fd >= 0) {
+        first = find_first_existing_record(list, directory_fd, first, *last);
+        close(directory_fd);
+    }
+
+    return first;
+}
+
+static void
+read_listed_hour(GcsIndex *index, int directory, uint64_t hour,
+    GArray *entries)
+{
+    GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, directory);
+
+    uint64_t last;
+    uint64_t first = find_listed_hour(index, directory, hour, &last);
+
+    for(; first < last; ++first) {
+        GcsMappedRecord *record = gcs_mapped_index_get(list->mapped, first);
+
+        GcsIndexLoadEntry entry;
+        entry.chunk = gcs_chunk_new_with_times(GCS_CHUNK_NO_FILENAME,
+            record->start_moment, record->stop_moment, record->duration);
+        entry.chunk.directory = (uint16_t) directory;
+
+        int filename_len = strnlen(record->filename, GCS_MAPPED_FILENAME_LEN);
+        memcpy(entry.filename, record->filename, filename_len);
+        entry.filename[filename_len] = '\0';
+
+        g_array_append_val(entries, entry);
+    }
+}
+
+static void
+read_unlisted_hour(GcsIndex *index, int directory, uint64_t hour,
+    GArray *entries)
+{
+    GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, directory);
+    char *directory_path = g_ptr_array_index(index->directories, directory);
+
+    /* the probes of the directory are loaded once, and kept, new
+    ones are appended to the cache file instead of saving it all */
+    if(!list->cache) {
+        list->cache = gcs_cache_new();
+        gcs_cache_load(list->cache, directory_path);
+    }
+
+    int directory_fd = open(directory_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(directory_fd < 0) {
+        return;
+    }
+
+    DIR *d = fdopendir(directory_fd);
+    if(!d) {
+        close(directory_fd);
+        return;
+    }
+
+    struct dirent *dir = NULL;
+    while((dir = readdir(d)) != NULL) {
+        char *filename = &dir->d_name[0];
+
+        if(dir->d_type != DT_REG || filename[0] == '.') {
+            continue;
+        }
+
+        uint64_t start_moment = gcs_chunk_parse_start_moment(filename);
+
+        if(get_hour(start_moment) != hour || (list->mapped &&
+            start_moment <= list->last_start_moment)) {
+            continue;
+        }
+
+        struct stat file_info;
+        if(fstatat(directory_fd, filename, &file_info, 0) != 0) {
+            continue;
+        }
+
+        GcsIndexLoadEntry entry;
+        GcsCacheEntry *cache_entry = gcs_cache_lookup(list->cache, filename,
+            &file_info);
+
+        if(cache_entry) {
+            entry.chunk = gcs_chunk_new_with_times(GCS_CHUNK_NO_FILENAME,
+                cache_entry->start_moment, cache_entry->stop_moment,
+                cache_entry->duration);
+
+            index->stats.cached++;
+        } else {
+            char full_path[PATH_MAX];
+            snprintf(full_path, PATH_MAX, "%s/%s", directory_path, filename);
+
+            uint64_t duration = gcs_meta_get_mkv_duration(full_path);
+            entry.chunk = gcs_chunk_new_with_times(GCS_CHUNK_NO_FILENAME,
+                start_moment, start_moment + duration, duration);
+
+            gcs_cache_store(list->cache, filename, &file_info,
+                entry.chunk.start_moment, entry.chunk.stop_moment,
+                entry.chunk.duration);
+
+            gcs_cache_append(directory_path, filename, &file_info,
+                entry.chunk.start_moment, entry.chunk.stop_moment,
+                entry.chunk.duration);
+
+            index->stats.probed++;
+        }
+
+        /* nothing was recorded in it */
+        if(entry.chunk.duration == 0) {
+            continue;
+        }
+
+        entry.chunk.directory = (uint16_t) directory;
+        g_strlcpy(entry.filename, filename, sizeof(entry.filename));
+
+        g_array_append_val(entries, entry);
+    }
+
+    closedir(d);
+}
+
+static uint32_t
+add_partition_filename(GcsIndex *index, GcsIndexPartition *partition,
+    guint *known, const char *filename)
+{
+    /* the names come in the same order every time the partition
+    is loaded, the ones of files that were deleted since are
+    skipped, new files are added to the arena */
+    guint i;
+    for(i = *known; partition->filenames && i < partition->filenames->len;
+        ++i) {
+        uint32_t offset = g_array_index(partition->filenames, uint32_t, i);
+
+        if(strcmp(gcs_arena_get(index->filenames, offset), filename) == 0) {
+            *known = i + 1;
+            return offset;
+        }
+    }
+
+    return gcs_arena_add(index->filenames, filename, strlen(filename));
+}
+
+static GArray *
+read_partition(GcsIndex *index, GcsIndexPartition *partition)
+{
+    GArray *entries = g_array_new(FALSE, TRUE, sizeof(GcsIndexLoadEntry));
+
+    guint i;
+    for(i = 0; i < index->lists->len; ++i) {
+        GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, i);
+
+        if(list->mapped) {
+            read_listed_hour(index, (int) i, partition->hour, entries);
+        }
+
+        if(partition->unlisted && list->unlisted > 0) {
+            read_unlisted_hour(index, (int) i, partition->hour, entries);
+        }
+    }
+
+    /* files deleted while it wasn't loaded, the ones that are still
+    listed after the first file that exists have to be skipped, and
+    remembered for the next time, the others are done with */
+    if(partition->removed) {
+        GHashTable *removed = g_hash_table_new(g_str_hash, g_str_equal);
+
+        for(i = 0; i < partition->removed->len; ++i) {
+            g_hash_table_add(removed, g_ptr_array_index(partition->removed, i));
+        }
+
+        GPtrArray *still_removed = g_ptr_array_new_with_free_func(g_free);
+        guint kept = 0;
+
+        for(i = 0; i < entries->len; ++i) {
+            GcsIndexLoadEntry *entry = &g_array_index(entries,
+                GcsIndexLoadEntry, i);
+
+            char removed_key[NAME_MAX + 1];
+            snprintf(removed_key, sizeof(removed_key), "%i/%s",
+                entry->chunk.directory, entry->filename);
+
+            if(g_hash_table_contains(removed, removed_key)) {
+                g_ptr_array_add(still_removed, g_strdup(removed_key));
+                continue;
+            }
+
+            g_array_index(entries, GcsIndexLoadEntry, kept++) = *entry;
+        }
+
+        g_array_set_size(entries, kept);
+        g_hash_table_destroy(removed);
+        g_ptr_array_free(partition->removed, TRUE);
+
+        partition->removed = still_removed->len > 0 ? still_removed : NULL;
+        if(!partition->removed) {
+            g_ptr_array_free(still_removed, TRUE);
+        }
+    }
+
+    g_array_sort(entries, compare_loaded_entries);
+
+    GArray *chunks = g_array_sized_new(FALSE, TRUE, sizeof(GcsChunk),
+        entries->len);
+    GArray *filenames = g_array_sized_new(FALSE, TRUE, sizeof(uint32_t),
+        entries->len);
+
+    guint known = 0;
+    for(i = 0; i < entries->len; ++i) {
+        GcsIndexLoadEntry *entry = &g_array_index(entries, GcsIndexLoadEntry,
+            i);
+
+        entry->chunk.filename = add_partition_filename(index, partition,
+            &known, entry->filename);
+
+        if(entry->chunk.filename == GCS_ARENA_INVALID_OFFSET) {
+            continue;
+        }
+
+        g_array_append_val(chunks, entry->chunk);
+        g_array_append_val(filenames, entry->chunk.filename);
+    }
+
+    if(partition->filenames) {
+        g_array_free(partition->filenames, TRUE);
+    }
+
+    partition->filenames = filenames;
+
+    g_array_free(entries, TRUE);
+    return chunks;
+}
+
+static int
+find_chunk_position(GcsIndex *index, uint64_t moment)
+{
+    /* the first chunk that starts at or after the moment */
+    int low = 0;
+    int high = (int) index->chunks->len;
+
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+
+        if(g_array_index(index->chunks, GcsChunk, middle).start_moment <
+            moment) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void
+replace_partition(GcsIndex *index, int partition, GArray *chunks)
+{
+    /* the chunks of a partition are the ones that start
+    before the next partition does */
+    int from = find_chunk_position(index,
+        get_partition(index, partition)->start_moment);
+
+    int to = partition + 1 < (int) index->partitions->len ?
+        find_chunk_position(index, get_partition(index,
+        partition + 1)->start_moment) : (int) index->chunks->len;
+
+    g_array_remove_range(index->chunks, from, to - from);
+    g_array_insert_vals(index->chunks, from, chunks->data, chunks->len);
+
+    mark_changed(index, from, to);
+    publish(index);
+}
+
+static GcsChunk
+new_unloaded(GcsIndex *index, int partition)
+{
+    GcsChunk unloaded = gcs_chunk_new_gap(
+        get_partition(index, partition)->start_moment,
+        get_partition_stop(index, partition));
+
+    unloaded.directory = GCS_INDEX_UNLOADED;
+    return unloaded;
+}
+
+static void
+unload_partition(GcsIndex *index, int partition)
+{
+    GArray *chunks = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+
+    GcsChunk unloaded = new_unloaded(index, partition);
+    g_array_append_val(chunks, unloaded);
+
+    replace_partition(index, partition, chunks);
+    g_array_free(chunks, TRUE);
+
+    get_partition(index, partition)->loaded = 0;
+    index->loaded_count--;
+    index->stats.unloaded_hours++;
+}
+
+static int
+is_in_use(GcsIndex *index, int partition, int keep)
+{
+    if(ABS(partition - keep) <= 1) {
+        return 1;
+    }
+
+    /* the chunks before and after the one an iterator is at
+    are used to find its place in a newer snapshot */
+    guint i;
+    for(i = 0; i < index->iterators->len; ++i) {
+        GcsIndexIterator *itr = g_ptr_array_index(index->iterators, i);
+
+        int used = find_partition(index,
+            __atomic_load_n(&itr->moment, __ATOMIC_RELAXED));
+
+        if(used >= 0 && ABS(partition - used) <= 1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+unload_partitions(GcsIndex *index, int keep)
+{
+    while(index->loaded_count >= index->max_loaded_hours) {
+        int oldest = -1;
+
+        guint i;
+        for(i = 0; i < index->partitions->len; ++i) {
+            GcsIndexPartition *partition = get_partition(index, i);
+
+            if(!partition->loaded || (oldest >= 0 &&
+                partition->load_time >= get_partition(index,
+                oldest)->load_time) || is_in_use(index, (int) i, keep)) {
+                continue;
+            }
+
+            oldest = (int) i;
+        }
+
+        /* all of them are used */
+        if(oldest < 0) {
+            return;
+        }
+
+        unload_partition(index, oldest);
+    }
+}
+
+static void
+load_partition(GcsIndex *index, int partition)
+{
+    if(partition < 0 || get_partition(index, partition)->loaded) {
+        return;
+    }
+
+    unload_partitions(index, partition);
+
+    gint64 load_start_time = g_get_monotonic_time();
+    GcsIndexPartition *loaded = get_partition(index, partition);
+    GArray *chunks = read_partition(index, loaded);
+
+    /* the gaps in between, and after the last one, which go
+    on until the next partition starts */
+    GArray *new_chunks = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+    uint64_t prev_chunk_stop_time = loaded->start_moment;
+
+    guint i;
+    for(i = 0; i < chunks->len; ++i) {
+        GcsChunk *chunk = &g_array_index(chunks, GcsChunk, i);
+
+        add_gap(index, new_chunks, prev_chunk_stop_time, chunk->start_moment);
+        g_array_append_val(new_chunks, *chunk);
+
+        prev_chunk_stop_time = chunk->stop_moment;
+    }
+
+    add_gap(index, new_chunks, prev_chunk_stop_time,
+        get_partition_stop(index, partition));
+
+    replace_partition(index, partition, new_chunks);
+
+    g_array_free(chunks, TRUE);
+    g_array_free(new_chunks, TRUE);
+
+    loaded->loaded = 1;
+    loaded->load_time = g_get_monotonic_time();
+    index->loaded_count++;
+
+    index->stats.loaded_hours++;
+    index->stats.load_time += g_get_monotonic_time() - load_start_time;
+}
+
+static int
+is_partition_empty(GcsIndex *index, GcsIndexPartition *partition)
+{
+    /* only the chunk lists can tell without reading the directory */
+    if(partition->unlisted) {
+        return 0;
+    }
+
+    guint i;
+    for(i = 0; i < index->lists->len; ++i) {
+        if(!g_array_index(index->lists, GcsIndexList, i).mapped) {
+            continue;
+        }
+
+        uint64_t last;
+        if(find_listed_hour(index, (int) i, partition->hour, &last) < last) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void
+forget_file(GcsIndex *index, int directory, const char *filename)
+{
+    /* a file of an hour that isn't loaded, the chunk list still
+    has it, so loading the hour would bring it back */
+    int found = find_partition(index, gcs_chunk_parse_start_moment(filename));
+    if(found < 0 || get_partition(index, found)->loaded) {
+        return;
+    }
+
+    GcsIndexPartition *partition = get_partition(index, found);
+
+    /* the recorder deletes the oldest chunks first, once all of
+    an hour's are gone, so is the hour, its placeholder makes way
+    for a gap, which is part of the partition before it */
+    if(is_partition_empty(index, partition)) {
+        uint64_t start_moment = partition->start_moment;
+        uint64_t stop_moment = get_partition_stop(index, found);
+        int position = find_chunk_position(index, start_moment);
+
+        if(partition->filenames) {
+            g_array_free(partition->filenames, TRUE);
+        }
+
+        if(partition->removed) {
+            g_ptr_array_free(partition->removed, TRUE);
+        }
+
+        g_array_remove_index(index->partitions, found);
+        update_days(index);
+
+        GArray *gaps = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+        add_gap(index, gaps, start_moment, stop_moment);
+
+        g_array_remove_index(index->chunks, position);
+        g_array_insert_vals(index->chunks, position, gaps->data, gaps->len);
+        g_array_free(gaps, TRUE);
+
+        mark_changed(index, position, position + 1);
+        publish(index);
+        return;
+    }
+
+    if(!partition->removed) {
+        partition->removed = g_ptr_array_new_with_free_func(g_free);
+    }
+
+    g_ptr_array_add(partition->removed, g_strdup_printf("%i/%s", directory,
+        filename));
+}
+
+static int
+finish_lazily(GcsIndex *index)
+{
+    /* every partition starts out unloaded, the ones that were
+    loaded by an earlier fill as well, their chunks could have
+    changed with the directory that was added */
+    update_days(index);
+    g_array_set_size(index->chunks, 0);
+
+    if(index->partitions->len > 0) {
+        uint64_t start_moment = get_partition(index, 0)->start_moment;
+        add_gap(index, index->chunks, get_midnight(start_moment, 0),
+            start_moment);
+    }
+
+    guint i;
+    for(i = 0; i < index->partitions->len; ++i) {
+        GcsChunk unloaded = new_unloaded(index, i);
+        g_array_append_val(index->chunks, unloaded);
+
+        get_partition(index, i)->loaded = 0;
+    }
+
+    index->loaded_count = 0;
+    mark_all_changed(index);
+    publish(index);
+
+    printf("[inf] found chunks in %i hours, over %i days\n",
+        (int) index->partitions->len, (int) index->days->len);
+
+    return (int) index->chunks->len;
+}
+
+static int
+finish(GcsIndex *index)
+{
+    if(index->partitions) {
+        return finish_lazily(index);
+    }
+
+    /* sort chunks from older to newer */
+    gint64 sort_start_time = g_get_monotonic_time();
+    g_array_sort_with_data(index->chunks, compare_chunks_start_moment,
+        index->filenames);
+
+    /* detect and insert gaps to fill up missing chunks */
+    gint64 gap_start_time = g_get_monotonic_time();
+    detect_and_insert_gaps(index);
+
+    index->stats.sort_time += gap_start_time - sort_start_time;
+    index->stats.gap_time += g_get_monotonic_time() - gap_start_time;
+
+    /* make the new chunks visible to readers */
+    publish(index);
+
+    int chunk_count = (int) index->chunks->len;
+    return chunk_count;
+}
+
+int
+gcs_index_fill(GcsIndex *index, char *directory)
+{
+    g_rec_mutex_lock(&index->write_lock);
+
+    int chunk_count = add_directory(index, directory);
+    if(chunk_count >= 0) {
+        chunk_count = finish(index);
+    }
+
+    g_rec_mutex_unlock(&index->write_lock);
+    return chunk_count;
+}
+
+int
+gcs_index_fill_directories(GcsIndex *index, const char *directories)
+{
+    g_rec_mutex_lock(&index->write_lock);
+
+    /* cameras that record into several directories, the chunks
+    are sorted and the gaps found once they're all added */
+    char **paths = g_strsplit(directories, ":", -1);
+    int chunk_count = -1;
+
+    int i;
+    for(i = 0; paths[i]; ++i) {
+        if(paths[i][0] == '\0') {
+            continue;
+        }
+
+        if(add_directory(index, paths[i]) < 0) {
+            fprintf(stderr, "[err] could not index %s\n", paths[i]);
+            continue;
+        }
+
+        chunk_count = 0;
+    }
+
+    g_strfreev(paths);
+
+    if(chunk_count >= 0) {
+        chunk_count = finish(index);
+    }
+
+    g_rec_mutex_unlock(&index->write_lock);
+    return chunk_count;
+}
+
+void
+gcs_index_set_thread_count(GcsIndex *index, int thread_count)
+{
+    index->thread_count = thread_count;
+}
+
+void
+gcs_index_set_max_loaded_hours(GcsIndex *index, int max_loaded_hours)
+{
+    index->max_loaded_hours = max_loaded_hours;
+
+    if(max_loaded_hours > 0 && !index->partitions) {
+        index->partitions = g_array_new(FALSE, TRUE,
+            sizeof(GcsIndexPartition));
+        index->days = g_array_new(FALSE, TRUE, sizeof(GcsIndexDay));
+    }
+}
+
+static void
+prepare_partition(GcsIndex *index, uint64_t start_moment)
+{
+    /* the chunk goes into a partition that is loaded, as does the
+    one before it, which its gaps and chunks might run into */
+    int partition;
+    if(find_hour(index, get_hour(start_moment), &partition)) {
+        load_partition(index, partition);
+
+        if(start_moment < get_partition(index, partition)->start_moment) {
+            load_partition(index, partition - 1);
+            get_partition(index, partition)->start_moment = start_moment;
+            update_days(index);
+        }
+
+        return;
+    }
+
+    /* an hour nothing was recorded in before */
+    load_partition(index, find_partition(index, start_moment));
+
+    partition = add_hour(index, start_moment, 0);
+    update_days(index);
+
+    GcsIndexPartition *added = get_partition(index, partition);
+    added->loaded = 1;
+    added->load_time = g_get_monotonic_time();
+    index->loaded_count++;
+}
+
+static void
+append_trailing_gap(GcsIndex *index)
+{
+    GcsChunk *last_chunk = &g_array_index(index->chunks, GcsChunk,
+        index->chunks->len - 1);
+
+    uint64_t last_stop_time = last_chunk->stop_moment;
+    uint64_t end_time = gcs_index_get_end_time(index);
+
+    add_gap(index, index->chunks, last_stop_time, end_time);
+}
+
+static int
+append(GcsIndex *index, GcsChunk *chunk)
+{
+    if(index->partitions) {
+        prepare_partition(index, chunk->start_moment);
+    }
+
+    int count = (int) index->chunks->len;
+    if(count == 0) {
+        g_array_append_val(index->chunks, *chunk);
+        detect_and_insert_gaps(index);
+        publish(index);
+
+        return (int) index->chunks->len;
+    }
+
+    GcsChunk *last_chunk = &g_array_index(index->chunks, GcsChunk,
+        count - 1);
+
+    /* the chunk is older than what we have, this should be rare
+    so just sort and find the gaps again, like filling does */
+    if(chunk->start_moment < last_chunk->start_moment) {
+        g_array_append_val(index->chunks, *chunk);
+        g_array_sort_with_data(index->chunks, compare_chunks_start_moment,
+            index->filenames);
+
+        detect_and_insert_gaps(index);
+        publish(index);
+
+        return (int) index->chunks->len;
+    }
+
+    /* the index normally ends with a gap up to the end of the
+    day, cut it off where the new chunk starts */
+    uint64_t prev_chunk_stop_time = last_chunk->stop_moment;
+
+    if(gcs_chunk_is_gap(last_chunk)) {
+        prev_chunk_stop_time = last_chunk->start_moment;
+        g_array_set_size(index->chunks, count - 1);
+
+        mark_changed(index, count - 1, count);
+    } else {
+        mark_changed(index, count, count);
+    }
+
+    add_gap(index, index->chunks, prev_chunk_stop_time, chunk->start_moment);
+    g_array_append_val(index->chunks, *chunk);
+
+    /* and put a gap back in up to the (possibly new) end */
+    append_trailing_gap(index);
+    publish(index);
+
+    return (int) index->chunks->len;
+}
+
+int
+gcs_index_append(GcsIndex *index, GcsChunk *chunk)
+{
+    g_rec_mutex_lock(&index->write_lock);
+    int chunk_count = append(index, chunk);
+    g_rec_mutex_unlock(&index->write_lock);
+
+    return chunk_count;
+}
+
+static int
+find_file(GcsIndex *index, int directory, const char *filename)
+{
+    /* the name tells when the chunk started, which is where it is
+    in the index, only the chunks that started at the same moment
+    have to be compared */
+    GcsChunk *chunks = (GcsChunk *) index->chunks->data;
+    int count = (int) index->chunks->len;
+
+    uint64_t start_moment = gcs_chunk_parse_start_moment(filename);
+    int i = find_last_chunk_starting_before(chunks, count, start_moment);
+
+    for(; i >= 0 && chunks[i].start_moment == start_moment; --i) {
+        if(!gcs_chunk_is_gap(&chunks[i]) && chunks[i].directory == directory &&
+            strcmp(gcs_arena_get(index->filenames, chunks[i].filename),
+            filename) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int
+remove_file(GcsIndex *index, int directory, const char *filename)
+{
+    int i = find_file(index, directory, filename);
+    if(i < 0) {
+        /* or the hour it's in isn't loaded */
+        if(index->partitions) {
+            forget_file(index, directory, filename);
+        }
+
+        return -1;
+    }
+
+    /* take the chunk out together with the gaps on either side of
+    it, what's left is a hole from the chunk before to the chunk
+    after, which becomes a single gap when it's large enough, the
+    rest of the index stays as it is */
+    int count = (int) index->chunks->len;
+    int from = i;
+    int to = i + 1;
+
+    if(from > 0 && gcs_chunk_is_gap(&g_array_index(index->chunks, GcsChunk,
+        from - 1))) {
+        --from;
+    }
+
+    if(to < count && gcs_chunk_is_gap(&g_array_index(index->chunks, GcsChunk,
+        to))) {
+        ++to;
+    }
+
+    /* at either end, the hole runs up to where the index started
+    or ended, which is where the gaps we take out started or ended */
+    uint64_t hole_start = from > 0 ?
+        g_array_index(index->chunks, GcsChunk, from - 1).stop_moment :
+        g_array_index(index->chunks, GcsChunk, from).start_moment;
+
+    uint64_t hole_stop = to < count ?
+        g_array_index(index->chunks, GcsChunk, to).start_moment :
+        g_array_index(index->chunks, GcsChunk, to - 1).stop_moment;
+
+    /* the filename stays in the arena, readers that are still
+    on an older snapshot might use it */
+    g_array_remove_range(index->chunks, from, to - from);
+
+    if(index->chunks->len > 0) {
+        GArray *gaps = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+        add_gap(index, gaps, hole_start, hole_stop);
+
+        g_array_insert_vals(index->chunks, from, gaps->data, gaps->len);
+        g_array_free(gaps, TRUE);
+    }
+
+    mark_changed(index, from, to);
+    publish(index);
+
+    return (int) index->chunks->len;
+}
+
+static void
+forget_old_probes(GcsIndex *index, int64_t mtime)
+{
+    if(g_hash_table_size(index->probed->entries) < MAXIMUM_PROBED_COUNT) {
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, index->probed->entries);
+    while(g_hash_table_iter_next(&iter, NULL, &value)) {
+        if(((GcsCacheEntry *) value)->mtime < mtime - PROBED_KEEP_TIME) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+static int
+append_file(GcsIndex *index, int directory, const char *filename)
+{
+    if(directory < 0 || directory >= (int) index->directories->len) {
+        return -1;
+    }
+
+    char *directory_path = g_ptr_array_index(index->directories, directory);
+
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s", directory_path, filename);
+
+    struct stat file_info;
+    if(stat(full_path, &file_info) != 0) {
+        return -1;
+    }
+
+    /* the same file can be closed more than once (reopened to fix
+    up its headers, for example), it's probed again when it changed
+    since the last time, the earlier probe (or the fill's) might have
+    seen only part of it */
+    char probed_key[NAME_MAX + 1];
+    snprintf(probed_key, sizeof(probed_key), "%i/%s", directory, filename);
+
+    /* it can only be found when the hour it's in is loaded */
+    if(index->partitions) {
+        load_partition(index, find_partition(index,
+            gcs_chunk_parse_start_moment(filename)));
+    }
+
+    int i = find_file(index, directory, filename);
+    if(i >= 0 && gcs_cache_lookup(index->probed, probed_key, &file_info)) {
+        return 0;
+    }
+
+    uint32_t filename_offset = i >= 0 ?
+        g_array_index(index->chunks, GcsChunk, i).filename :
+        gcs_arena_add(index->filenames, filename, strlen(filename));
+
+    if(filename_offset == GCS_ARENA_INVALID_OFFSET) {
+        return -1;
+    }
+
+    GcsChunk new_chunk = gcs_chunk_new(directory_path, filename,
+        filename_offset);
+
+    new_chunk.directory = (uint16_t) directory;
+
+    /* remember the probe, so neither the next close nor the next
+    start have to repeat it */
+    forget_old_probes(index, (int64_t) file_info.st_mtime);
+    gcs_cache_store(index->probed, probed_key, &file_info,
+        new_chunk.start_moment, new_chunk.stop_moment, new_chunk.duration);
+
+    gcs_cache_append(directory_path, filename, &file_info,
+        new_chunk.start_moment, new_chunk.stop_moment, new_chunk.duration);
+
+    if(i >= 0) {
+        if(g_array_index(index->chunks, GcsChunk, i).stop_moment ==
+            new_chunk.stop_moment) {
+            return 0;
+        }
+
+        remove_file(index, directory, filename);
+    }
+
+    /* nothing was recorded in it, or it's still being written and
+    has no blocks yet */
+    if(new_chunk.duration == 0) {
+        return 0;
+    }
+
+    return append(index, &new_chunk);
+}
+
+int
+gcs_index_append_file(GcsIndex *index, int directory, const char *filename)
+{
+    g_rec_mutex_lock(&index->write_lock);
+    int chunk_count = append_file(index, directory, filename);
+    g_rec_mutex_unlock(&index->write_lock);
+
+    return chunk_count;
+}
+
+int
+gcs_index_refresh(GcsIndex *index)
+{
+    g_rec_mutex_lock(&index->write_lock);
+    int chunk_count = 0;
+
+    guint i;
+    for(i = 0; i < index->lists->len; ++i) {
+        GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, i);
+        if(!list->mapped) {
+            continue;
+        }
+
+        uint64_t record_count = gcs_mapped_index_refresh(list->mapped);
+
+        for(; list->record_count < record_count; ++list->record_count) {
+            GcsMappedRecord *record = gcs_mapped_index_get(list->mapped,
+                list->record_count);
+
+            list->last_start_moment = MAX(list->last_start_moment,
+                record->start_moment);
+
+            if(index->partitions) {
+                load_partition(index, find_partition(index,
+                    record->start_moment));
+            }
+
+            /* the watcher might have added the file already, when
+            something other than the recorder put it there */
+            if(find_file(index, (int) i, record->filename) >= 0) {
+                continue;
+            }
+
+            uint32_t filename_offset = gcs_arena_add(index->filenames,
+                record->filename, strnlen(record->filename,
+                GCS_MAPPED_FILENAME_LEN));
+
+            if(filename_offset == GCS_ARENA_INVALID_OFFSET) {
+                continue;
+            }
+
+            GcsChunk new_chunk = gcs_chunk_new_with_times(filename_offset,
+                record->start_moment, record->stop_moment, record->duration);
+
+            new_chunk.directory = (uint16_t) i;
+            append(index, &new_chunk);
+
+            ++chunk_count;
+        }
+    }
+
+    g_rec_mutex_unlock(&index->write_lock);
+    return chunk_count;
+}
+
+int
+gcs_index_is_listed_later(GcsIndex *index, int directory, const char *filename)
+{
+    if(directory < 0 || directory >= (int) index->lists->len) {
+        return 0;
+    }
+
+    g_rec_mutex_lock(&index->write_lock);
+
+    GcsIndexList *list = &g_array_index(index->lists, GcsIndexList,
+        directory);
+
+    /* anything older was not recorded by it */
+    int listed_later = list->mapped &&
+        gcs_mapped_index_is_in_use(list->mapped) &&
+        gcs_chunk_parse_start_moment(filename) > list->last_start_moment;
+
+    g_rec_mutex_unlock(&index->write_lock);
+    return listed_later;
+}
+
+int
+gcs_index_remove_file(GcsIndex *index, int directory, const char *filename)
+{
+    g_rec_mutex_lock(&index->write_lock);
+    int chunk_count = remove_file(index, directory, filename);
+    g_rec_mutex_unlock(&index->write_lock);
 
-    if(chunk_a->start_moment < chunk_b->start_moment) {
-        return -1;
+    return chunk_count;
+}
+
+const char *
+gcs_index_get_filename(GcsIndex *index, GcsChunk *chunk)
+{
+    if(!index || !chunk || gcs_chunk_is_gap(chunk)) {
+        return NULL;
     }
 
-    if(chunk_a->start_moment == chunk_b->start_moment) {
+    return gcs_arena_get(index->filenames, chunk->filename);
+}
+
+int
+gcs_index_get_full_path(GcsIndex *index, GcsChunk *chunk, char *path,
+    int path_len)
+{
+    const char *filename = gcs_index_get_filename(index, chunk);
+    if(!filename) {
         return 0;
     }
 
-    return 1;
+    const char *directory = g_ptr_array_index(index->directories,
+        chunk->directory);
+
+    int len = snprintf(path, path_len, "%s/%s", directory, filename);
+    return (len > 0 && len < path_len);
 }
 
-static void
-detect_and_insert_gaps(GcsIndex *index)
+int
+gcs_index_count(GcsIndex *index)
 {
-    /* create a new array to store our newly build
-    index in */
-    GArray *new_index = g_array_new(0, 1, sizeof(GcsChunk));
-    GcsIndexIterator *itr = gcs_index_iterator_new(index);
+    g_rec_mutex_lock(&index->write_lock);
+    int count = (int) index->chunks->len;
+    g_rec_mutex_unlock(&index->write_lock);
 
-    /* get the start time of the index */
-    uint64_t prev_chunk_stop_time = gcs_index_get_start_time(index);
+    return count;
+}
 
-    GcsChunk *chunk;
-    while((chunk = gcs_index_iterator_next(itr)) != NULL) {
-        /* calculate amount of nanoseconds between this chunk
-        and the next one */
-        uint64_t gap = chunk->start_moment - prev_chunk_stop_time;
+uint64_t
+gcs_index_get_start_time(GcsIndex *index)
+{
+    if(!index) {
+        return 0;
+    }
 
-        /* somehow, the compiler fucks when chunk->start_moment
-        and prev_chunk_stop_time are equal (overflows the integer),
-        little hack to prevent that */
-        if(prev_chunk_stop_time >= chunk->start_moment) {
-            gap = 0;
-        }
+    g_rec_mutex_lock(&index->write_lock);
 
-        /* is it more than a second ? */
-        if(gap > MAXIMUM_GAP_TIME) {
-            /* insert a new gap into the index that is as long
-            as the gap between the previous chunk and the next one */
-            GcsChunk new_gap = gcs_chunk_new_gap(
-                prev_chunk_stop_time, chunk->start_moment);
+    /* midnight of the day the first chunk was recorded on */
+    uint64_t start_time = index->chunks->len == 0 ? 0 : get_midnight(
+        g_array_index(index->chunks, GcsChunk, 0).start_moment, 0);
 
-            g_array_append_val(new_index, new_gap);
-        }
+    g_rec_mutex_unlock(&index->write_lock);
+    return start_time;
+}
 
-        /* insert the chunk into the new index */
-        g_array_append_val(new_index, *chunk);
-        prev_chunk_stop_time = chunk->stop_moment;
+uint64_t
+gcs_index_get_end_time(GcsIndex *index)
+{
+    if(!index) {
+        return 0;
     }
 
-    /* get the end time of this index (end of the day) */
-    uint64_t next_day_time = gcs_index_get_end_time(index);
+    g_rec_mutex_lock(&index->write_lock);
+
+    /* midnight after the day the last chunk was recorded on,
+    the index can span more than one day */
+    uint64_t end_time = index->chunks->len == 0 ? 0 : get_midnight(
+        g_array_index(index->chunks, GcsChunk,
+        index->chunks->len - 1).start_moment, 1);
+
+    g_rec_mutex_unlock(&index->write_lock);
+    return end_time;
+}
+
+GcsIndexSnapshot *
+gcs_index_snapshot_acquire(GcsIndex *index)
+{
+    /* never waits, the counter only tells the writer that we might
+    be holding on to a snapshot we don't have a reference to yet */
+    int parity = g_atomic_int_get(&index->epoch) & 1;
+    g_atomic_int_inc(&index->readers[parity]);
+
+    GcsIndexSnapshot *snapshot = (GcsIndexSnapshot *) g_atomic_pointer_get(
+        &index->snapshot);
 
-    /* determine whether we need to create a gap chunk between
-    the last chunk and the end of the day */
-    uint64_t gap = next_day_time - prev_chunk_stop_time;
-    if(gap > MAXIMUM_GAP_TIME) {
-        GcsChunk new_gap = gcs_chunk_new_gap(
-            prev_chunk_stop_time, next_day_time);
+    g_atomic_int_inc(&snapshot->ref_count);
+    g_atomic_int_inc(&index->users);
 
-        g_array_append_val(new_index, new_gap);
+    if(g_atomic_int_dec_and_test(&index->readers[parity]) &&
+        g_atomic_int_get(&index->waiting)) {
+        g_mutex_lock(&index->readers_lock);
+        g_cond_broadcast(&index->readers_cond);
+        g_mutex_unlock(&index->readers_lock);
     }
 
-    /* free old index and replace with new index, which also
-    contains all the gaps */
-    g_array_free(index->chunks, TRUE);
-    index->chunks = new_index;
+    return snapshot;
 }
 
-GcsIndex *
-gcs_index_new()
+void
+gcs_index_snapshot_release(GcsIndexSnapshot *snapshot)
 {
-    GcsIndex *index = ALLOC_NULL(GcsIndex *, sizeof(GcsIndex));
-    index->chunks = g_array_new(FALSE, TRUE, sizeof(GcsChunk));
+    if(!snapshot) {
+        return;
+    }
 
-    return index;
+    /* the snapshot might be gone once we let go of it */
+    GcsIndex *index = snapshot->index;
+
+    snapshot_unref(snapshot);
+    index_unref(index);
 }
 
-int
-gcs_index_fill(GcsIndex *index, char *directory)
+GcsChunk *
+gcs_index_snapshot_get(GcsIndexSnapshot *snapshot, int position)
 {
-    int directory_len = strlen(directory);
-
-    DIR *d = opendir(directory);
-    if(!d) {
-        return -1;
+    if(!snapshot || position < 0 || position >= snapshot->count) {
+        return NULL;
     }
 
-    struct dirent *dir = NULL;
-    while((dir = readdir(d)) != NULL) {
-        /* skip non-files */
-        if(dir->d_type != DT_REG) {
-            continue;
+    /* binary search for the last block starting at or before
+    the position */
+    int low = 0;
+    int high = snapshot->block_count - 1;
+
+    while(low < high) {
+        int middle = low + (high - low + 1) / 2;
+
+        if(snapshot->block_starts[middle] <= position) {
+            low = middle;
+        } else {
+            high = middle - 1;
         }
+    }
 
-        char *filename = &dir->d_name[0];
-        int filename_len = strlen(filename);
+    return &snapshot->blocks[low]->chunks[position -
+        snapshot->block_starts[low]];
+}
+
+static int
+snapshot_lower_bound(GcsIndexSnapshot *snapshot, uint64_t moment)
+{
+    /* the first chunk that starts at or after the moment (or the
+    count when there's none), first the block it's in, by the last
+    chunk of every block, then the chunk in that block */
+    int low = 0;
+    int high = snapshot->block_count;
 
-        GcsChunk new_chunk = gcs_chunk_new(directory,
-            directory_len, filename, filename_len);
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+        GcsIndexBlock *block = snapshot->blocks[middle];
 
-        g_array_append_val(index->chunks, new_chunk);
+        if(block->chunks[block->count - 1].start_moment < moment) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
 
-    closedir(d);
+    if(low >= snapshot->block_count) {
+        return snapshot->count;
+    }
 
-    /* sort chunks from older to newer */
-    g_array_sort(index->chunks, compare_chunks_start_moment);
+    GcsIndexBlock *block = snapshot->blocks[low];
+    int first = 0;
+    int last = block->count;
 
-    /* detect and insert gaps to fill up missing chunks */
-    detect_and_insert_gaps(index);
+    while(first < last) {
+        int middle = first + (last - first) / 2;
 
-    int chunk_count = (int) index->chunks->len;
-    return chunk_count;
-}
+        if(block->chunks[middle].start_moment < moment) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
 
-int
-gcs_index_count(GcsIndex *index)
-{
-    return index->chunks->len;
+    return snapshot->block_starts[low] + first;
 }
 
-static struct tm
-gcs_index_get_date(GcsIndex *index)
+static int
+snapshot_find(GcsIndexSnapshot *snapshot, uint64_t moment)
 {
-    /* grab the first chunk and its start moment, note that
-    we have to convert it back to seconds (from nanoseconds) */
-    GcsChunk *first_chunk = &g_array_index(index->chunks, GcsChunk, 0);
-    time_t start_moment = (time_t) GCS_TIME_NANO_AS_SECONDS(first_chunk->start_moment);
+    /* the last chunk that starts at or before the moment, chunks
+    of different directories can start at the same moment, in which
+    case it's the first of them, so nothing after it is skipped */
+    int after = moment == UINT64_MAX ? snapshot->count :
+        snapshot_lower_bound(snapshot, moment + 1);
 
-    /* convert time_t to tm structure, UTC neutral */
-    struct tm date_time = *localtime(&start_moment);
-
-    /* zero out all the time related stuff, so we're left
-    with the date */
-    date_time.tm_sec = 0;
-    date_time.tm_min = 0;
-    date_time.tm_hour = 0;
-    date_time.tm_wday = 0;
-    date_time.tm_yday = 0;
+    if(after <= 0) {
+        return -1;
+    }
 
-    return date_time;
+    return snapshot_lower_bound(snapshot,
+        gcs_index_snapshot_get(snapshot, after - 1)->start_moment);
 }
 
-uint64_t
-gcs_index_get_start_time(GcsIndex *index)
+int
+gcs_index_snapshot_find_range(GcsIndexSnapshot *snapshot, uint64_t start,
+    uint64_t stop, int *first_position)
 {
-    if(!index || gcs_index_count(index) <= 0 ) {
+    *first_position = -1;
+
+    /* the range is half-open like the chunks themselves, a chunk
+    overlaps when it starts before `stop` and stops after `start` */
+    if(!snapshot || snapshot->count <= 0 || start >= stop) {
         return 0;
     }
 
-    /* get the date of the first structure, time will be
-    zeroed out (00:00:00) */
-    struct tm date_time = gcs_index_get_date(index);
-
-    /* convert to time_t and then to nanoseconds */
-    uint64_t date = (uint64_t) mktime(&date_time);
-    date = GCS_TIME_SECONDS_AS_NANO(date);
-
-    return date;
-}
+    int first = snapshot_find(snapshot, start);
+    int last = snapshot_lower_bound(snapshot, stop) - 1;
 
-uint64_t
-gcs_index_get_end_time(GcsIndex *index)
-{
-    if(!index || gcs_index_count(index) <= 0 ) {
+    /* everything starts after the end of the range */
+    if(last < 0) {
         return 0;
     }
 
-    /* get the date of the first structure, time will be
-    zeroed out (00:00:00) */
-    struct tm date_time = gcs_index_get_date(index);
+    if(first < 0) {
+        first = 0;
+    }
 
-    /* increase by one day (which gives us 00:00 at the next day)*/
-    ++date_time.tm_mday;
+    /* the chunk starting before the range might have ended
+    before the range started as well */
+    GcsChunk *chunk = gcs_index_snapshot_get(snapshot, first);
+    if(chunk->stop_moment <= start) {
+        ++first;
+    }
 
-    /* convert to time_t and then to nanoseconds */
-    uint64_t date = (uint64_t) mktime(&date_time);
-    date = GCS_TIME_SECONDS_AS_NANO(date);
+    if(first > last) {
+        return 0;
+    }
 
-    return date;
+    /* chunks are sorted and contiguous, so all the chunks in
+    between overlap with the range as well */
+    *first_position = first;
+    return (last - first) + 1;
 }
 
 void
@@ -209,12 +2320,62 @@ gcs_index_free(GcsIndex *index)
         return;
     }
 
+    gcs_index_unwatch(index);
+
+    /* iterators that are still around don't load anything
+    once the chunks are gone */
+    g_rec_mutex_lock(&index->write_lock);
+
     if(index->chunks) {
         /* last parameter indicates freeing of elements as well */
         g_array_free(index->chunks, 1);
+        index->chunks = NULL;
+    }
+
+    gcs_arena_free(index->filenames);
+
+    if(index->directories) {
+        g_ptr_array_free(index->directories, TRUE);
     }
 
-    index = NULL;
+    if(index->lists) {
+        guint i;
+        for(i = 0; i < index->lists->len; ++i) {
+            GcsIndexList *list = &g_array_index(index->lists, GcsIndexList, i);
+
+            gcs_mapped_index_close(list->mapped);
+            gcs_cache_free(list->cache);
+        }
+
+        g_array_free(index->lists, TRUE);
+    }
+
+    if(index->partitions) {
+        guint i;
+        for(i = 0; i < index->partitions->len; ++i) {
+            GcsIndexPartition *partition = get_partition(index, i);
+
+            if(partition->filenames) {
+                g_array_free(partition->filenames, TRUE);
+            }
+
+            if(partition->removed) {
+                g_ptr_array_free(partition->removed, TRUE);
+            }
+        }
+
+        g_array_free(index->partitions, TRUE);
+        g_array_free(index->days, TRUE);
+    }
+
+    gcs_cache_free(index->probed);
+    g_rec_mutex_unlock(&index->write_lock);
+
+    /* readers on other threads might still have a snapshot, or an
+    iterator, which looks at the index for newer ones, the latest
+    snapshot and the index itself stay until the last of them let
+    go, which is right away when there are none */
+    index_unref(index);
 }
 
 GcsIndexIterator *
@@ -224,39 +2385,219 @@ gcs_index_iterator_new(GcsIndex *index)
         sizeof(GcsIndexIterator));
 
     itr->index = index;
+    itr->snapshot = gcs_index_snapshot_acquire(index);
+
+    g_rec_mutex_lock(&index->write_lock);
+    g_ptr_array_add(index->iterators, itr);
+    g_rec_mutex_unlock(&index->write_lock);
+
     return itr;
 }
 
+static int
+snapshot_find_chunk(GcsIndexSnapshot *snapshot, GcsChunk *chunk)
+{
+    /* the position of a chunk of another snapshot, among the ones
+    starting at the same moment, when it's still there, otherwise
+    the first of those */
+    int position = snapshot_find(snapshot, chunk->start_moment);
+    int first = position;
+
+    GcsChunk *found;
+    while((found = gcs_index_snapshot_get(snapshot, position)) &&
+        found->start_moment == chunk->start_moment &&
+        (found->filename != chunk->filename ||
+        found->directory != chunk->directory)) {
+        ++position;
+    }
+
+    if(!found || found->start_moment != chunk->start_moment) {
+        position = first;
+    }
+
+    return position;
+}
+
+int
+gcs_index_iterator_refresh(GcsIndexIterator *itr)
+{
+    /* nothing was published since we got ours */
+    if(g_atomic_pointer_get(&itr->index->snapshot) == itr->snapshot) {
+        return 0;
+    }
+
+    GcsIndexSnapshot *snapshot = gcs_index_snapshot_acquire(itr->index);
+
+    /* chunks might have been removed before our position and the
+    trailing gap we returned might have been cut short, so find the
+    chunk we returned last again and continue after it */
+    if(itr->offset > 0) {
+        itr->offset = snapshot_find_chunk(snapshot, gcs_index_snapshot_get(
+            itr->snapshot, itr->offset - 1)) + 1;
+    }
+
+    gcs_index_snapshot_release(itr->snapshot);
+    itr->snapshot = snapshot;
+
+    return 1;
+}
+
+static void
+iterator_load(GcsIndexIterator *itr, GcsChunk *unloaded)
+{
+    GcsIndex *index = itr->index;
+
+    /* so it isn't unloaded again before we got to it */
+    __atomic_store_n(&itr->moment, unloaded->start_moment, __ATOMIC_RELAXED);
+
+    g_rec_mutex_lock(&index->write_lock);
+
+    if(index->chunks) {
+        load_partition(index, find_partition(index, unloaded->start_moment));
+    }
+
+    g_rec_mutex_unlock(&index->write_lock);
+}
+
+static GcsChunk *
+iterator_return(GcsIndexIterator *itr, GcsChunk *chunk)
+{
+    if(chunk) {
+        __atomic_store_n(&itr->moment, chunk->start_moment, __ATOMIC_RELAXED);
+    }
+
+    return chunk;
+}
+
 GcsChunk *
 gcs_index_iterator_next(GcsIndexIterator *itr)
 {
+    /* ran out of chunks, new ones might have been appended */
+    if(itr->offset >= itr->snapshot->count) {
+        gcs_index_iterator_refresh(itr);
+    }
+
+    /* an hour that isn't loaded, load it and continue with its
+    first chunk, which the chunk we returned last is right before,
+    it's loaded only once, unless it's unloaded by the time we look
+    again, at which point we give up and return it as a gap */
+    int tries;
+    for(tries = 0; tries < 2; ++tries) {
+        GcsChunk *next = gcs_index_snapshot_get(itr->snapshot, itr->offset);
+
+        if(!next || !is_unloaded(next)) {
+            break;
+        }
+
+        iterator_load(itr, next);
+        gcs_index_iterator_refresh(itr);
+    }
+
     /* don't go out of bounds */
-    if(itr->offset > (itr->index->chunks->len - 1)) {
+    if(itr->offset >= itr->snapshot->count) {
         return NULL;
     }
 
-    GcsChunk *next = &g_array_index(itr->index->chunks, GcsChunk,
-        itr->offset);
-
+    GcsChunk *next = gcs_index_snapshot_get(itr->snapshot, itr->offset);
     ++itr->offset;
 
-    return next;
+    return iterator_return(itr, next);
 }
 
 GcsChunk *
 gcs_index_iterator_prev(GcsIndexIterator *itr)
 {
+    /* an hour that isn't loaded, we continue before the chunk after
+    it, which is the chunk next() returns, or the end */
+    int tries;
+    for(tries = 0; tries < 2 && itr->offset > 0; ++tries) {
+        GcsChunk *prev = gcs_index_snapshot_get(itr->snapshot,
+            itr->offset - 1);
+
+        if(!is_unloaded(prev)) {
+            break;
+        }
+
+        GcsChunk *after = gcs_index_snapshot_get(itr->snapshot, itr->offset);
+        iterator_load(itr, prev);
+
+        GcsIndexSnapshot *snapshot = gcs_index_snapshot_acquire(itr->index);
+        itr->offset = after ? snapshot_find_chunk(snapshot, after) :
+            snapshot->count;
+
+        gcs_index_snapshot_release(itr->snapshot);
+        itr->snapshot = snapshot;
+    }
+
     /* don't go out of bounds */
-    if(itr->offset == 0 && itr->index->chunks->len > 0) {
+    if(itr->offset <= 0) {
         return NULL;
     }
 
     --itr->offset;
 
-    GcsChunk *prev = &g_array_index(itr->index->chunks, GcsChunk,
-        itr->offset);
+    GcsChunk *prev = gcs_index_snapshot_get(itr->snapshot, itr->offset);
+    return iterator_return(itr, prev);
+}
+
+GcsChunk *
+gcs_index_iterator_seek(GcsIndexIterator *itr, uint64_t moment,
+    uint64_t *chunk_offset)
+{
+    if(chunk_offset) {
+        *chunk_offset = 0;
+    }
+
+    /* seek in the latest chunks, after loading the hour
+    the moment is in, when it isn't */
+    GcsChunk *chunk = NULL;
+    int position = 0;
+
+    int tries;
+    for(tries = 0; tries < 2; ++tries) {
+        gcs_index_iterator_refresh(itr);
+
+        GcsIndexSnapshot *snapshot = itr->snapshot;
+        if(snapshot->count <= 0) {
+            return NULL;
+        }
+
+        position = snapshot_find(snapshot, moment);
+
+        /* before the first chunk, start at the beginning */
+        if(position < 0) {
+            position = 0;
+        }
+
+        chunk = gcs_index_snapshot_get(snapshot, position);
+
+        if(!is_unloaded(chunk)) {
+            break;
+        }
+
+        iterator_load(itr, chunk);
+    }
+
+    if(moment >= chunk->start_moment && moment < chunk->stop_moment) {
+        if(chunk_offset) {
+            *chunk_offset = moment - chunk->start_moment;
+        }
+    } else if(moment >= chunk->stop_moment) {
+        /* the moment falls in between two chunks (holes too small
+        to become a gap), continue at the start of the next one */
+        ++position;
+
+        if(position >= itr->snapshot->count) {
+            return NULL;
+        }
+
+        chunk = gcs_index_snapshot_get(itr->snapshot, position);
+    }
 
-    return prev;
+    /* position the iterator so the next call to next()
+    returns this chunk */
+    itr->offset = position;
+    return iterator_return(itr, chunk);
 }
 
 GcsChunk *
@@ -270,6 +2611,92 @@ gcs_index_iterator_peek(GcsIndexIterator *itr)
     return chunk;
 }
 
+GcsChunk *
+gcs_index_iterator_peek_ahead(GcsIndexIterator *itr, int distance)
+{
+    /* without moving, 0 is the chunk that next() returns, 1 the one
+    after it, -1 the chunk that prev() returns, -2 the one before it,
+    looks at the snapshot the iterator has, not a newer one, and
+    doesn't load hours, those that aren't loaded look like gaps */
+    int position = itr->offset + distance;
+
+    if(position < 0 || position >= itr->snapshot->count) {
+        return NULL;
+    }
+
+    return gcs_index_snapshot_get(itr->snapshot, position);
+}
+
+const char *
+gcs_index_iterator_get_filename(GcsIndexIterator *itr, GcsChunk *chunk)
+{
+    if(!itr || !chunk || gcs_chunk_is_gap(chunk)) {
+        return NULL;
+    }
+
+    return gcs_arena_get(itr->snapshot->filenames, chunk->filename);
+}
+
+int
+gcs_index_iterator_get_full_path(GcsIndexIterator *itr, GcsChunk *chunk,
+    char *path, int path_len)
+{
+    const char *filename = gcs_index_iterator_get_filename(itr, chunk);
+    if(!filename || chunk->directory >= itr->snapshot->directory_count) {
+        return 0;
+    }
+
+    const char *directory = itr->snapshot->directories[chunk->directory];
+
+    int len = snprintf(path, path_len, "%s/%s", directory, filename);
+    return (len > 0 && len < path_len);
+}
+
+int
+gcs_index_iterator_find_keyframe(GcsIndexIterator *itr, GcsChunk *chunk,
+    uint64_t offset, GcsMetaKeyframe *keyframe)
+{
+    keyframe->time = 0;
+    keyframe->offset = 0;
+
+    char full_path[PATH_MAX];
+    if(!gcs_index_iterator_get_full_path(itr, chunk, full_path, PATH_MAX)) {
+        return 0;
+    }
+
+    /* the keyframes are read from the cues at the end of the file
+    when they're needed instead of being kept for every chunk, that
+    keeps chunks small and filling the index cheap, seeking into a
+    chunk costs a couple of reads */
+    GArray *keyframes = g_array_new(FALSE, FALSE, sizeof(GcsMetaKeyframe));
+    gcs_meta_get_mkv_keyframes(full_path, keyframes);
+
+    /* binary search for the last keyframe at or before the offset */
+    int low = 0;
+    int high = (int) keyframes->len - 1;
+    int result = -1;
+
+    while(low <= high) {
+        int middle = low + (high - low) / 2;
+        GcsMetaKeyframe *candidate = &g_array_index(keyframes,
+            GcsMetaKeyframe, middle);
+
+        if(candidate->time <= offset) {
+            result = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    if(result >= 0) {
+        *keyframe = g_array_index(keyframes, GcsMetaKeyframe, result);
+    }
+
+    g_array_free(keyframes, TRUE);
+    return (result >= 0);
+}
+
 void
 gcs_index_iterator_free(GcsIndexIterator *itr)
 {
@@ -277,6 +2704,11 @@ gcs_index_iterator_free(GcsIndexIterator *itr)
         return;
     }
 
+    g_rec_mutex_lock(&itr->index->write_lock);
+    g_ptr_array_remove_fast(itr->index->iterators, itr);
+    g_rec_mutex_unlock(&itr->index->write_lock);
+
+    gcs_index_snapshot_release(itr->snapshot);
     free(itr);
     itr = NULL;
 }
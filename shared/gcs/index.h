@@ -4,29 +4,308 @@
 #include <gst/gst.h>
 
 #include <gcs/chunk.h>
+#include <gcs/arena.h>
+#include <gcs/meta.h>
+#include <gcs/cache.h>
+#include <gcs/mapped.h>
+#include <gcs/time.h>
 
-/* explictly made a struct instead of typedef so
-new members can easily be added */
+/* snapshots hold their chunks in blocks of at most this many, a
+change only copies the blocks it touches, the others are shared
+with the snapshot before it */
+#define GCS_INDEX_BLOCK_SIZE 1024
+
+/* lazy indexes (see gcs_index_set_max_loaded_hours) keep the chunks
+of an hour together, as a partition, which is loaded as a whole */
+#define GCS_INDEX_HOUR GCS_TIME_SECONDS_AS_NANO(3600ULL)
+
+/* hours kept loaded by default, older ones are unloaded when
+another one is loaded, unless an iterator is in or next to them */
+#define GCS_INDEX_DEFAULT_MAX_LOADED_HOURS 48
+
+/* directory of the chunk that stands in for an hour that isn't
+loaded, it has no file, so to anything but the iterators that load
+it, it looks like any other gap */
+#define GCS_INDEX_UNLOADED UINT16_MAX
+
+/* snapshots point back to the index they came from, which is
+defined further down */
+typedef struct _GcsIndex GcsIndex;
+
+/* a run of chunks, never changed after it was published, freed
+when the last snapshot that has it is released */
+typedef struct {
+    gint ref_count;
+    int count;
+    GcsChunk chunks[];
+} GcsIndexBlock;
+
+/* immutable view of the chunks in an index, the thread that
+modifies the index publishes a new one after every change, any
+thread can acquire the latest one without taking a lock and
+keeps it alive by holding a reference */
+typedef struct {
+    gint ref_count;
+
+    /* the chunks, in order, spread over the blocks, the position
+    of every block's first chunk is kept to find chunks by position */
+    GcsIndexBlock **blocks;
+    int *block_starts;
+    int block_count;
+    int count;
+
+    /* the directories as they were when this was published, the
+    strings are in the arena */
+    char **directories;
+    int directory_count;
+
+    /* referenced by every snapshot, so the strings outlive the
+    index when a reader still has one */
+    GcsStringArena *filenames;
+
+    /* the index it was published by, readers keep it alive (see
+    `users` in the index) until they released their snapshot */
+    GcsIndex *index;
+} GcsIndexSnapshot;
+
+/* the chunk list the recorder keeps in a directory, kept open
+after the fill to pick up the chunks it adds to it */
+typedef struct {
+    GcsMappedIndex *mapped;
+
+    /* records that were read into the index already */
+    uint64_t record_count;
+
+    /* start of the newest chunk in the list, the recorder lists
+    newer files itself, once it's done with them */
+    uint64_t last_start_moment;
+
+    /* the records before it are of files that were deleted */
+    uint64_t first_record;
+
+    /* files in the directory that are not in the list, in lazy
+    indexes, loading an hour they're in means reading the directory,
+    their probes are kept in the cache, which is loaded once */
+    int unlisted;
+    GcsCache *cache;
+} GcsIndexList;
+
+/* the chunks that started in the same hour, the hours are those of
+UTC, so the hour that repeats when daylight saving time ends is two
+partitions, a partition goes on until the next one starts, so the
+gaps after its last chunk are part of it */
+typedef struct {
+    uint64_t hour;
+
+    /* start of its first chunk, it might have been deleted since */
+    uint64_t start_moment;
+
+    /* when it isn't, the index has a single chunk (see
+    GCS_INDEX_UNLOADED) in place of its chunks */
+    int loaded;
+
+    /* some of its chunks were not in the chunk list */
+    int unlisted;
+
+    /* when it was last loaded, the ones loaded longest ago
+    are unloaded first */
+    gint64 load_time;
+
+    /* arena offsets of the filenames of its chunks, in order, so
+    loading it again does not add the same names to the arena again,
+    NULL until it's loaded for the first time */
+    GArray *filenames;
+
+    /* files that were deleted while it wasn't loaded, as
+    directory/filename, the chunk list still has them */
+    GPtrArray *removed;
+} GcsIndexPartition;
+
+/* the partitions whose first chunk started on the same local day,
+which has 23 or 25 of them when daylight saving time starts or ends */
 typedef struct {
+    /* local midnight */
+    uint64_t start_moment;
+
+    int first_partition;
+    int partition_count;
+} GcsIndexDay;
+
+/* where the time went while filling the index, in microseconds,
+parsing and probing happens on many threads at once, their times
+are summed over all chunks, the wall time of probing is separate */
+typedef struct {
+    gint64 readdir_time;
+    gint64 cache_time;
+    gint64 parse_time;
+    gint64 probe_time;
+    gint64 probe_wall_time;
+    gint64 sort_time;
+    gint64 gap_time;
+
+    int probed;
+    int cached;
+
+    /* hours of lazy indexes that were loaded and unloaded, and
+    the time it took to load them */
+    int loaded_hours;
+    int unloaded_hours;
+    gint64 load_time;
+} GcsIndexStats;
+
+/* explictly made a struct instead of typedef so
+new members can easily be added
+
+only a single thread (the one that fills and watches the index)
+may use the functions below that take an index, other threads read
+through snapshots and iterators, in lazy indexes, iterators load
+hours as well, so changes are made with `write_lock` held */
+struct _GcsIndex {
     GArray *chunks;
-} GcsIndex;
 
+    /* filenames of all chunks, chunks refer to them by offset */
+    GcsStringArena *filenames;
+
+    /* resolved paths of the directories the chunks live in,
+    chunks refer to them by their position, the strings are
+    stored in the arena along with the filenames */
+    GPtrArray *directories;
+
+    /* chunk list of every directory, by position, the list is
+    NULL for directories that have none */
+    GArray *lists;
+
+    /* inotify instance used to pick up new chunks, -1 (or 0
+    before gcs_index_watch) when not watching */
+    int watch_fd;
+    guint watch_source;
+
+    /* watch descriptor of every directory, by position */
+    GArray *watch_descriptors;
+
+    /* files probed since the fill, keyed by directory position
+    and filename, a file that's closed again is probed again only
+    when its mtime or size changed */
+    GcsCache *probed;
+
+    /* amount of threads used to probe chunks, 0 means
+    one per processor */
+    int thread_count;
+
+    /* latest published snapshot, only replaced by the writer */
+    GcsIndexSnapshot *snapshot;
+
+    /* chunks that changed since the snapshot was published, in
+    positions of the snapshot, the ones after `changed_to` only
+    moved, by as many as were added or removed, -1 when nothing
+    changed */
+    int changed_from;
+    int changed_to;
+
+    /* readers that are in the middle of acquiring the snapshot,
+    counted per parity of the epoch they started in, the writer
+    waits for them before dropping its reference to an old one,
+    the last reader of a parity signals it when `waiting` is set */
+    gint epoch;
+    gint readers[2];
+    gint waiting;
+    GMutex readers_lock;
+    GCond readers_cond;
+
+    /* snapshots acquired by readers, plus one for the index itself
+    until gcs_index_free, whoever drops it to zero frees what's left
+    of the index, the latest snapshot and the index itself */
+    gint users;
+
+    /* added to by every fill */
+    GcsIndexStats stats;
+
+    /* taken by everything that modifies the index, or reads it
+    without a snapshot, recursive as those call each other */
+    GRecMutex write_lock;
+
+    /* 0 unless lazy, in which case the fill only finds out which
+    hours have chunks (from the names of the files, or the chunk
+    lists) and iterators load an hour when they get to it */
+    int max_loaded_hours;
+    int loaded_count;
+
+    /* partitions by hour, and the days they're on, by day */
+    GArray *partitions;
+    GArray *days;
+
+    /* iterators of the index, hours they are in, or next
+    to, are never unloaded */
+    GPtrArray *iterators;
+};
+
+/* iterators read from a snapshot, so every reader (such as every
+client of the server) can have its own without locking, chunks
+returned by it stay valid until it moves to a newer snapshot */
 typedef struct {
     GcsIndex *index;
+    GcsIndexSnapshot *snapshot;
     int offset;
+
+    /* start of the chunk it returned last, only touched
+    atomically, the index looks at it from the writer */
+    uint64_t moment;
 } GcsIndexIterator;
 
 GcsIndex *      gcs_index_new();
 int             gcs_index_fill(GcsIndex *index, char *directory);
+
+/* fills from several directories at once, separated by colons */
+int             gcs_index_fill_directories(GcsIndex *index,
+                    const char *directories);
+int             gcs_index_append(GcsIndex *index, GcsChunk *chunk);
+int             gcs_index_append_file(GcsIndex *index, int directory,
+                    const char *filename);
+int             gcs_index_refresh(GcsIndex *index);
+
+/* whether the recorder is running in the directory and is going
+to list the file itself, once it's done with it */
+int             gcs_index_is_listed_later(GcsIndex *index, int directory,
+                    const char *filename);
+void            gcs_index_set_thread_count(GcsIndex *index, int thread_count);
+
+/* makes the fills that follow lazy, at most this many hours
+are loaded at once (a few more when iterators are spread out) */
+void            gcs_index_set_max_loaded_hours(GcsIndex *index,
+                    int max_loaded_hours);
 int             gcs_index_count(GcsIndex *index);
+const char *    gcs_index_get_filename(GcsIndex *index, GcsChunk *chunk);
+int             gcs_index_get_full_path(GcsIndex *index, GcsChunk *chunk,
+                    char *path, int path_len);
 uint64_t        gcs_index_get_start_time(GcsIndex *index);
 uint64_t        gcs_index_get_end_time(GcsIndex *index);
+int             gcs_index_remove_file(GcsIndex *index, int directory,
+                    const char *filename);
 void            gcs_index_free(GcsIndex *index);
 
+GcsIndexSnapshot *  gcs_index_snapshot_acquire(GcsIndex *index);
+void                gcs_index_snapshot_release(GcsIndexSnapshot *snapshot);
+GcsChunk *          gcs_index_snapshot_get(GcsIndexSnapshot *snapshot,
+                        int position);
+int                 gcs_index_snapshot_find_range(GcsIndexSnapshot *snapshot,
+                        uint64_t start, uint64_t stop, int *first_position);
+
 GcsIndexIterator * gcs_index_iterator_new(GcsIndex *index);
 GcsChunk *         gcs_index_iterator_next(GcsIndexIterator *itr);
 GcsChunk *         gcs_index_iterator_prev(GcsIndexIterator *itr);
 GcsChunk *         gcs_index_iterator_peek(GcsIndexIterator *itr);
+GcsChunk *         gcs_index_iterator_peek_ahead(GcsIndexIterator *itr,
+                       int distance);
+GcsChunk *         gcs_index_iterator_seek(GcsIndexIterator *itr,
+                       uint64_t moment, uint64_t *chunk_offset);
+int                gcs_index_iterator_refresh(GcsIndexIterator *itr);
+const char *       gcs_index_iterator_get_filename(GcsIndexIterator *itr,
+                       GcsChunk *chunk);
+int                gcs_index_iterator_get_full_path(GcsIndexIterator *itr,
+                       GcsChunk *chunk, char *path, int path_len);
+int                gcs_index_iterator_find_keyframe(GcsIndexIterator *itr,
+                       GcsChunk *chunk, uint64_t offset,
+                       GcsMetaKeyframe *keyframe);
 void               gcs_index_iterator_free(GcsIndexIterator *itr);
 
 #endif /* __gst_chunks_shared_index_h */
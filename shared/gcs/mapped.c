@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include <gcs/mem.h>
+#include <gcs/mapped.h>
+
+static const char MAPPED_MAGIC[4] = { 'G', 'C', 'S', 'M' };
+
+static void
+build_mapped_path(const char *directory, char *path, int path_len)
+{
+    snprintf(path, path_len, "%s/%s", directory, GCS_MAPPED_FILENAME);
+}
+
+static uint64_t
+get_capacity(GcsMappedIndex *mapped)
+{
+    return (mapped->size - sizeof(GcsMappedHeader)) / sizeof(GcsMappedRecord);
+}
+
+static int
+map_file(GcsMappedIndex *mapped, size_t size)
+{
+    int protection = PROT_READ;
+    if(mapped->writable) {
+        protection |= PROT_WRITE;
+    }
+
+    void *memory = mmap(NULL, size, protection, MAP_SHARED, mapped->fd, 0);
+    if(memory == MAP_FAILED) {
+        return 0;
+    }
+
+    if(mapped->header) {
+        munmap(mapped->header, mapped->size);
+    }
+
+    mapped->header = (GcsMappedHeader *) memory;
+    mapped->size = size;
+    return 1;
+}
+
+static int
+is_valid(GcsMappedIndex *mapped)
+{
+    GcsMappedHeader *header = mapped->header;
+
+    return memcmp(header->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC)) == 0 &&
+        header->version == GCS_MAPPED_VERSION &&
+        header->record_size == sizeof(GcsMappedRecord);
+}
+
+int
+gcs_mapped_index_exists(const char *directory)
+{
+    char path[PATH_MAX];
+    build_mapped_path(directory, path, PATH_MAX);
+
+    return access(path, F_OK) == 0;
+}
+
+GcsMappedIndex *
+gcs_mapped_index_open(const char *directory)
+{
+    char path[PATH_MAX];
+    build_mapped_path(directory, path, PATH_MAX);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return NULL;
+    }
+
+    struct stat file_info;
+    if(fstat(fd, &file_info) != 0 ||
+        file_info.st_size < (off_t) sizeof(GcsMappedHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    GcsMappedIndex *mapped = ALLOC_NULL(GcsMappedIndex *,
+        sizeof(GcsMappedIndex));
+
+    mapped->fd = fd;
+
+    if(!map_file(mapped, (size_t) file_info.st_size) || !is_valid(mapped)) {
+        printf("[wrn] ignoring incompatible chunk list '%s'\n", path);
+        gcs_mapped_index_close(mapped);
+        return NULL;
+    }
+
+    return mapped;
+}
+
+GcsMappedIndex *
+gcs_mapped_index_create(const char *directory)
+{
+    char path[PATH_MAX];
+    build_mapped_path(directory, path, PATH_MAX);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        fprintf(stderr, "[err] could not open chunk list '%s'\n", path);
+        return NULL;
+    }
+
+    /* records are appended in-place, two writers would
+    overwrite each other's records */
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "[err] chunk list '%s' is in use by another "
+            "recorder\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    struct stat file_info;
+    if(fstat(fd, &file_info) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    GcsMappedIndex *mapped = ALLOC_NULL(GcsMappedIndex *,
+        sizeof(GcsMappedIndex));
+
+    mapped->fd = fd;
+    mapped->writable = 1;
+
+    size_t size = (size_t) file_info.st_size;
+    int is_new = (size < sizeof(GcsMappedHeader));
+
+    if(is_new) {
+        size = sizeof(GcsMappedHeader) +
+            GCS_MAPPED_GROW_COUNT * sizeof(GcsMappedRecord);
+
+        if(ftruncate(fd, (off_t) size) != 0) {
+            goto error;
+        }
+    }
+
+    if(!map_file(mapped, size)) {
+        goto error;
+    }
+
+    if(is_new) {
+        GcsMappedHeader *header = mapped->header;
+        memcpy(header->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC));
+        header->version = GCS_MAPPED_VERSION;
+        header->record_size = sizeof(GcsMappedRecord);
+        header->count = 0;
+    }
+
+    /* don't touch a file we don't understand, somebody has to
+    remove it so it can be rebuilt */
+    if(!is_valid(mapped)) {
+        fprintf(stderr, "[err] incompatible chunk list '%s'\n", path);
+        goto error;
+    }
+
+    return mapped;
+
+error:
+    gcs_mapped_index_close(mapped);
+    return NULL;
+}
+
+uint64_t
+gcs_mapped_index_refresh(GcsMappedIndex *mapped)
+{
+    if(!mapped) {
+        return 0;
+    }
+
+    /* pairs with the store in gcs_mapped_index_append, records
+    below the count are completely written */
+    uint64_t count = __atomic_load_n(&mapped->header->count,
+        __ATOMIC_ACQUIRE);
+
+    if(count <= get_capacity(mapped)) {
+        return count;
+    }
+
+    /* the recorder grew the file since we mapped it, pointers
+    to records from before this call are invalid after remapping */
+    struct stat file_info;
+    if(fstat(mapped->fd, &file_info) != 0 ||
+        !map_file(mapped, (size_t) file_info.st_size)) {
+        return get_capacity(mapped);
+    }
+
+    if(count > get_capacity(mapped)) {
+        count = get_capacity(mapped);
+    }
+
+    return count;
+}
+
+GcsMappedRecord *
+gcs_mapped_index_get(GcsMappedIndex *mapped, uint64_t position)
+{
+    if(position >= get_capacity(mapped)) {
+        return NULL;
+    }
+
+    GcsMappedRecord *records = (GcsMappedRecord *) (mapped->header + 1);
+    return &records[position];
+}
+
+int
+gcs_mapped_index_append(GcsMappedIndex *mapped, const char *filename,
+    uint64_t start_moment, uint64_t stop_moment, uint64_t duration)
+{
+    if(!mapped || !mapped->writable) {
+        return 0;
+    }
+
+    int filename_len = strlen(filename);
+    if(filename_len >= GCS_MAPPED_FILENAME_LEN) {
+        return 0;
+    }
+
+    uint64_t count = mapped->header->count;
+
+    /* out of room, grow the file and map it again, readers
+    find out through the count */
+    if(count >= get_capacity(mapped)) {
+        size_t size = mapped->size +
+            GCS_MAPPED_GROW_COUNT * sizeof(GcsMappedRecord);
+
+        if(ftruncate(mapped->fd, (off_t) size) != 0 ||
+            !map_file(mapped, size)) {
+            return 0;
+        }
+    }
+
+    GcsMappedRecord *record = gcs_mapped_index_get(mapped, count);
+    memset(record, 0, sizeof(GcsMappedRecord));
+    memcpy(record->filename, filename, filename_len);
+
+    record->start_moment = start_moment;
+    record->stop_moment = stop_moment;
+    record->duration = duration;
+
+    /* publish the record, readers never see a half written one */
+    __atomic_store_n(&mapped->header->count, count + 1, __ATOMIC_RELEASE);
+
+    /* writes through the mapping don't reach inotify, touching the
+    file does, which is what readers that watch the directory wait
+    for, instead of looking at the count every so often */
+    futimens(mapped->fd, NULL);
+    return 1;
+}
+
+int
+gcs_mapped_index_is_in_use(GcsMappedIndex *mapped)
+{
+    /* the recorder holds its lock for as long as it records, the
+    shared one is dropped right away, so it doesn't keep a recorder
+    that starts later from taking it */
+    if(flock(mapped->fd, LOCK_SH | LOCK_NB) != 0) {
+        return 1;
+    }
+
+    flock(mapped->fd, LOCK_UN);
+    return 0;
+}
+
+void
+gcs_mapped_index_close(GcsMappedIndex *mapped)
+{
+    if(!mapped) {
+        return;
+    }
+
+    if(mapped->header) {
+        munmap(mapped->header, mapped->size);
+    }
+
+    /* also releases the lock of the writer */
+    close(mapped->fd);
+    free(mapped);
+}
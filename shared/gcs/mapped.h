@@ -0,0 +1,70 @@
+#ifndef __gst_chunks_shared_mapped_h
+#define __gst_chunks_shared_mapped_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* name of the file (inside the recording directory) that the
+recorder lists its chunks in, starts with a dot so the indexer
+skips it while scanning */
+#define GCS_MAPPED_FILENAME ".gcs-chunks"
+
+/* bump this whenever the layout of the header or a record
+changes, readers ignore files with a different version */
+#define GCS_MAPPED_VERSION 1
+
+/* "DD-MM-YYYY_HH-MM-SS.mkv" fits with room to spare */
+#define GCS_MAPPED_FILENAME_LEN 40
+
+/* amount of records the file grows by when it's full, growing
+means remapping, so don't do it for every record */
+#define GCS_MAPPED_GROW_COUNT 1024
+
+/* the file is a header followed by fixed-size records, it is
+used in-place through a shared mapping, values are in host byte
+order since the file never leaves the machine it was made on */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+
+    /* amount of records that are completely written, only the
+    recorder changes it, always after writing the record, readers
+    watch it to find out about new chunks */
+    uint64_t count;
+
+    uint8_t padding[40];
+} GcsMappedHeader;
+
+typedef struct {
+    uint64_t start_moment;
+    uint64_t stop_moment;
+    uint64_t duration;
+
+    /* null terminated, relative to the directory */
+    char filename[GCS_MAPPED_FILENAME_LEN];
+} GcsMappedRecord;
+
+typedef struct {
+    int fd;
+    int writable;
+
+    /* start of the mapping, the records follow the header */
+    GcsMappedHeader *header;
+    size_t size;
+} GcsMappedIndex;
+
+GcsMappedIndex *    gcs_mapped_index_open(const char *directory);
+GcsMappedIndex *    gcs_mapped_index_create(const char *directory);
+int                 gcs_mapped_index_exists(const char *directory);
+uint64_t            gcs_mapped_index_refresh(GcsMappedIndex *mapped);
+GcsMappedRecord *   gcs_mapped_index_get(GcsMappedIndex *mapped,
+                        uint64_t position);
+int                 gcs_mapped_index_append(GcsMappedIndex *mapped,
+                        const char *filename, uint64_t start_moment,
+                        uint64_t stop_moment, uint64_t duration);
+int                 gcs_mapped_index_is_in_use(GcsMappedIndex *mapped);
+void                gcs_mapped_index_close(GcsMappedIndex *mapped);
+
+#endif /* __gst_chunks_shared_mapped_h */
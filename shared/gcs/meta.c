@@ -1,18 +1,581 @@
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <gst/gst.h>
 #include <gst/pbutils/pbutils.h>
 
 #include <gcs/meta.h>
+#include <gcs/ebml.h>
 #include <gcs/mem.h>
 
+/* the info element is tiny, refuse to read huge ones as that
+means the file is corrupt */
+#define MKV_MAX_INFO_SIZE 4096
+
+/* same for the seek head and cues, a 10 second chunk has a
+cue point per keyframe, which is a couple of bytes each */
+#define MKV_MAX_SEEK_HEAD_SIZE 4096
+#define MKV_MAX_CUES_SIZE (1024 * 1024)
+
+typedef struct {
+    uint64_t id;
+    uint64_t size;
+    uint64_t offset;        /* offset of the element's data */
+} MkvElement;
+
+static int
+read_element(int fd, uint64_t offset, uint64_t end, MkvElement *element)
+{
+    /* 4 bytes for the id and 8 for the size is the maximum */
+    uint8_t header[12];
+
+    if(offset >= end) {
+        return 0;
+    }
+
+    size_t wanted = sizeof(header);
+    if(end - offset < wanted) {
+        wanted = (size_t) (end - offset);
+    }
+
+    ssize_t got = pread(fd, header, wanted, (off_t) offset);
+    if(got <= 0) {
+        return 0;
+    }
+
+    int id_len = gcs_ebml_read_vint(header, (int) got, 1, &element->id);
+    if(id_len <= 0 || id_len > 4) {
+        return 0;
+    }
+
+    int size_len = gcs_ebml_read_vint(header + id_len, (int) got - id_len, 0,
+        &element->size);
+
+    if(size_len <= 0) {
+        return 0;
+    }
+
+    element->offset = offset + id_len + size_len;
+    return 1;
+}
+
+static uint64_t
+element_end(MkvElement *element, uint64_t end)
+{
+    /* unknown sizes and sizes beyond the end of the file (truncated)
+    are clamped to whatever is left */
+    if(element->size == GCS_MKV_UNKNOWN_SIZE ||
+        element->size > end - element->offset) {
+        return end;
+    }
+
+    return element->offset + element->size;
+}
+
+static int
+parse_info(int fd, MkvElement *info, uint64_t *timecode_scale,
+    double *duration)
+{
+    if(info->size == GCS_MKV_UNKNOWN_SIZE || info->size > MKV_MAX_INFO_SIZE) {
+        return 0;
+    }
+
+    /* read the whole element at once, it's small */
+    uint8_t data[MKV_MAX_INFO_SIZE];
+    if(pread(fd, data, (size_t) info->size, (off_t) info->offset) !=
+        (ssize_t) info->size) {
+        return 0;
+    }
+
+    int position = 0;
+    int data_len = (int) info->size;
+
+    while(position < data_len) {
+        uint64_t id = 0;
+        uint64_t size = 0;
+
+        int id_len = gcs_ebml_read_vint(data + position, data_len - position,
+            1, &id);
+        if(id_len <= 0) {
+            break;
+        }
+
+        position += id_len;
+
+        int size_len = gcs_ebml_read_vint(data + position,
+            data_len - position, 0, &size);
+
+        if(size_len <= 0 || size > (uint64_t) (data_len - position - size_len)) {
+            break;
+        }
+
+        position += size_len;
+
+        if(id == GCS_MKV_ID_TIMECODE_SCALE) {
+            *timecode_scale = gcs_ebml_read_uint(data + position, size);
+        } else if(id == GCS_MKV_ID_DURATION) {
+            *duration = gcs_ebml_read_float(data + position, size);
+        }
+
+        position += (int) size;
+    }
+
+    return 1;
+}
+
+static uint8_t *
+read_whole_element(int fd, MkvElement *element, uint64_t max_size)
+{
+    if(element->size == GCS_MKV_UNKNOWN_SIZE || element->size > max_size) {
+        return NULL;
+    }
+
+    uint8_t *data = ALLOC_NULL(uint8_t *, element->size + 1);
+    if(pread(fd, data, (size_t) element->size, (off_t) element->offset) !=
+        (ssize_t) element->size) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static uint64_t
+parse_seek_head(int fd, MkvElement *seek_head)
+{
+    /* returns the position of the cues, relative to the
+    start of the segment's data, or 0 when it's not listed */
+    uint8_t *data = read_whole_element(fd, seek_head, MKV_MAX_SEEK_HEAD_SIZE);
+    if(!data) {
+        return 0;
+    }
+
+    int data_len = (int) seek_head->size;
+    int position = 0;
+    uint64_t cues_position = 0;
+
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *seek;
+
+    while(!cues_position &&
+        (seek = gcs_ebml_read_child(data, data_len, &position, &id,
+        &size)) != NULL) {
+        if(id != GCS_MKV_ID_SEEK) {
+            continue;
+        }
+
+        uint64_t seek_id = 0;
+        uint64_t seek_position = 0;
+
+        int seek_len = (int) size;
+        int seek_child_position = 0;
+        const uint8_t *value;
+
+        while((value = gcs_ebml_read_child(seek, seek_len, &seek_child_position,
+            &id, &size)) != NULL) {
+            if(id == GCS_MKV_ID_SEEK_ID) {
+                seek_id = gcs_ebml_read_uint(value, size);
+            } else if(id == GCS_MKV_ID_SEEK_POSITION) {
+                seek_position = gcs_ebml_read_uint(value, size);
+            }
+        }
+
+        if(seek_id == GCS_MKV_ID_CUES) {
+            cues_position = seek_position;
+        }
+    }
+
+    free(data);
+    return cues_position;
+}
+
+static int
+parse_cues(int fd, MkvElement *cues, uint64_t segment_offset,
+    uint64_t timecode_scale, GArray *keyframes)
+{
+    uint8_t *data = read_whole_element(fd, cues, MKV_MAX_CUES_SIZE);
+    if(!data) {
+        return 0;
+    }
+
+    int data_len = (int) cues->size;
+    int position = 0;
+
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *cue_point;
+
+    while((cue_point = gcs_ebml_read_child(data, data_len, &position, &id,
+        &size)) != NULL) {
+        if(id != GCS_MKV_ID_CUE_POINT) {
+            continue;
+        }
+
+        uint64_t cue_time = 0;
+        uint64_t cluster_position = 0;
+        int have_position = 0;
+
+        int cue_point_len = (int) size;
+        int cue_point_position = 0;
+        const uint8_t *value;
+
+        while((value = gcs_ebml_read_child(cue_point, cue_point_len,
+            &cue_point_position, &id, &size)) != NULL) {
+            if(id == GCS_MKV_ID_CUE_TIME) {
+                cue_time = gcs_ebml_read_uint(value, size);
+            } else if(id == GCS_MKV_ID_CUE_TRACK_POSITIONS && !have_position) {
+                /* there's only one track, take the first one */
+                int track_len = (int) size;
+                int track_position = 0;
+                const uint8_t *track_value;
+
+                while((track_value = gcs_ebml_read_child(value, track_len,
+                    &track_position, &id, &size)) != NULL) {
+                    if(id == GCS_MKV_ID_CUE_CLUSTER_POSITION) {
+                        cluster_position = gcs_ebml_read_uint(track_value,
+                            size);
+                        have_position = 1;
+                    }
+                }
+            }
+        }
+
+        if(!have_position) {
+            continue;
+        }
+
+        GcsMetaKeyframe keyframe;
+        keyframe.time = cue_time * timecode_scale;
+        keyframe.offset = segment_offset + cluster_position;
+
+        g_array_append_val(keyframes, keyframe);
+    }
+
+    free(data);
+    return 1;
+}
+
+static uint64_t
+scan_cluster(int fd, MkvElement *cluster, uint64_t end)
+{
+    /* returns the timecode (in timecode scale units) at which the
+    last block in the cluster ends */
+    uint64_t cluster_end = element_end(cluster, end);
+    uint64_t cluster_timecode = 0;
+    uint64_t last_block_end = 0;
+
+    uint64_t offset = cluster->offset;
+    MkvElement child;
+
+    while(read_element(fd, offset, cluster_end, &child)) {
+        /* clusters written with an unknown size end where the
+        next top level element starts */
+        if(gcs_ebml_is_level1_id(child.id)) {
+            break;
+        }
+
+        uint64_t block_offset = 0;
+        uint64_t block_duration = 0;
+
+        if(child.id == GCS_MKV_ID_CLUSTER_TIMECODE) {
+            uint8_t data[8];
+            if(child.size <= sizeof(data) &&
+                pread(fd, data, (size_t) child.size, (off_t) child.offset) ==
+                (ssize_t) child.size) {
+                cluster_timecode = gcs_ebml_read_uint(data, child.size);
+            }
+        } else if(child.id == GCS_MKV_ID_SIMPLE_BLOCK) {
+            block_offset = child.offset;
+        } else if(child.id == GCS_MKV_ID_BLOCK_GROUP) {
+            /* look for the block and its duration inside the group */
+            uint64_t group_end = element_end(&child, cluster_end);
+            uint64_t group_offset = child.offset;
+            MkvElement group_child;
+
+            while(read_element(fd, group_offset, group_end, &group_child)) {
+                if(group_child.id == GCS_MKV_ID_BLOCK) {
+                    block_offset = group_child.offset;
+                } else if(group_child.id == GCS_MKV_ID_BLOCK_DURATION) {
+                    uint8_t data[8];
+                    if(group_child.size <= sizeof(data) &&
+                        pread(fd, data, (size_t) group_child.size,
+                            (off_t) group_child.offset) ==
+                        (ssize_t) group_child.size) {
+                        block_duration = gcs_ebml_read_uint(data,
+                            group_child.size);
+                    }
+                }
+
+                if(group_child.size == GCS_MKV_UNKNOWN_SIZE) {
+                    break;
+                }
+
+                group_offset = group_child.offset + group_child.size;
+            }
+        }
+
+        if(block_offset) {
+            /* block header: track number (vint), followed by a signed
+            16-bit timecode relative to the cluster */
+            uint8_t data[10];
+            ssize_t got = pread(fd, data, sizeof(data), (off_t) block_offset);
+
+            uint64_t track = 0;
+            int track_len = gcs_ebml_read_vint(data, (int) got, 0, &track);
+
+            if(track_len > 0 && got >= track_len + 2) {
+                int16_t relative = (int16_t) ((data[track_len] << 8) |
+                    data[track_len + 1]);
+
+                int64_t block_timecode = (int64_t) cluster_timecode + relative;
+                if(block_timecode >= 0 &&
+                    (uint64_t) block_timecode + block_duration > last_block_end) {
+                    last_block_end = (uint64_t) block_timecode + block_duration;
+                }
+            }
+        }
+
+        if(child.size == GCS_MKV_UNKNOWN_SIZE) {
+            break;
+        }
+
+        offset = child.offset + child.size;
+    }
+
+    return last_block_end;
+}
+
+static uint64_t
+find_cluster_end(int fd, MkvElement *cluster, uint64_t end)
+{
+    /* a cluster written with an unknown size ends where the next
+    top level element starts, only the headers of its children are
+    read to get there, not the blocks themselves */
+    uint64_t offset = cluster->offset;
+    MkvElement child;
+
+    while(read_element(fd, offset, end, &child)) {
+        if(gcs_ebml_is_level1_id(child.id) ||
+            child.size == GCS_MKV_UNKNOWN_SIZE) {
+            return offset;
+        }
+
+        offset = child.offset + child.size;
+    }
+
+    return end;
+}
+
+static int
+native_get_duration(const char *filename, uint64_t *duration_out)
+{
+    /* 1 with the duration, 0 for a file that has none (empty, or
+    cut off before the first block), -1 for anything we can't read */
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+
+    int result = 0;
+
+    struct stat file_info;
+    if(fstat(fd, &file_info) != 0) {
+        goto cleanup;
+    }
+
+    uint64_t file_end = (uint64_t) file_info.st_size;
+
+    /* the file must start with an EBML header, skip over it, a file
+    that doesn't is something other than matroska, a file that's
+    too short for one was cut off (or never written to) */
+    MkvElement element;
+    if(!read_element(fd, 0, file_end, &element)) {
+        goto cleanup;
+    }
+
+    if(element.id != GCS_MKV_ID_EBML || element.size == GCS_MKV_UNKNOWN_SIZE) {
+        result = -1;
+        goto cleanup;
+    }
+
+    /* from here on, anything missing means the file was cut off */
+    MkvElement segment;
+    if(!read_element(fd, element.offset + element.size, file_end, &segment)) {
+        goto cleanup;
+    }
+
+    if(segment.id != GCS_MKV_ID_SEGMENT) {
+        result = -1;
+        goto cleanup;
+    }
+
+    uint64_t segment_end = element_end(&segment, file_end);
+    uint64_t timecode_scale = GCS_MKV_DEFAULT_TIMECODE_SCALE;
+    double duration = 0.0;
+    int have_info = 0;
+
+    /* cleared when the walk stopped before the end of the segment,
+    the last cluster we found might not be the last one then */
+    int complete = 1;
+
+    /* walk the top level elements of the segment, the info element
+    comes before the first cluster in everything matroskamux writes */
+    uint64_t last_cluster_offset = 0;
+    uint64_t offset = segment.offset;
+
+    while(read_element(fd, offset, segment_end, &element)) {
+        if(element.id == GCS_MKV_ID_INFO) {
+            have_info = parse_info(fd, &element, &timecode_scale, &duration);
+
+            /* the common case, we're done */
+            if(have_info && duration > 0.0) {
+                break;
+            }
+        } else if(element.id == GCS_MKV_ID_CLUSTER) {
+            last_cluster_offset = offset;
+        }
+
+        if(element.size != GCS_MKV_UNKNOWN_SIZE) {
+            offset = element.offset + element.size;
+            continue;
+        }
+
+        /* a cluster of unknown size (a live muxer writes all of
+        them like that), walk its children to find the next one,
+        stopping here would take the first cluster for the last */
+        if(element.id != GCS_MKV_ID_CLUSTER) {
+            complete = 0;
+            break;
+        }
+
+        uint64_t cluster_end = find_cluster_end(fd, &element, segment_end);
+        if(cluster_end <= offset) {
+            complete = 0;
+            break;
+        }
+
+        offset = cluster_end;
+    }
+
+    if(have_info && duration > 0.0) {
+        *duration_out = (uint64_t) (duration * (double) timecode_scale);
+        result = 1;
+        goto cleanup;
+    }
+
+    /* an element of unknown size we can't walk past, what comes
+    after it might have blocks in it */
+    if(!complete) {
+        result = -1;
+        goto cleanup;
+    }
+
+    /* no duration, the muxer probably never finalized the file, take
+    the end of the last block in the last cluster we found, without
+    one, nothing was recorded */
+    if(last_cluster_offset &&
+        read_element(fd, last_cluster_offset, segment_end, &element)) {
+        uint64_t last_block_end = scan_cluster(fd, &element, segment_end);
+
+        if(last_block_end > 0) {
+            *duration_out = last_block_end * timecode_scale;
+            result = 1;
+        }
+    }
+
+cleanup:
+    close(fd);
+    return result;
+}
+
+static int
+native_get_keyframes(const char *filename, GArray *keyframes)
+{
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+
+    int result = 0;
+
+    struct stat file_info;
+    if(fstat(fd, &file_info) != 0) {
+        goto cleanup;
+    }
+
+    uint64_t file_end = (uint64_t) file_info.st_size;
+
+    MkvElement element;
+    if(!read_element(fd, 0, file_end, &element) ||
+        element.id != GCS_MKV_ID_EBML || element.size == GCS_MKV_UNKNOWN_SIZE) {
+        goto cleanup;
+    }
+
+    MkvElement segment;
+    if(!read_element(fd, element.offset + element.size, file_end, &segment) ||
+        segment.id != GCS_MKV_ID_SEGMENT) {
+        goto cleanup;
+    }
+
+    uint64_t segment_end = element_end(&segment, file_end);
+    uint64_t timecode_scale = GCS_MKV_DEFAULT_TIMECODE_SCALE;
+    double duration = 0.0;
+
+    /* matroskamux writes the cues at the end, the seek head at the
+    start of the file tells us where, so we don't have to walk over
+    all the clusters to get there */
+    uint64_t cues_position = 0;
+    uint64_t offset = segment.offset;
+
+    while(read_element(fd, offset, segment_end, &element)) {
+        if(element.id == GCS_MKV_ID_SEEK_HEAD && !cues_position) {
+            cues_position = parse_seek_head(fd, &element);
+        } else if(element.id == GCS_MKV_ID_INFO) {
+            parse_info(fd, &element, &timecode_scale, &duration);
+        } else if(element.id == GCS_MKV_ID_CUES) {
+            result = parse_cues(fd, &element, segment.offset, timecode_scale,
+                keyframes);
+            break;
+        } else if(element.id == GCS_MKV_ID_CLUSTER && cues_position &&
+            segment.offset + cues_position > offset) {
+            /* the info comes before the clusters, so we have
+            everything we need, jump to the cues */
+            offset = segment.offset + cues_position;
+            continue;
+        }
+
+        if(element.size == GCS_MKV_UNKNOWN_SIZE) {
+            break;
+        }
+
+        offset = element.offset + element.size;
+    }
+
+cleanup:
+    close(fd);
+    return result;
+}
+
+int
+gcs_meta_get_mkv_keyframes(const char *filename, GArray *keyframes)
+{
+    if(!filename || !keyframes) {
+        return 0;
+    }
+
+    return native_get_keyframes(filename, keyframes);
+}
+
 uint64_t
-gcs_meta_get_mkv_duration(const char *filename)
+gcs_meta_get_mkv_duration_discoverer(const char *filename)
 {
     uint64_t duration = 0;
-    GstDiscoverer *magic;
-    GstDiscovererInfo *info;
+    GstDiscoverer *magic = NULL;
+    GstDiscovererInfo *info = NULL;
 
     if(!filename) {
         goto cleanup;
@@ -43,3 +606,28 @@ cleanup:
 
     return duration;
 }
+
+uint64_t
+gcs_meta_get_mkv_duration(const char *filename)
+{
+    if(!filename) {
+        return 0;
+    }
+
+    /* empty and cut off files have no duration, they're skipped,
+    the discoverer wouldn't find one either, it would just take
+    longer to say so */
+    uint64_t duration = 0;
+    int result = native_get_duration(filename, &duration);
+    if(result >= 0) {
+        return duration;
+    }
+
+    /* matroska the native reader doesn't understand, a duration
+    that's too short would leave a hole in the index, a slow probe
+    is the lesser evil */
+    printf("[wrn] could not read the duration of '%s', using the "
+        "discoverer\n", filename);
+
+    return gcs_meta_get_mkv_duration_discoverer(filename);
+}
@@ -3,6 +3,30 @@
 
 #include <stdint.h>
 
+#include <glib.h>
+
+/* a point in a chunk that playback can start from */
+typedef struct {
+    /* nanoseconds since the start of the chunk */
+    uint64_t time;
+
+    /* byte offset of the cluster that starts with the keyframe */
+    uint64_t offset;
+} GcsMetaKeyframe;
+
+/* reads the duration with the native matroska reader, 0 for files
+that are empty or were cut off before anything was recorded, falls
+back to the discoverer for matroska it can't make sense of */
 uint64_t gcs_meta_get_mkv_duration(const char *filename);
 
+/* appends the keyframes listed in the cues of the file to the
+array (of GcsMetaKeyframe), from first to last, returns 0 when the
+file has no cues (for example, when it was never finished) */
+int      gcs_meta_get_mkv_keyframes(const char *filename, GArray *keyframes);
+
+/* the old, GstDiscoverer based, implementation, a lot slower but
+understands anything GStreamer does, kept around for comparison
+and for the files the native reader gives up on */
+uint64_t gcs_meta_get_mkv_duration_discoverer(const char *filename);
+
 #endif /* __gst_chunks_shared_meta_h */
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <gcs/mem.h>
+#include <gcs/metrics.h>
+
+/* metrics are only ever added to, under the lock, recording
+and writing them doesn't take it */
+static GMutex metrics_lock;
+static GcsMetric *metrics[GCS_METRICS_MAX_COUNT];
+static gint metric_count;
+
+static GcsMetric *
+metrics_find(const char *name)
+{
+    int count = g_atomic_int_get(&metric_count);
+
+    int i;
+    for(i = 0; i < count; ++i) {
+        if(strcmp(metrics[i]->name, name) == 0) {
+            return metrics[i];
+        }
+    }
+
+    return NULL;
+}
+
+static GcsMetric *
+metrics_add(const char *name, const char *help, GcsMetricType type)
+{
+    GcsMetric *metric = metrics_find(name);
+    if(metric) {
+        return metric;
+    }
+
+    if(metric_count >= GCS_METRICS_MAX_COUNT) {
+        fprintf(stderr, "[err] too many metrics, not recording %s\n", name);
+        return NULL;
+    }
+
+    metric = ALLOC_NULL(GcsMetric *, sizeof(GcsMetric));
+    metric->name = name;
+    metric->help = help;
+    metric->type = type;
+    metric->scale = 1.0;
+
+    /* the count is read without the lock, it goes up only
+    after the metric is there */
+    metrics[metric_count] = metric;
+    g_atomic_int_inc(&metric_count);
+
+    return metric;
+}
+
+GcsMetric *
+gcs_metrics_counter(const char *name, const char *help)
+{
+    g_mutex_lock(&metrics_lock);
+    GcsMetric *metric = metrics_add(name, help, GCS_METRIC_TYPE_COUNTER);
+    g_mutex_unlock(&metrics_lock);
+
+    return metric;
+}
+
+GcsMetric *
+gcs_metrics_histogram(const char *name, const char *help, uint64_t start,
+    int factor, int bucket_count, double scale)
+{
+    g_mutex_lock(&metrics_lock);
+
+    /* a second caller gets the histogram the first one made */
+    GcsMetric *metric = metrics_find(name);
+    if(!metric) {
+        metric = metrics_add(name, help, GCS_METRIC_TYPE_HISTOGRAM);
+
+        if(metric) {
+            metric->bound_count = CLAMP(bucket_count, 1,
+                GCS_METRICS_MAX_BUCKETS);
+            metric->scale = scale;
+
+            uint64_t bound = start;
+
+            int i;
+            for(i = 0; i < metric->bound_count; ++i) {
+                metric->bounds[i] = bound;
+                bound *= (uint64_t) factor;
+            }
+        }
+    }
+
+    g_mutex_unlock(&metrics_lock);
+    return metric;
+}
+
+void
+gcs_metrics_add(GcsMetric *metric, uint64_t value)
+{
+    if(!metric) {
+        return;
+    }
+
+    /* glib has no 64 bit atomic add, the builtin is what
+    g_atomic_int_add comes down to anyway */
+    __atomic_fetch_add(&metric->sum, value, __ATOMIC_RELAXED);
+}
+
+void
+gcs_metrics_observe(GcsMetric *metric, uint64_t value)
+{
+    if(!metric) {
+        return;
+    }
+
+    /* a handful of bounds, a scan is as fast as anything else */
+    int bucket = 0;
+    while(bucket < metric->bound_count && value > metric->bounds[bucket]) {
+        ++bucket;
+    }
+
+    __atomic_fetch_add(&metric->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->sum, value, __ATOMIC_RELAXED);
+}
+
+static void
+metrics_write_value(GString *out, double value)
+{
+    /* the C locale's dot, whatever the locale is */
+    char text[G_ASCII_DTOSTR_BUF_SIZE];
+    g_string_append(out, g_ascii_dtostr(text, sizeof(text), value));
+}
+
+static void
+metrics_write_histogram(GString *out, GcsMetric *metric)
+{
+    /* the buckets are written while they're being added to, a
+    value can show up in its bucket before it's in the sum, the
+    count is taken from the buckets, so those at least agree */
+    guint64 count = 0;
+
+    int i;
+    for(i = 0; i <= metric->bound_count; ++i) {
+        count += __atomic_load_n(&metric->buckets[i], __ATOMIC_RELAXED);
+
+        g_string_append_printf(out, "%s_bucket{le=\"", metric->name);
+
+        if(i < metric->bound_count) {
+            metrics_write_value(out, metric->bounds[i] * metric->scale);
+        } else {
+            g_string_append(out, "+Inf");
+        }
+
+        g_string_append_printf(out, "\"} %" G_GUINT64_FORMAT "\n", count);
+    }
+
+    g_string_append_printf(out, "%s_sum ", metric->name);
+    metrics_write_value(out,
+        __atomic_load_n(&metric->sum, __ATOMIC_RELAXED) * metric->scale);
+
+    g_string_append_printf(out, "\n%s_count %" G_GUINT64_FORMAT "\n",
+        metric->name, count);
+}
+
+void
+gcs_metrics_write(GString *out)
+{
+    int count = g_atomic_int_get(&metric_count);
+
+    int i;
+    for(i = 0; i < count; ++i) {
+        GcsMetric *metric = metrics[i];
+
+        int is_counter = metric->type == GCS_METRIC_TYPE_COUNTER;
+
+        g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n",
+            metric->name, metric->help, metric->name,
+            is_counter ? "counter" : "histogram");
+
+        if(is_counter) {
+            g_string_append_printf(out, "%s %" G_GUINT64_FORMAT "\n",
+                metric->name, __atomic_load_n(&metric->sum,
+                __ATOMIC_RELAXED));
+        } else {
+            metrics_write_histogram(out, metric);
+        }
+    }
+}
+
+static gboolean
+on_metrics_request(GThreadedSocketService *service,
+    GSocketConnection *connection, GObject *source_object,
+    gpointer user_data)
+{
+    /* runs on a thread of the service's own, so a slow client
+    doesn't hold up the main loop, the request is read but not
+    looked at, every path has the metrics */
+    GInputStream *input = g_io_stream_get_input_stream(
+        G_IO_STREAM(connection));
+    GOutputStream *output = g_io_stream_get_output_stream(
+        G_IO_STREAM(connection));
+
+    char request[4096];
+    if(g_input_stream_read(input, request, sizeof(request), NULL,
+        NULL) <= 0) {
+        return TRUE;
+    }
+
+    GString *body = g_string_new(NULL);
+    gcs_metrics_write(body);
+
+    GString *response = g_string_new(NULL);
+    g_string_append_printf(response, "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+        "Connection: close\r\n\r\n", body->len);
+    g_string_append_len(response, body->str, body->len);
+
+    g_output_stream_write_all(output, response->str, response->len, NULL,
+        NULL, NULL);
+
+    g_string_free(response, TRUE);
+    g_string_free(body, TRUE);
+
+    return TRUE;
+}
+
+int
+gcs_metrics_serve(int port)
+{
+    GSocketService *service = g_threaded_socket_service_new(2);
+
+    /* only for whatever scrapes it on this machine, there's no
+    authentication of any kind */
+    GInetAddress *loopback = g_inet_address_new_loopback(
+        G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new(loopback,
+        (guint16) port);
+
+    GError *error = NULL;
+    int added = g_socket_listener_add_address(G_SOCKET_LISTENER(service),
+        address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, NULL,
+        &error);
+
+    g_object_unref(address);
+    g_object_unref(loopback);
+
+    if(!added) {
+        fprintf(stderr, "[err] could not serve metrics on port %i: %s\n",
+            port, error ? error->message : "unknown error");
+        g_clear_error(&error);
+        g_object_unref(service);
+        return 0;
+    }
+
+    g_signal_connect(service, "run", G_CALLBACK(on_metrics_request), NULL);
+    g_socket_service_start(service);
+
+    printf("[inf] serving metrics on http://127.0.0.1:%i/metrics\n", port);
+    return 1;
+}
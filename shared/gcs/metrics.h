@@ -0,0 +1,58 @@
+#ifndef __gst_chunks_shared_metrics_h
+#define __gst_chunks_shared_metrics_h
+
+#include <stdint.h>
+
+#include <glib.h>
+
+/* most buckets a histogram can have, and metrics a process can have */
+#define GCS_METRICS_MAX_BUCKETS 20
+#define GCS_METRICS_MAX_COUNT 32
+
+typedef enum {
+    GCS_METRIC_TYPE_COUNTER = 0,
+    GCS_METRIC_TYPE_HISTOGRAM = 1
+} GcsMetricType;
+
+/* a counter or histogram, in the sense prometheus has them, shared
+by everything in the process that records the same thing (every
+player, for example), recording only takes atomic adds, no lock,
+so it can be done from any streaming thread */
+typedef struct {
+    const char *name;
+    const char *help;
+    GcsMetricType type;
+
+    /* upper bounds of the buckets, in the unit values are recorded
+    in, exported multiplied by the scale (to get to seconds, say) */
+    uint64_t bounds[GCS_METRICS_MAX_BUCKETS];
+    int bound_count;
+    double scale;
+
+    /* values per bucket, not cumulative, the one after the
+    last bound is for everything above it */
+    guint64 buckets[GCS_METRICS_MAX_BUCKETS + 1];
+    guint64 sum;
+} GcsMetric;
+
+/* returns the metric with the name, made the first time it's asked
+for, metrics are never freed, the name and help have to outlive
+the process (string literals) */
+GcsMetric * gcs_metrics_counter(const char *name, const char *help);
+
+/* buckets grow exponentially, the first one ends at `start`, every
+next one is `factor` times as large */
+GcsMetric * gcs_metrics_histogram(const char *name, const char *help,
+                uint64_t start, int factor, int bucket_count, double scale);
+
+void        gcs_metrics_add(GcsMetric *metric, uint64_t value);
+void        gcs_metrics_observe(GcsMetric *metric, uint64_t value);
+
+/* appends every metric in the prometheus text format */
+void        gcs_metrics_write(GString *out);
+
+/* answers every request on the port with the text, only on the
+loopback interface, runs from the default main context */
+int         gcs_metrics_serve(int port);
+
+#endif /* __gst_chunks_shared_metrics_h */
@@ -0,0 +1,538 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gcs/mkv.h>
+#include <gcs/ebml.h>
+#include <gcs/mem.h>
+
+/* 4 bytes for the id and 8 for the size is the maximum */
+#define MKV_MAX_HEADER_SIZE 12
+
+/* info and tracks are tiny, refuse to read huge ones as that
+means the file is corrupt */
+#define MKV_MAX_INFO_SIZE 4096
+#define MKV_MAX_TRACKS_SIZE (64 * 1024)
+
+/* flags of a (simple) block */
+#define MKV_BLOCK_FLAG_KEYFRAME 0x80
+#define MKV_BLOCK_FLAG_LACING   0x06
+
+typedef struct {
+    uint64_t id;
+    uint64_t size;
+    uint64_t offset;        /* offset of the element's data */
+} MkvElement;
+
+static GcsMkvBlock *
+gcs_mkv_block_new(size_t size)
+{
+    uint8_t *data = malloc(size);
+    if(!data) {
+        return NULL;
+    }
+
+    GcsMkvBlock *block = ALLOC_NULL(GcsMkvBlock *, sizeof(GcsMkvBlock));
+    block->ref_count = 1;
+    block->data = data;
+    block->size = size;
+
+    return block;
+}
+
+static const uint8_t *
+fill(GcsMkvReader *reader, uint64_t offset, uint64_t len)
+{
+    GcsMkvBlock *block = reader->block;
+
+    /* most of the time, it's in what we read already */
+    if(offset >= reader->buffer_offset &&
+        offset + len <= reader->buffer_offset + reader->buffer_len) {
+        return block->data + (offset - reader->buffer_offset);
+    }
+
+    if(offset >= reader->file_end || len > reader->file_end - offset) {
+        return NULL;
+    }
+
+    /* frames in the block are still being used (they were wrapped in
+    buffers that are queued somewhere), or a frame doesn't fit in it
+    (doesn't happen with the recorder's chunks, but isn't wrong either),
+    read into a new one, the old one goes when its last frame does */
+    if(g_atomic_int_get(&block->ref_count) > 1 || len > block->size) {
+        block = gcs_mkv_block_new(MAX((size_t) len, GCS_MKV_READ_SIZE));
+        if(!block) {
+            return NULL;
+        }
+    }
+
+    /* keep the part of the range that we have, reading is sequential,
+    so that's the tail of the window, and read as much as fits after it */
+    size_t kept = 0;
+    if(offset >= reader->buffer_offset &&
+        offset < reader->buffer_offset + reader->buffer_len) {
+        kept = (size_t) (reader->buffer_offset + reader->buffer_len - offset);
+        memmove(block->data,
+            reader->block->data + (offset - reader->buffer_offset), kept);
+    }
+
+    if(block != reader->block) {
+        gcs_mkv_block_unref(reader->block);
+        reader->block = block;
+    }
+
+    reader->buffer_offset = offset;
+    reader->buffer_len = kept;
+
+    while(reader->buffer_len < len) {
+        ssize_t got = pread(reader->fd, block->data + reader->buffer_len,
+            block->size - reader->buffer_len,
+            (off_t) (offset + reader->buffer_len));
+
+        if(got <= 0) {
+            return NULL;
+        }
+
+        reader->buffer_len += (size_t) got;
+        reader->bytes_read += (uint64_t) got;
+    }
+
+    return block->data;
+}
+
+static int
+read_element(GcsMkvReader *reader, uint64_t offset, uint64_t end,
+    MkvElement *element)
+{
+    if(offset >= end) {
+        return 0;
+    }
+
+    uint64_t wanted = MKV_MAX_HEADER_SIZE;
+    if(end - offset < wanted) {
+        wanted = end - offset;
+    }
+
+    const uint8_t *header = fill(reader, offset, wanted);
+    if(!header) {
+        return 0;
+    }
+
+    int id_len = gcs_ebml_read_vint(header, (int) wanted, 1, &element->id);
+    if(id_len <= 0 || id_len > 4) {
+        return 0;
+    }
+
+    int size_len = gcs_ebml_read_vint(header + id_len, (int) wanted - id_len,
+        0, &element->size);
+
+    if(size_len <= 0) {
+        return 0;
+    }
+
+    element->offset = offset + id_len + size_len;
+    return 1;
+}
+
+static uint64_t
+element_end(MkvElement *element, uint64_t end)
+{
+    /* unknown sizes and sizes beyond the end of the file (truncated)
+    are clamped to whatever is left */
+    if(element->size == GCS_MKV_UNKNOWN_SIZE ||
+        element->size > end - element->offset) {
+        return end;
+    }
+
+    return element->offset + element->size;
+}
+
+static int
+parse_info(GcsMkvReader *reader, MkvElement *info)
+{
+    if(info->size == GCS_MKV_UNKNOWN_SIZE || info->size > MKV_MAX_INFO_SIZE) {
+        return 0;
+    }
+
+    const uint8_t *data = fill(reader, info->offset, info->size);
+    if(!data) {
+        return 0;
+    }
+
+    int position = 0;
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *value;
+
+    while((value = gcs_ebml_read_child(data, (int) info->size, &position,
+        &id, &size)) != NULL) {
+        if(id == GCS_MKV_ID_TIMECODE_SCALE) {
+            reader->timecode_scale = gcs_ebml_read_uint(value, size);
+        }
+    }
+
+    return reader->timecode_scale > 0;
+}
+
+static void
+parse_video(GcsMkvReader *reader, const uint8_t *data, uint64_t len)
+{
+    int position = 0;
+
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *value;
+
+    while((value = gcs_ebml_read_child(data, (int) len, &position, &id,
+        &size)) != NULL) {
+        if(id == GCS_MKV_ID_PIXEL_WIDTH) {
+            reader->width = (int) gcs_ebml_read_uint(value, size);
+        } else if(id == GCS_MKV_ID_PIXEL_HEIGHT) {
+            reader->height = (int) gcs_ebml_read_uint(value, size);
+        }
+    }
+}
+
+static int
+parse_tracks(GcsMkvReader *reader, MkvElement *tracks)
+{
+    if(tracks->size == GCS_MKV_UNKNOWN_SIZE ||
+        tracks->size > MKV_MAX_TRACKS_SIZE) {
+        return 0;
+    }
+
+    const uint8_t *data = fill(reader, tracks->offset, tracks->size);
+    if(!data) {
+        return 0;
+    }
+
+    int track_count = 0;
+    int position = 0;
+
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *entry;
+
+    while((entry = gcs_ebml_read_child(data, (int) tracks->size, &position,
+        &id, &size)) != NULL) {
+        if(id != GCS_MKV_ID_TRACK_ENTRY) {
+            continue;
+        }
+
+        /* the recorder writes a single video track, more than
+        that is something we don't know how to read */
+        if(++track_count > 1) {
+            return 0;
+        }
+
+        uint64_t track_type = 0;
+        int is_h264 = 0;
+
+        int entry_len = (int) size;
+        int entry_position = 0;
+        const uint8_t *value;
+
+        while((value = gcs_ebml_read_child(entry, entry_len, &entry_position,
+            &id, &size)) != NULL) {
+            if(id == GCS_MKV_ID_TRACK_NUMBER) {
+                reader->track_number = gcs_ebml_read_uint(value, size);
+            } else if(id == GCS_MKV_ID_TRACK_TYPE) {
+                track_type = gcs_ebml_read_uint(value, size);
+            } else if(id == GCS_MKV_ID_CODEC_ID) {
+                is_h264 = size == strlen(GCS_MKV_CODEC_H264) &&
+                    memcmp(value, GCS_MKV_CODEC_H264, (size_t) size) == 0;
+            } else if(id == GCS_MKV_ID_CODEC_PRIVATE && size > 0) {
+                /* the buffer is re-used, keep our own copy */
+                free(reader->codec_private);
+
+                reader->codec_private = ALLOC_NULL(uint8_t *, size);
+                reader->codec_private_size = (size_t) size;
+                memcpy(reader->codec_private, value, (size_t) size);
+            } else if(id == GCS_MKV_ID_VIDEO) {
+                parse_video(reader, value, size);
+            }
+        }
+
+        if(track_type != GCS_MKV_TRACK_TYPE_VIDEO || !is_h264) {
+            return 0;
+        }
+    }
+
+    return track_count == 1 && reader->track_number &&
+        reader->codec_private;
+}
+
+static int
+parse_block(GcsMkvReader *reader, const uint8_t *data, uint64_t size,
+    int keyframe, GcsMkvFrame *frame)
+{
+    /* block header: track number (vint), followed by a signed
+    16-bit timecode relative to the cluster and the flags */
+    uint64_t track = 0;
+    int track_len = gcs_ebml_read_vint(data, (int) (size < 8 ? size : 8), 0,
+        &track);
+
+    if(track_len <= 0 || size < (uint64_t) track_len + 3 ||
+        track != reader->track_number) {
+        return -1;
+    }
+
+    int16_t relative = (int16_t) ((data[track_len] << 8) |
+        data[track_len + 1]);
+
+    /* matroskamux never laces video */
+    uint8_t flags = data[track_len + 2];
+    if(flags & MKV_BLOCK_FLAG_LACING) {
+        return -1;
+    }
+
+    /* simple blocks say it in their flags, blocks in a group are
+    keyframes unless they reference another block */
+    if(keyframe < 0) {
+        keyframe = (flags & MKV_BLOCK_FLAG_KEYFRAME) != 0;
+    }
+
+    int64_t timecode = (int64_t) reader->cluster_timecode + relative;
+    if(timecode < 0) {
+        timecode = 0;
+    }
+
+    frame->time = (uint64_t) timecode * reader->timecode_scale;
+    frame->keyframe = keyframe;
+    frame->data = data + track_len + 3;
+    frame->size = (size_t) (size - track_len - 3);
+    frame->block = reader->block;
+
+    return 1;
+}
+
+static int
+parse_block_group(GcsMkvReader *reader, MkvElement *group,
+    GcsMkvFrame *frame)
+{
+    const uint8_t *data = fill(reader, group->offset, group->size);
+    if(!data) {
+        return 0;
+    }
+
+    const uint8_t *block = NULL;
+    uint64_t block_size = 0;
+    int keyframe = 1;
+
+    int position = 0;
+    uint64_t id;
+    uint64_t size;
+    const uint8_t *value;
+
+    while((value = gcs_ebml_read_child(data, (int) group->size, &position,
+        &id, &size)) != NULL) {
+        if(id == GCS_MKV_ID_BLOCK) {
+            block = value;
+            block_size = size;
+        } else if(id == GCS_MKV_ID_REFERENCE_BLOCK) {
+            keyframe = 0;
+        }
+    }
+
+    if(!block) {
+        return -1;
+    }
+
+    return parse_block(reader, block, block_size, keyframe, frame);
+}
+
+GcsMkvReader *
+gcs_mkv_reader_open(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+
+    GcsMkvReader *reader = ALLOC_NULL(GcsMkvReader *, sizeof(GcsMkvReader));
+    reader->fd = fd;
+    reader->timecode_scale = GCS_MKV_DEFAULT_TIMECODE_SCALE;
+    reader->block = gcs_mkv_block_new(GCS_MKV_READ_SIZE);
+
+    if(!reader->block) {
+        close(fd);
+        free(reader);
+        return NULL;
+    }
+
+    struct stat file_info;
+    if(fstat(fd, &file_info) != 0) {
+        goto error;
+    }
+
+    reader->file_end = (uint64_t) file_info.st_size;
+
+    /* the whole file is read front to back */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    MkvElement element;
+    if(!read_element(reader, 0, reader->file_end, &element) ||
+        element.id != GCS_MKV_ID_EBML ||
+        element.size == GCS_MKV_UNKNOWN_SIZE) {
+        goto error;
+    }
+
+    MkvElement segment;
+    if(!read_element(reader, element.offset + element.size,
+        reader->file_end, &segment) || segment.id != GCS_MKV_ID_SEGMENT) {
+        goto error;
+    }
+
+    reader->segment_offset = segment.offset;
+    reader->segment_end = element_end(&segment, reader->file_end);
+
+    /* everything we need comes before the first cluster */
+    uint64_t offset = segment.offset;
+    while(read_element(reader, offset, reader->segment_end, &element)) {
+        if(element.id == GCS_MKV_ID_CLUSTER) {
+            reader->offset = offset;
+            break;
+        }
+
+        if(element.id == GCS_MKV_ID_INFO) {
+            if(!parse_info(reader, &element)) {
+                goto error;
+            }
+        } else if(element.id == GCS_MKV_ID_TRACKS) {
+            if(!parse_tracks(reader, &element)) {
+                goto error;
+            }
+        }
+
+        if(element.size == GCS_MKV_UNKNOWN_SIZE) {
+            goto error;
+        }
+
+        offset = element.offset + element.size;
+    }
+
+    if(!reader->offset || !reader->track_number) {
+        goto error;
+    }
+
+    return reader;
+
+error:
+    gcs_mkv_reader_close(reader);
+    return NULL;
+}
+
+int
+gcs_mkv_reader_next(GcsMkvReader *reader, GcsMkvFrame *frame)
+{
+    MkvElement element;
+
+    while(1) {
+        if(!reader->in_cluster) {
+            /* skip over anything in between clusters, the cues
+            at the end for example */
+            if(!read_element(reader, reader->offset, reader->segment_end,
+                &element)) {
+                return 0;
+            }
+
+            if(element.id == GCS_MKV_ID_CLUSTER) {
+                reader->in_cluster = 1;
+                reader->cluster_end = element_end(&element,
+                    reader->segment_end);
+                reader->cluster_timecode = 0;
+                reader->offset = element.offset;
+                continue;
+            }
+
+            if(element.size == GCS_MKV_UNKNOWN_SIZE) {
+                return 0;
+            }
+
+            reader->offset = element.offset + element.size;
+            continue;
+        }
+
+        if(!read_element(reader, reader->offset, reader->cluster_end,
+            &element)) {
+            reader->in_cluster = 0;
+            reader->offset = reader->cluster_end;
+            continue;
+        }
+
+        /* clusters written with an unknown size end where the
+        next top level element starts */
+        if(gcs_ebml_is_level1_id(element.id)) {
+            reader->in_cluster = 0;
+            continue;
+        }
+
+        if(element.size == GCS_MKV_UNKNOWN_SIZE) {
+            return -1;
+        }
+
+        reader->offset = element.offset + element.size;
+
+        if(element.id == GCS_MKV_ID_CLUSTER_TIMECODE) {
+            const uint8_t *data = fill(reader, element.offset, element.size);
+            if(!data || element.size > 8) {
+                return 0;
+            }
+
+            reader->cluster_timecode = gcs_ebml_read_uint(data, element.size);
+
+        } else if(element.id == GCS_MKV_ID_SIMPLE_BLOCK) {
+            const uint8_t *data = fill(reader, element.offset, element.size);
+            if(!data) {
+                return 0;
+            }
+
+            return parse_block(reader, data, element.size, -1, frame);
+
+        } else if(element.id == GCS_MKV_ID_BLOCK_GROUP) {
+            return parse_block_group(reader, &element, frame);
+        }
+    }
+}
+
+void
+gcs_mkv_reader_seek(GcsMkvReader *reader, uint64_t offset)
+{
+    reader->in_cluster = 0;
+    reader->offset = offset;
+}
+
+void
+gcs_mkv_reader_close(GcsMkvReader *reader)
+{
+    if(!reader) {
+        return;
+    }
+
+    close(reader->fd);
+
+    gcs_mkv_block_unref(reader->block);
+    free(reader->codec_private);
+    free(reader);
+}
+
+GcsMkvBlock *
+gcs_mkv_block_ref(GcsMkvBlock *block)
+{
+    g_atomic_int_inc(&block->ref_count);
+    return block;
+}
+
+void
+gcs_mkv_block_unref(GcsMkvBlock *block)
+{
+    /* the last reference can be dropped by any thread, usually the
+    one of whatever element had the last frame in it */
+    if(block && g_atomic_int_dec_and_test(&block->ref_count)) {
+        free(block->data);
+        free(block);
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef __gst_chunks_shared_mkv_h
+#define __gst_chunks_shared_mkv_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <glib.h>
+
+/* the chunks are read with reads of this size, a couple of
+seconds of video, a block that doesn't fit grows the buffer */
+#define GCS_MKV_READ_SIZE (1024 * 1024)
+
+/* the only codec the recorder writes, and the only one we read */
+#define GCS_MKV_CODEC_H264 "V_MPEG4/ISO/AVC"
+
+/* what the reader reads into, frames point into it, a frame that
+has to outlive the next read keeps a reference to its block, the
+reader then reads into a new block instead of over the old one */
+typedef struct {
+    gint ref_count;
+    uint8_t *data;
+    size_t size;
+} GcsMkvBlock;
+
+typedef struct {
+    /* nanoseconds since the start of the chunk */
+    uint64_t time;
+    int keyframe;
+
+    /* points into the block, only valid until the next call to
+    the reader, unless a reference to the block is taken */
+    const uint8_t *data;
+    size_t size;
+    GcsMkvBlock *block;
+} GcsMkvFrame;
+
+/* reads the frames of a chunk, as written by the recorder, front to
+back, anything else (more than one track, another codec, laced
+blocks) is refused, so callers can fall back to matroskademux */
+typedef struct {
+    int fd;
+    uint64_t file_end;
+
+    uint64_t segment_offset;
+    uint64_t segment_end;
+    uint64_t timecode_scale;
+
+    uint64_t track_number;
+    uint8_t *codec_private;
+    size_t codec_private_size;
+
+    /* size of the video, 0 when the track doesn't say */
+    int width;
+    int height;
+
+    /* a window of the file, starting at buffer_offset */
+    GcsMkvBlock *block;
+    size_t buffer_len;
+    uint64_t buffer_offset;
+
+    /* the next element to read, and the cluster it's in, if any */
+    uint64_t offset;
+    uint64_t cluster_end;
+    uint64_t cluster_timecode;
+    int in_cluster;
+
+    /* read from the file so far */
+    uint64_t bytes_read;
+} GcsMkvReader;
+
+GcsMkvReader *  gcs_mkv_reader_open(const char *filename);
+
+/* returns 1 when a frame was read, 0 at the end of the chunk (or
+where it was cut off) and -1 when the chunk has something the
+reader does not support */
+int             gcs_mkv_reader_next(GcsMkvReader *reader, GcsMkvFrame *frame);
+
+/* continues at the cluster at the offset, which is what the
+keyframes from gcs_meta_get_mkv_keyframes point at */
+void            gcs_mkv_reader_seek(GcsMkvReader *reader, uint64_t offset);
+void            gcs_mkv_reader_close(GcsMkvReader *reader);
+
+GcsMkvBlock *   gcs_mkv_block_ref(GcsMkvBlock *block);
+void            gcs_mkv_block_unref(GcsMkvBlock *block);
+
+#endif /* __gst_chunks_shared_mkv_h */
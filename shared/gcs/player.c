@@ -1,85 +1,237 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 #include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
 
 #include <gcs/mem.h>
 #include <gcs/index.h>
 #include <gcs/player.h>
 #include <gcs/gst.h>
 
+/* shared by every player in the process, exported
+with gcs_metrics_write */
+typedef struct {
+    GcsMetric *switch_time;
+    GcsMetric *prepare_time;
+    GcsMetric *underruns;
+    GcsMetric *chunk_bytes;
+    GcsMetric *decode_time;
+    GcsMetric *gap_duration;
+} GcsPlayerMetrics;
+
+static GcsPlayerMetrics player_metrics;
+
+/* frames going into the decoder are tagged with a reference
+timestamp meta of these caps, holding the monotonic time (in
+microseconds) they went in, the decoder copies it to the frame it
+decodes them to, whatever order they come out in */
+static GstCaps *decode_meta_caps;
+
 /* prototype declarations */
 static int gcs_player_prepare_next_bin(GcsPlayer *player, int play);
-static int gcs_player_get_next_bin_index(GcsPlayer *player);
+static GQueue *gcs_player_get_spare_bins(GcsPlayer *player,
+    GcsPlayerBinType type);
+static void gcs_player_read_ahead(GcsPlayer *player);
+static void gcs_player_release_readahead(GcsPlayer *player,
+    const char *filename);
+static void gcs_player_bin_stop(GcsPlayer *player, GcsPlayerBin *player_bin);
 
-static gboolean
-on_switch_finish(gpointer user_data)
+static void
+gcs_player_init_metrics()
 {
-    GcsPlayer *player = GCS_PLAYER(user_data);
-    gcs_player_prepare_next_bin(player, TRUE);
+    static gsize initialized = 0;
+    if(!g_once_init_enter(&initialized)) {
+        return;
+    }
 
-    return FALSE;
+    /* times are recorded in microseconds, exported in seconds */
+    player_metrics.switch_time = gcs_metrics_histogram(
+        "gcs_player_switch_seconds", "Time from concat switching to a "
+        "chunk until the first frame of the chunk left concat",
+        1000, 2, 15, 0.000001);
+
+    player_metrics.prepare_time = gcs_metrics_histogram(
+        "gcs_player_prepare_seconds", "Time it took to stop a bin and "
+        "start it on the next chunk", 100, 2, 16, 0.000001);
+
+    player_metrics.underruns = gcs_metrics_counter(
+        "gcs_player_multiqueue_underruns_total",
+        "Times the multiqueue at the end of a player ran empty");
+
+    player_metrics.chunk_bytes = gcs_metrics_histogram(
+        "gcs_player_chunk_read_bytes", "Bytes read from the file of "
+        "a chunk", 65536, 2, 14, 1.0);
+
+    player_metrics.decode_time = gcs_metrics_histogram(
+        "gcs_player_decode_seconds", "Time from a frame going into "
+        "the decoder until it came out", 100, 2, 14, 0.000001);
+
+    /* recorded in nanoseconds, from a second to a couple of days */
+    player_metrics.gap_duration = gcs_metrics_histogram(
+        "gcs_player_gap_seconds", "Duration of the gaps that were filled "
+        "with a black frame", 1000000000, 4, 10, 0.000000001);
+
+    decode_meta_caps = gst_caps_new_empty_simple("timestamp/x-gcs-decode");
+
+    g_once_init_leave(&initialized, 1);
 }
 
 static void
-on_switch(GstElement *element, GstPad *old_pad, GstPad *new_pad,
+gcs_player_invoke(GMainContext *context, GSourceFunc function,
     gpointer user_data)
 {
-    /* perform switching of bins on the application thread
-    and not on the streaming thread, which is where signals
-    are emitted on. g_idle_add will execute the specified function
-    from the main thread */
+    /* runs the function once on the player's worker thread */
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, function, user_data, NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
+static gpointer
+gcs_player_worker(gpointer user_data)
+{
+    GcsPlayer *player = GCS_PLAYER(user_data);
 
-    g_idle_add(on_switch_finish, user_data);
+    g_main_context_push_thread_default(player->context);
+    g_main_loop_run(player->loop);
+    g_main_context_pop_thread_default(player->context);
+
+    return NULL;
 }
 
 static void
-gcs_player_bin_change_elements(GcsPlayerBin *player_bin, const char *source_name,
-    const char *demuxer_name)
+gcs_player_release_bin(GcsPlayer *player, GcsPlayerBin *player_bin)
+{
+    /* put it back with the others of its type so it can be used
+    for a later chunk */
+    gcs_player_bin_stop(player, player_bin);
+    g_queue_push_tail(gcs_player_get_spare_bins(player, player_bin->type),
+        player_bin);
+}
+
+static gboolean
+on_switch_finish(gpointer user_data)
+{
+    GcsPlayer *player = GCS_PLAYER(user_data);
+    gint64 start_time = g_get_monotonic_time();
+
+    g_mutex_lock(&player->lock);
+
+    /* the bin that was playing is done, unless we seeked since
+    the switch, in which case all bins were replaced already */
+    GcsPlayerBin *player_bin = g_queue_peek_head(player->active_bins);
+    if(!player_bin || !g_atomic_int_get(&player_bin->finished)) {
+        g_mutex_unlock(&player->lock);
+        return FALSE;
+    }
+
+    g_queue_pop_head(player->active_bins);
+    gcs_player_release_bin(player, player_bin);
+
+    gcs_player_prepare_next_bin(player, TRUE);
+    gcs_player_read_ahead(player);
+
+    gint64 time = g_get_monotonic_time() - start_time;
+    gcs_metrics_observe(player_metrics.prepare_time, (uint64_t) time);
+
+    player->stats.prepare_time += time;
+    player->stats.max_prepare_time = MAX(player->stats.max_prepare_time, time);
+    player->stats.prepared++;
+
+    g_mutex_unlock(&player->lock);
+
+    /* let the application know, without it having to wait for it */
+    gst_element_post_message(player->pipeline, gst_message_new_element(
+        GST_OBJECT(player->concat), gst_structure_new("gcs-prepared",
+        "prepare-time", G_TYPE_INT64, time, NULL)));
+
+    return FALSE;
+}
+
+static GcsPlayerBin *
+gcs_player_find_bin(GcsPlayer *player, GstPad *concat_sink_pad)
 {
-    /* create the new elements that we're going to inject
-    into the pipeline */
-    GstElement *new_source = gst_element_factory_make(source_name, NULL);
-    GstElement *new_demuxer = gst_element_factory_make(demuxer_name, NULL);
+    GcsPlayerBin *found_bin = NULL;
 
-    /* add the new elements to the bin */
-    gst_bin_add(GST_BIN(player_bin->bin), new_source);
-    gst_bin_add(GST_BIN(player_bin->bin), new_demuxer);
+    guint i;
+    for(i = 0; i < player->bins->len && !found_bin; ++i) {
+        GcsPlayerBin *player_bin = g_ptr_array_index(player->bins, i);
 
-    /* unlink the demuxer from the rest of the pipeline, and
-    unlink the source from the demuxer */
-    gst_element_unlink(player_bin->demuxer, player_bin->queue);
-    gst_element_unlink(player_bin->source, player_bin->demuxer);
+        GstPad *bin_src_pad = gst_element_get_static_pad(player_bin->bin,
+            "src");
+        GstPad *peer_pad = gst_pad_get_peer(bin_src_pad);
 
-    /* remove the source and demuxer from the bin */
-    gst_bin_remove(GST_BIN(player_bin->bin), player_bin->source);
-    gst_bin_remove(GST_BIN(player_bin->bin), player_bin->demuxer);
+        if(peer_pad == concat_sink_pad) {
+            found_bin = player_bin;
+        }
 
-    /* update references in our structure */
-    player_bin->source = new_source;
-    player_bin->demuxer = new_demuxer;
+        GSTREAMER_FREE(bin_src_pad);
+        GSTREAMER_FREE(peer_pad);
+    }
 
-    /* link the new elements together */
-    gst_element_link_many(player_bin->source, player_bin->demuxer,
-        player_bin->queue, NULL);
+    return found_bin;
 }
 
 static void
-gcs_player_bin_make_chunk_bin(GcsPlayerBin *player_bin)
+gcs_player_post_chunk_message(GcsPlayer *player, GcsPlayerBin *player_bin)
 {
-    gcs_player_bin_change_elements(player_bin, "filesrc",
-        "matroskademux");
-
-    player_bin->type = GCS_PLAYER_BIN_TYPE_CHUNK;
+    /* running time doesn't say what's playing once gaps are skipped
+    or shortened, let the application know what moment it's at */
+    int is_gap = player_bin->type == GCS_PLAYER_BIN_TYPE_GAP;
+
+    GstStructure *structure = gst_structure_new("gcs-chunk",
+        "start-moment", G_TYPE_UINT64, player_bin->start_moment,
+        "stop-moment", G_TYPE_UINT64, player_bin->stop_moment,
+        "gap", G_TYPE_BOOLEAN, is_gap,
+        NULL);
+
+    gst_element_post_message(player->pipeline, gst_message_new_element(
+        GST_OBJECT(player->concat), structure));
 }
 
 static void
-gcs_player_bin_make_gap_bin(GcsPlayerBin *player_bin)
+on_switch(GstElement *element, GstPad *old_pad, GstPad *new_pad,
+    gpointer user_data)
 {
-    gcs_player_bin_change_elements(player_bin, "videotestsrc",
-        "x264enc");
+    GcsPlayer *player = GCS_PLAYER(user_data);
+
+    /* the bin we're switching to should have been prerolled while
+    the previous one was playing, if not, playback stalls */
+    GcsPlayerBin *player_bin = gcs_player_find_bin(player, new_pad);
+    GcsPlayerBin *old_player_bin = gcs_player_find_bin(player, old_pad);
+
+    if(old_player_bin) {
+        g_atomic_int_set(&old_player_bin->finished, TRUE);
+    }
+
+    g_atomic_int_inc(&player->stats.switches);
+    if(player_bin && !g_atomic_int_get(&player_bin->ready)) {
+        g_atomic_int_inc(&player->stats.not_ready);
+
+        printf("[wrn] switched to a chunk that is not ready yet, "
+            "%i of %i switches\n", g_atomic_int_get(&player->stats.not_ready),
+            g_atomic_int_get(&player->stats.switches));
+    }
+
+    if(player_bin) {
+        gcs_player_post_chunk_message(player, player_bin);
+
+        /* see how long it takes for the chunk to come through */
+        __atomic_store_n(&player->switch_time, g_get_monotonic_time(),
+            __ATOMIC_RELAXED);
+    }
 
-    player_bin->type = GCS_PLAYER_BIN_TYPE_GAP;
+    /* perform switching of bins on the player's worker thread
+    and not on the streaming thread, which is where signals
+    are emitted on, nor on the application's main loop, where a
+    slow state change would hold up every other player */
+    gcs_player_invoke(player->context, on_switch_finish, player);
 }
 
 static void
@@ -99,27 +251,94 @@ gcs_player_bin_stop(GcsPlayer *player, GcsPlayerBin *player_bin)
         this causes the pad to be removed so that when we link again,
         we get a new pad */
         gst_element_release_request_pad(player->concat, concat_sink_pad);
+        player_bin->linked = FALSE;
+    }
+
+    /* it never got any data, don't let the probe linger */
+    if(player_bin->ready_probe) {
+        gst_pad_remove_probe(bin_src_pad, player_bin->ready_probe);
+        player_bin->ready_probe = 0;
     }
 
     /* we don't need the pads any more */
     GSTREAMER_FREE(bin_src_pad);
     GSTREAMER_FREE(concat_sink_pad);
 
-    /* set the entire bin to NULL so we can perform
-    operations on it */
+    /* nor the seek, if it never got far enough to seek */
+    if(player_bin->seek_probe) {
+        GstPad *queue_sink_pad = gst_element_get_static_pad(player_bin->queue,
+            "sink");
+
+        gst_pad_remove_probe(queue_sink_pad, player_bin->seek_probe);
+        GSTREAMER_FREE(queue_sink_pad);
+
+        player_bin->seek_probe = 0;
+        player_bin->seek_time = 0;
+        player_bin->seek_pending = FALSE;
+    }
+
+    /* set the entire bin to NULL so we can change the properties
+    of its elements, and keep it there when the pipeline changes
+    state while the bin is not in use */
+    gst_element_set_locked_state(player_bin->bin, TRUE);
     gst_element_set_state(player_bin->bin, GST_STATE_NULL);
+
+    /* its streaming thread stopped, nothing reads from it anymore,
+    frames that are still queued keep their blocks alive */
+    if(player_bin->reader) {
+        player_bin->bytes_read = (gint64) player_bin->reader->bytes_read;
+
+        gcs_mkv_reader_close(player_bin->reader);
+        player_bin->reader = NULL;
+    }
+
+    if(player_bin->fallback) {
+        gst_element_set_state(player_bin->fallback, GST_STATE_NULL);
+        GSTREAMER_FREE(player_bin->fallback);
+    }
+
+    if(player_bin->bytes_read) {
+        gcs_metrics_observe(player_metrics.chunk_bytes,
+            (uint64_t) player_bin->bytes_read);
+        player_bin->bytes_read = 0;
+    }
+}
+
+static GstPadProbeReturn
+on_bin_ready_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    /* the first buffer is all we wanted to know about */
+    g_atomic_int_set(&player_bin->ready, TRUE);
+    player_bin->ready_probe = 0;
+
+    return GST_PAD_PROBE_REMOVE;
 }
 
 static void
 gcs_player_bin_start(GcsPlayer *player, GcsPlayerBin *player_bin, int play)
 {
+    /* find out when the bin is ready to be switched to */
+    g_atomic_int_set(&player_bin->ready, FALSE);
+    g_atomic_int_set(&player_bin->finished, FALSE);
+
+    GstPad *bin_src_pad = gst_element_get_static_pad(player_bin->bin, "src");
+    player_bin->ready_probe = gst_pad_add_probe(bin_src_pad,
+        GST_PAD_PROBE_TYPE_BUFFER, on_bin_ready_probe, player_bin, NULL);
+
+    GSTREAMER_FREE(bin_src_pad);
+
     /* link it back into the pipeline and then put it
     into the playing state again */
     gst_element_link(player_bin->bin, player->concat);
 
-    /* when the pipeline is initializing, we don't want the bin
-    to be moving to the PLAYING state on it's own, this flag can
-    be used to control this behaviour */
+    /* follow the state of the pipeline again, when the pipeline
+    is initializing, we don't want the bin to be moving to the
+    PLAYING state on it's own, this flag can be used to control
+    this behaviour */
+    gst_element_set_locked_state(player_bin->bin, FALSE);
+
     if(play) {
         gst_element_set_state(player_bin->bin, GST_STATE_PLAYING);
     }
@@ -134,223 +353,1467 @@ gcs_player_bin_set_filename(GcsPlayerBin *player_bin, const char *filename)
     g_object_set(player_bin->source, "location", filename, NULL);
 }
 
-static int
-gcs_player_get_next_bin_index(GcsPlayer *player)
+static gboolean
+on_bin_seek(gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+    g_mutex_lock(player_bin->lock);
+
+    /* the bin was stopped before we got to it */
+    if(!player_bin->seek_probe) {
+        g_mutex_unlock(player_bin->lock);
+        return FALSE;
+    }
+
+    gboolean seeked = FALSE;
+    if(player_bin->rate < 0) {
+        /* play backwards from the offset, or from the end, the demuxer
+        sends the clusters in reverse and the decoder reverses the
+        frames of one GOP at a time, the rate itself is applied by
+        scaling the timestamps, like when playing forward */
+        GstSeekType stop_type = player_bin->seek_time ?
+            GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE;
+
+        seeked = gst_element_seek(player_bin->demuxer, -1.0, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, GST_SEEK_TYPE_SET,
+            0, stop_type, (gint64) player_bin->seek_time);
+    } else {
+        /* jump to the keyframe, the demuxer finds the cluster it's in
+        through the cues, so nothing before it is read or decoded */
+        seeked = gst_element_seek(player_bin->demuxer, 1.0, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+            GST_SEEK_FLAG_SNAP_BEFORE, GST_SEEK_TYPE_SET,
+            (gint64) player_bin->seek_time, GST_SEEK_TYPE_NONE, -1);
+    }
+
+    if(!seeked) {
+        printf("[wrn] could not seek into chunk\n");
+    }
+
+    /* the flush unblocked the pad, let data through again */
+    GstPad *queue_sink_pad = gst_element_get_static_pad(player_bin->queue,
+        "sink");
+
+    gst_pad_remove_probe(queue_sink_pad, player_bin->seek_probe);
+    GSTREAMER_FREE(queue_sink_pad);
+
+    player_bin->seek_probe = 0;
+    player_bin->seek_time = 0;
+
+    g_mutex_unlock(player_bin->lock);
+    return FALSE;
+}
+
+static GstPadProbeReturn
+on_bin_seek_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    int next_index = 0;
-    int last_index = player->bins->len - 1;
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    /* the demuxer produces data, which means it read the headers
+    and is ready to be seeked, which has to happen from the
+    worker thread and not its own streaming thread, keep the
+    data blocked until then */
+    if(player_bin->seek_pending) {
+        gcs_player_invoke(player_bin->context, on_bin_seek, player_bin);
+        player_bin->seek_pending = FALSE;
+    }
+
+    return GST_PAD_PROBE_OK;
+}
 
-    /* if we're at the end, move the the first one again,
-    otherwise, just take the next one in the list */
-    if(player->next_bin_index == last_index) {
-        next_index = 0;
+static void
+gcs_player_bin_seek_on_start(GcsPlayer *player, GcsPlayerBin *player_bin,
+    GcsChunk *chunk)
+{
+    if(player_bin->rate < 0) {
+        /* going backwards, playback ends at a keyframe, but can
+        start (the last frame shown) anywhere */
+        player_bin->seek_time = player->start_offset;
     } else {
-        next_index = player->next_bin_index + 1;
+        /* find the keyframe at or before the offset, playback can't
+        start in between keyframes */
+        GcsMetaKeyframe keyframe;
+        if(!gcs_index_iterator_find_keyframe(player->index_itr, chunk,
+            player->start_offset, &keyframe) || keyframe.time == 0) {
+            return;
+        }
+
+        player_bin->seek_time = keyframe.time;
     }
 
-    return next_index;
+    player_bin->seek_pending = TRUE;
+
+    GstPad *queue_sink_pad = gst_element_get_static_pad(player_bin->queue,
+        "sink");
+
+    player_bin->seek_probe = gst_pad_add_probe(queue_sink_pad,
+        GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER,
+        on_bin_seek_probe, player_bin, NULL);
+
+    GSTREAMER_FREE(queue_sink_pad);
+
+    if(player_bin->seek_time) {
+        printf("[inf] starting %" PRIu64 "ms into the chunk\n",
+            player_bin->seek_time / 1000000);
+    }
 }
 
 static GcsChunk *
 gcs_player_get_next_chunk(GcsPlayer *player)
 {
+    /* backwards, the chunk before the iterator's position, unless
+    the position is somewhere in the chunk after it, which is where
+    gcs_index_iterator_seek leaves it */
+    if(player->rate < 0) {
+        if(player->start_offset) {
+            return gcs_index_iterator_peek(player->index_itr);
+        }
+
+        return gcs_index_iterator_prev(player->index_itr);
+    }
+
     GcsChunk *chunk = gcs_index_iterator_next(player->index_itr);
     return chunk;
 }
 
+static GQueue *
+gcs_player_get_spare_bins(GcsPlayer *player, GcsPlayerBinType type)
+{
+    switch(type) {
+        case GCS_PLAYER_BIN_TYPE_GAP:
+            return player->gap_bins;
+        case GCS_PLAYER_BIN_TYPE_MKV:
+            return player->mkv_bins;
+        default:
+            return player->chunk_bins;
+    }
+}
+
+static GcsPlayerBin *
+gcs_player_take_bin(GcsPlayer *player, GcsPlayerBinType type)
+{
+    /* there are as many bins of each type as can be in use at
+    the same time, so there always is one */
+    GcsPlayerBin *player_bin = g_queue_pop_head(
+        gcs_player_get_spare_bins(player, type));
+    g_queue_push_tail(player->active_bins, player_bin);
+
+    player_bin->rate = player->rate;
+
+    return player_bin;
+}
+
+static void
+gcs_player_bin_set_reader(GcsPlayer *player, GcsPlayerBin *player_bin,
+    GcsMkvReader *reader, GcsChunk *chunk, const char *filename)
+{
+    player_bin->reader = reader;
+    player_bin->time_offset = 0;
+
+    g_free(player_bin->filename);
+    player_bin->filename = g_strdup(filename);
+    player_bin->keyframe_time = 0;
+    player_bin->keyframe_frames = 0;
+
+    /* the same for every chunk of a camera, the caps probe
+    keeps them from reaching the parser more than once */
+    GstCaps *caps = gcs_gst_new_h264_caps(reader->codec_private,
+        reader->codec_private_size);
+
+    g_object_set(player_bin->source, "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    if(!player->start_offset) {
+        return;
+    }
+
+    /* no waiting for a demuxer to find its way, the reader
+    starts at the cluster of the keyframe right away */
+    GcsMetaKeyframe keyframe;
+    if(!gcs_index_iterator_find_keyframe(player->index_itr, chunk,
+        player->start_offset, &keyframe) || keyframe.time == 0) {
+        return;
+    }
+
+    gcs_mkv_reader_seek(reader, keyframe.offset);
+    player_bin->time_offset = keyframe.time;
+    player_bin->keyframe_time = keyframe.time;
+
+    printf("[inf] starting %" PRIu64 "ms into the chunk\n",
+        keyframe.time / 1000000);
+}
+
 static int
 gcs_player_prepare_next_bin(GcsPlayer *player, int play)
 {
-    /* get a reference to the bin we're switching to, but
-    don't actually make the switch yet */
-    GcsPlayerBin *player_bin = g_ptr_array_index(player->bins,
-        player->next_bin_index);
-
     /* get the next chunk to switch to */
     GcsChunk *chunk = gcs_player_get_next_chunk(player);
 
-    /* make sure the bin is stopped before we're making any
-    changes to it */
-    gcs_player_bin_stop(player, player_bin);
+    /* don't spend any time on gaps at all, the chunk after
+    the gap just follows the one before it */
+    while(chunk && gcs_chunk_is_gap(chunk) &&
+        player->gap_mode == GCS_PLAYER_GAP_MODE_SKIP) {
+        player->stats.skipped_gaps++;
+        player->start_offset = 0;
+
+        chunk = gcs_player_get_next_chunk(player);
+    }
+
+    if(!chunk) {
+        printf("[inf] no more chunks to prepare\n");
+        return 0;
+    }
+
+    /* get a bin that was built for this type of chunk, but
+    don't actually make the switch yet, it's stopped already */
+    GcsPlayerBin *player_bin = NULL;
 
-    /* set the type of the bin (depending on the type of chunk) */
     if(gcs_chunk_is_gap(chunk)) {
-        gcs_player_bin_make_gap_bin(player_bin);
+        player_bin = gcs_player_take_bin(player, GCS_PLAYER_BIN_TYPE_GAP);
+
+        /* the source ends the stream once it covered the gap, which
+        is only a moment when it's shortened to a marker */
+        player_bin->gap_duration = chunk->duration;
+        player_bin->gap_position = 0;
+
+        if(player->gap_mode == GCS_PLAYER_GAP_MODE_MARKER) {
+            player_bin->gap_duration = MIN(chunk->duration,
+                player->marker_duration);
+        }
+
+        player_bin->gap_duration = (uint64_t) (player_bin->gap_duration /
+            ABS(player->rate));
+
+        gcs_metrics_observe(player_metrics.gap_duration,
+            player_bin->gap_duration);
+
+        /* the size of the chunk before it, which is most likely the
+        size of the one after it as well */
+        GcsGapFrame *gap_frame = gcs_gap_frame_get(player->video_width,
+            player->video_height);
 
-        /* temp hack to avoid waiting */
-        if(chunk->duration > 12000000000) {
-            chunk->duration = 12000000000;
-            printf("[wrn] applying temp hack, reducing gap to 12 seconds\n");
+        if(gap_frame && gap_frame != player_bin->gap_frame) {
+            g_object_set(player_bin->source, "caps", gap_frame->caps, NULL);
         }
 
-        /* videotestsrc will EOS when the max-duration was reached,
-        pattern == GST_VIDEO_TEST_SRC_BLACK */
-        g_object_set(player_bin->source, "max-duration", chunk->duration, NULL);
-        g_object_set(player_bin->source, "pattern", 2, NULL);
+        player_bin->gap_frame = gap_frame;
 
     } else {
-        gcs_player_bin_make_chunk_bin(player_bin);
-        gcs_player_bin_set_filename(player_bin, chunk->full_path);
+        char full_path[PATH_MAX];
+        gcs_index_iterator_get_full_path(player->index_itr, chunk, full_path,
+            PATH_MAX);
+
+        /* it's being read from here on, one way or the other */
+        gcs_player_release_readahead(player, full_path);
+
+        /* the reader only goes forward */
+        GcsMkvReader *reader = NULL;
+        if(player->rate > 0) {
+            reader = gcs_mkv_reader_open(full_path);
+        }
+
+        if(reader) {
+            if(reader->width > 0 && reader->height > 0) {
+                player->video_width = reader->width;
+                player->video_height = reader->height;
+            }
+
+            player_bin = gcs_player_take_bin(player, GCS_PLAYER_BIN_TYPE_MKV);
+            gcs_player_bin_set_reader(player, player_bin, reader, chunk,
+                full_path);
+
+        } else {
+            if(player->rate > 0) {
+                player->stats.fallbacks++;
+            }
+
+            player_bin = gcs_player_take_bin(player,
+                GCS_PLAYER_BIN_TYPE_CHUNK);
+            gcs_player_bin_set_filename(player_bin, full_path);
+
+            if(player->start_offset || player->rate < 0) {
+                gcs_player_bin_seek_on_start(player, player_bin, chunk);
+            }
+        }
     }
 
+    /* the offset only applies to the first chunk we prepare */
+    player->start_offset = 0;
+
+    player_bin->start_moment = chunk->start_moment;
+    player_bin->stop_moment = chunk->stop_moment;
+
     /* when the pipeline is initializing, we don't want the
     bins to go into the play state right away */
     gcs_player_bin_start(player, player_bin, play);
 
     if(!gcs_chunk_is_gap(chunk)) {
-        printf("[inf] prepared chunk '%s'\n", chunk->filename);
+        printf("[inf] prepared chunk '%s'\n",
+            gcs_index_iterator_get_filename(player->index_itr, chunk));
     } else {
         printf("[inf] prepared gap\n");
     }
 
-    /* update with the new bin index */
-    player->next_bin_index = gcs_player_get_next_bin_index(player);
     return 1;
 }
 
-static int
-gcs_player_create_pipeline(GcsPlayer *player, const char *sink_type,
-    const char *sink_name, int enable_decoder)
+static void
+gcs_player_read_ahead(GcsPlayer *player)
 {
-    player->pipeline = gst_pipeline_new(NULL);
-    player->concat = gst_element_factory_make("concat", NULL);
-    player->multiqueue = gst_element_factory_make("multiqueue", NULL);
-
-    gst_bin_add_many(GST_BIN(player->pipeline), player->concat,
-        player->multiqueue, NULL);
+    /* get the chunks after the ones the bins have into the page
+    cache, by the time a bin gets one of them, there's no seek and
+    no cold reads at the switch */
+    int i;
+    for(i = 0; i < player->readahead_count; ++i) {
+        int distance = (player->rate < 0) ? -(i + 1) : i;
 
-    gst_element_link_many(player->concat, player->multiqueue, NULL);
+        GcsChunk *chunk = gcs_index_iterator_peek_ahead(player->index_itr,
+            distance);
 
-    /* a sink is optional, for for example, RTSP servers */
-    if(sink_type) {
-        player->sink = gst_element_factory_make(sink_type, sink_name);
+        if(!chunk) {
+            break;
+        }
 
-        if(!player->sink) {
-            fprintf(stderr, "[err] could not create sink element of type `%s`",
-                sink_type);
-            return FALSE;
+        char full_path[PATH_MAX];
+        if(gcs_chunk_is_gap(chunk) || !gcs_index_iterator_get_full_path(
+            player->index_itr, chunk, full_path, PATH_MAX)) {
+            continue;
         }
 
-        gst_bin_add(GST_BIN(player->pipeline), player->sink);
-        gst_element_link(player->multiqueue, player->sink);
-    }
+        if(g_queue_find_custom(player->readahead_files, full_path,
+            (GCompareFunc) strcmp)) {
+            continue;
+        }
 
-    /* add bins for context switching */
-    int i;
-    for(i = 0; i < GCS_PLAYER_DEFAULT_BIN_COUNT; ++i) {
-        GcsPlayerBin *new_bin = gcs_player_bin_new(enable_decoder);
+        /* the budget is used up, by this player or others, the
+        chunks after this one can wait for the next switch */
+        if(!gcs_readahead_warm(full_path)) {
+            break;
+        }
 
-        /* add to the pipeline bin, but don't link them yet */
-        gst_bin_add(GST_BIN(player->pipeline), new_bin->bin);
-        g_ptr_array_add(player->bins, new_bin);
+        g_queue_push_tail(player->readahead_files, g_strdup(full_path));
     }
+}
 
-    /* hook up signals */
-    g_signal_connect(player->concat, "pad-switch", G_CALLBACK(on_switch),
-        player);
+static void
+gcs_player_release_readahead(GcsPlayer *player, const char *filename)
+{
+    /* without a filename, all of them, when seeking or stopping */
+    GList *item = player->readahead_files->head;
+    while(item) {
+        GList *next = item->next;
+        char *readahead_filename = (char *) item->data;
+
+        if(!filename || strcmp(readahead_filename, filename) == 0) {
+            gcs_readahead_release(readahead_filename);
+            g_free(readahead_filename);
+            g_queue_delete_link(player->readahead_files, item);
+        }
 
-    return TRUE;
+        item = next;
+    }
 }
 
-GcsPlayer *
-gcs_player_new(GcsIndexIterator *index_itr, const char *sink_type,
-    const char *sink_name,
-    int enable_decoder)
+static GstPadProbeReturn
+on_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    GcsPlayer *player = ALLOC_NULL(GcsPlayer *, sizeof(GcsPlayer));
-    player->index_itr = index_itr;
-    player->bins = g_ptr_array_new();
+    GcsPlayer *player = GCS_PLAYER(user_data);
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
 
-    gcs_player_create_pipeline(player, sink_type, sink_name, enable_decoder);
+    if(GST_EVENT_TYPE(event) != GST_EVENT_CAPS) {
+        return GST_PAD_PROBE_OK;
+    }
 
-    return player;
+    GstCaps *caps = NULL;
+    gst_event_parse_caps(event, &caps);
+
+    /* the parser and decoder still have these, telling them again
+    would only make them start over */
+    if(player->caps && gst_caps_is_equal(player->caps, caps)) {
+        return GST_PAD_PROBE_DROP;
+    }
+
+    gst_caps_replace(&player->caps, caps);
+    g_atomic_int_inc(&player->stats.caps_changes);
+
+    return GST_PAD_PROBE_OK;
 }
 
-void
-gcs_player_prepare(GcsPlayer *player)
+static GstPadProbeReturn
+on_frame_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    /* initialize the first two bins with the first
-    two chunks */
-    gcs_player_prepare_next_bin(player, FALSE);
-    gcs_player_prepare_next_bin(player, FALSE);
+    GcsPlayer *player = GCS_PLAYER(user_data);
+    gint64 now = g_get_monotonic_time();
+
+    /* only ever called from one streaming thread at a time */
+    if(player->stats.last_frame_time) {
+        gint64 interval = now - player->stats.last_frame_time;
+        player->stats.max_frame_interval = MAX(
+            player->stats.max_frame_interval, interval);
+    }
 
-    /* little hack to make everything works */
-    player->next_bin_index = 0;
+    player->stats.last_frame_time = now;
+    return GST_PAD_PROBE_OK;
 }
 
-void
-gcs_player_connect_signal(GcsPlayer *player, GCallback callback, gpointer user_data)
+static GstPadProbeReturn
+on_switch_done_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    g_signal_connect(player->concat, "pad-switch", G_CALLBACK(callback),
-      user_data);
+    GcsPlayer *player = GCS_PLAYER(user_data);
+
+    /* the first frame of the chunk that was switched to, taken
+    in one go so a switch that happens meanwhile isn't lost */
+    gint64 switch_time = __atomic_exchange_n(&player->switch_time, 0,
+        __ATOMIC_RELAXED);
+
+    if(!switch_time) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 time = g_get_monotonic_time() - switch_time;
+    gcs_metrics_observe(player_metrics.switch_time, (uint64_t) time);
+
+    if(time > GCS_PLAYER_SLOW_SWITCH_TIME) {
+        g_atomic_int_inc(&player->stats.slow_switches);
+    }
+
+    return GST_PAD_PROBE_OK;
 }
 
-void
-gcs_player_play(GcsPlayer *player)
+static void
+on_underrun(GstElement *multiqueue, gpointer user_data)
 {
-    gcs_player_prepare(player);
-    gst_element_set_state(player->pipeline, GST_STATE_PLAYING);
+    GcsPlayer *player = GCS_PLAYER(user_data);
+
+    /* whatever comes after the player is waiting for data */
+    g_atomic_int_inc(&player->stats.underruns);
+    gcs_metrics_add(player_metrics.underruns, 1);
 }
 
-void
-gcs_player_stop(GcsPlayer *player)
+static GstPadProbeReturn
+on_decoder_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    gst_element_set_state(player->pipeline, GST_STATE_NULL);
+    GstBuffer *buffer = gst_buffer_make_writable(
+        GST_PAD_PROBE_INFO_BUFFER(info));
+
+    gst_buffer_add_reference_timestamp_meta(buffer, decode_meta_caps,
+        (GstClockTime) g_get_monotonic_time(), GST_CLOCK_TIME_NONE);
+
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    return GST_PAD_PROBE_OK;
 }
 
-void
-gcs_player_free(GcsPlayer *player)
+static GstPadProbeReturn
+on_decoder_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-    if(!player) {
-        return;
-    }
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
 
-    if(player->bins) {
-        /* free entire array, and the elements */
-        g_ptr_array_free(player->bins, TRUE);
+    /* matched by the meta and not by timestamp, frames come out
+    in another order than they go in when there are b-frames and
+    timestamps repeat when a rate or a seek rewrites them */
+    GstReferenceTimestampMeta *meta = gst_buffer_get_reference_timestamp_meta(
+        buffer, decode_meta_caps);
+
+    if(!meta) {
+        return GST_PAD_PROBE_OK;
     }
 
-    free(player);
+    gcs_metrics_observe(player_metrics.decode_time,
+        (uint64_t) (g_get_monotonic_time() - (gint64) meta->timestamp));
+
+    /* nothing after the decoder needs to know, the meta moves along
+    with the buffer when it's copied */
+    buffer = gst_buffer_make_writable(buffer);
+    meta = gst_buffer_get_reference_timestamp_meta(buffer, decode_meta_caps);
+    gst_buffer_remove_meta(buffer, &meta->parent);
+
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    return GST_PAD_PROBE_OK;
 }
 
-GcsPlayerBin *
-gcs_player_bin_new(int enable_decoder)
+static int
+gcs_player_create_pipeline(GcsPlayer *player, const char *sink_type,
+    const char *sink_name, int enable_decoder, int bin_count)
 {
-    GcsPlayerBin *player_bin = ALLOC_NULL(GcsPlayerBin *, sizeof(GcsPlayerBin));
+    player->pipeline = gst_pipeline_new(NULL);
+    player->concat = gst_element_factory_make("concat", NULL);
+    player->parser = gst_element_factory_make("h264parse", NULL);
+    player->multiqueue = gst_element_factory_make("multiqueue", NULL);
 
-    player_bin->bin = gst_bin_new(NULL);
-    player_bin->source = gst_element_factory_make("filesrc", NULL);
-    player_bin->demuxer = gst_element_factory_make("matroskademux", NULL);
-    player_bin->queue = gst_element_factory_make("queue", NULL);
-    player_bin->parser = gst_element_factory_make("h264parse", NULL);
-    player_bin->capsfilter = gst_element_factory_make("capsfilter", NULL);
+    gst_bin_add_many(GST_BIN(player->pipeline), player->concat,
+        player->parser, player->multiqueue, NULL);
 
-    /* it could be that one does not want the video to be decoded,
-    in that case we simply turn it into a queue element */
+    /* one parser and decoder for all chunks, they live as long as
+    the player does, instead of starting over at every chunk, it
+    could be that one does not want the video to be decoded, in that
+    case there simply is no decoder */
+    GstElement *last_element = player->parser;
     if(enable_decoder) {
-        player_bin->decoder = gst_element_factory_make("avdec_h264", NULL);
+        player->decoder = gst_element_factory_make("avdec_h264", NULL);
+
+        gst_bin_add(GST_BIN(player->pipeline), player->decoder);
+        last_element = player->decoder;
+    }
+
+    gst_element_link_many(player->concat, player->parser, NULL);
+    if(player->decoder) {
+        gst_element_link(player->parser, player->decoder);
+    }
+
+    gst_element_link(last_element, player->multiqueue);
+
+    /* every chunk starts with its caps, which are the same for all
+    chunks of a camera, only let them through when they change */
+    GstPad *parser_sink_pad = gst_element_get_static_pad(player->parser,
+        "sink");
+
+    gst_pad_add_probe(parser_sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        on_caps_probe, player, NULL);
+
+    GSTREAMER_FREE(parser_sink_pad);
+
+    /* see how even frames come out, switches show up as hiccups */
+    GstPad *last_src_pad = gst_element_get_static_pad(last_element, "src");
+
+    gst_pad_add_probe(last_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        on_frame_probe, player, NULL);
+
+    GSTREAMER_FREE(last_src_pad);
+
+    /* how long every switch and every frame takes */
+    GstPad *concat_src_pad = gst_element_get_static_pad(player->concat,
+        "src");
+
+    gst_pad_add_probe(concat_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        on_switch_done_probe, player, NULL);
+
+    GSTREAMER_FREE(concat_src_pad);
+
+    if(player->decoder) {
+        GstPad *decoder_sink_pad = gst_element_get_static_pad(player->decoder,
+            "sink");
+        GstPad *decoder_src_pad = gst_element_get_static_pad(player->decoder,
+            "src");
+
+        gst_pad_add_probe(decoder_sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+            on_decoder_sink_probe, player, NULL);
+        gst_pad_add_probe(decoder_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+            on_decoder_src_probe, player, NULL);
+
+        GSTREAMER_FREE(decoder_sink_pad);
+        GSTREAMER_FREE(decoder_src_pad);
+    }
+
+    g_signal_connect(player->multiqueue, "underrun", G_CALLBACK(on_underrun),
+        player);
+
+    /* a sink is optional, for for example, RTSP servers */
+    if(sink_type) {
+        player->sink = gst_element_factory_make(sink_type, sink_name);
+
+        if(!player->sink) {
+            fprintf(stderr, "[err] could not create sink element of type `%s`",
+                sink_type);
+            return FALSE;
+        }
+
+        gst_bin_add(GST_BIN(player->pipeline), player->sink);
+        gst_element_link(player->multiqueue, player->sink);
+    }
+
+    /* add bins for context switching, one plays while the
+    others prepare the chunks after it, any of them could be
+    a gap, or a chunk the reader refuses, so build enough of
+    every type to never have to build one while playing */
+    int i;
+    for(i = 0; i < bin_count * 3; ++i) {
+        GcsPlayerBinType type = (GcsPlayerBinType) (i / bin_count);
+
+        GcsPlayerBin *new_bin = gcs_player_bin_new(type, enable_decoder);
+        new_bin->context = player->context;
+        new_bin->lock = &player->lock;
+
+        /* add to the pipeline bin, but don't link them yet */
+        gst_bin_add(GST_BIN(player->pipeline), new_bin->bin);
+        g_ptr_array_add(player->bins, new_bin);
+
+        g_queue_push_tail(gcs_player_get_spare_bins(player, type), new_bin);
+    }
+
+    /* hook up signals */
+    g_signal_connect(player->concat, "pad-switch", G_CALLBACK(on_switch),
+        player);
+
+    return TRUE;
+}
+
+GcsPlayer *
+gcs_player_new(GcsIndexIterator *index_itr, const char *sink_type,
+    const char *sink_name,
+    int enable_decoder,
+    int bin_count)
+{
+    gcs_player_init_metrics();
+
+    GcsPlayer *player = ALLOC_NULL(GcsPlayer *, sizeof(GcsPlayer));
+    player->index_itr = index_itr;
+    player->bins = g_ptr_array_new_with_free_func(
+        (GDestroyNotify) gcs_player_bin_free);
+    player->active_bins = g_queue_new();
+    player->chunk_bins = g_queue_new();
+    player->gap_bins = g_queue_new();
+    player->mkv_bins = g_queue_new();
+    player->readahead_files = g_queue_new();
+
+    /* at least one to play and one to prepare the next chunk */
+    if(bin_count <= 0) {
+        bin_count = GCS_PLAYER_DEFAULT_BIN_COUNT;
+    }
+
+    bin_count = CLAMP(bin_count, 2, GCS_PLAYER_MAX_BIN_COUNT);
+    player->bin_count = bin_count;
+    player->marker_duration = GCS_PLAYER_DEFAULT_MARKER_DURATION;
+    player->rate = 1.0;
+    player->readahead_count = GCS_READAHEAD_DEFAULT_CHUNK_COUNT;
+
+    /* bins are prepared on a thread of the player's own, every
+    player has one, so players don't wait for each other */
+    g_mutex_init(&player->lock);
+    player->context = g_main_context_new();
+    player->loop = g_main_loop_new(player->context, FALSE);
+    player->thread = g_thread_new("gcs-player", gcs_player_worker, player);
+
+    gcs_player_create_pipeline(player, sink_type, sink_name, enable_decoder,
+        bin_count);
+
+    return player;
+}
+
+void
+gcs_player_set_start_offset(GcsPlayer *player, uint64_t start_offset)
+{
+    /* usually the chunk offset gcs_index_iterator_seek returned,
+    has to be set before the chunk is prepared */
+    g_mutex_lock(&player->lock);
+    player->start_offset = start_offset;
+    g_mutex_unlock(&player->lock);
+}
+
+void
+gcs_player_set_gap_mode(GcsPlayer *player, GcsPlayerGapMode gap_mode,
+    uint64_t marker_duration)
+{
+    /* applies to the gaps that are prepared after this */
+    g_mutex_lock(&player->lock);
+    player->gap_mode = gap_mode;
+    player->marker_duration = marker_duration;
+
+    if(!player->marker_duration) {
+        player->marker_duration = GCS_PLAYER_DEFAULT_MARKER_DURATION;
+    }
+
+    g_mutex_unlock(&player->lock);
+}
+
+void
+gcs_player_set_rate(GcsPlayer *player, double rate)
+{
+    /* applies to the chunks that are prepared after this, the
+    ones that are prepared already play at the old rate, negative
+    rates play backwards */
+    if(rate == 0.0) {
+        printf("[wrn] can't play at a rate of %f\n", rate);
+        return;
+    }
+
+    g_mutex_lock(&player->lock);
+    player->rate = rate;
+    g_mutex_unlock(&player->lock);
+}
+
+void
+gcs_player_set_readahead(GcsPlayer *player, int chunk_count)
+{
+    /* zero turns it off, applies from the next switch on */
+    g_mutex_lock(&player->lock);
+    player->readahead_count = MAX(chunk_count, 0);
+    g_mutex_unlock(&player->lock);
+}
+
+static void
+gcs_player_prepare_bins(GcsPlayer *player)
+{
+    /* initialize every bin with the first chunks, so that
+    many chunks are prepared ahead of the one that's playing */
+    int i;
+    for(i = 0; i < player->bin_count; ++i) {
+        if(!gcs_player_prepare_next_bin(player, FALSE)) {
+            break;
+        }
+    }
+
+    gcs_player_read_ahead(player);
+
+    /* there's no switch to the first one */
+    GcsPlayerBin *player_bin = g_queue_peek_head(player->active_bins);
+    if(player_bin) {
+        gcs_player_post_chunk_message(player, player_bin);
+    }
+}
+
+void
+gcs_player_prepare(GcsPlayer *player)
+{
+    g_mutex_lock(&player->lock);
+    gcs_player_prepare_bins(player);
+    g_mutex_unlock(&player->lock);
+}
+
+static GstPadProbeReturn
+on_seek_done_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GcsPlayer *player = GCS_PLAYER(user_data);
+
+    g_mutex_lock(&player->lock);
+
+    /* a later seek (or stop) removed it already */
+    if(player->seek_probe != GST_PAD_PROBE_INFO_ID(info)) {
+        g_mutex_unlock(&player->lock);
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* the first frame after the seek left concat */
+    gint64 time = g_get_monotonic_time() - player->seek_start_time;
+    player->stats.seek_time += time;
+    player->stats.max_seek_time = MAX(player->stats.max_seek_time, time);
+    g_atomic_int_inc(&player->stats.seeks);
+
+    player->seek_probe = 0;
+    g_mutex_unlock(&player->lock);
+
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+gcs_player_remove_seek_probe(GcsPlayer *player)
+{
+    if(!player->seek_probe) {
+        return;
+    }
+
+    GstPad *concat_src_pad = gst_element_get_static_pad(player->concat, "src");
+    gst_pad_remove_probe(concat_src_pad, player->seek_probe);
+    GSTREAMER_FREE(concat_src_pad);
+
+    player->seek_probe = 0;
+}
+
+static void
+gcs_player_release_active_bins(GcsPlayer *player)
+{
+    GcsPlayerBin *player_bin = NULL;
+    while((player_bin = g_queue_pop_head(player->active_bins))) {
+        gcs_player_release_bin(player, player_bin);
+    }
+}
+
+static void
+gcs_player_reset_stream(GcsPlayer *player)
+{
+    /* the pads of a stopped pipeline forget their caps, so the
+    caps of the next chunk have to go through, whatever they are,
+    nor does the pause count as a hiccup */
+    gst_caps_replace(&player->caps, NULL);
+    player->stats.last_frame_time = 0;
+    __atomic_store_n(&player->switch_time, 0, __ATOMIC_RELAXED);
+}
+
+int
+gcs_player_seek(GcsPlayer *player, uint64_t moment)
+{
+    /* a seek that's still waiting for its first frame never gets
+    it, this one is measured instead */
+    g_mutex_lock(&player->lock);
+    player->seek_start_time = g_get_monotonic_time();
+    gcs_player_remove_seek_probe(player);
+    g_mutex_unlock(&player->lock);
+
+    /* resetting the pipeline flushes concat, the queue and the sink,
+    and concat starts counting running time from zero again, which is
+    a lot faster than building a new pipeline, it waits for the
+    streaming threads, so it's done without the lock, a switch the
+    worker thread handles meanwhile is undone below */
+    gst_element_set_state(player->pipeline, GST_STATE_READY);
+    gcs_player_reset_stream(player);
+
+    /* keep the worker thread from preparing bins while we
+    replace them */
+    g_mutex_lock(&player->lock);
+
+    gcs_player_release_active_bins(player);
+
+    /* the chunks after the old position won't be played */
+    gcs_player_release_readahead(player, NULL);
+
+    /* the chunk to start at goes into the first spare bin, seeked to
+    the keyframe before the moment, the other bins prepare the chunks
+    behind it, so there's no waiting at the first switch either */
+    uint64_t chunk_offset = 0;
+    GcsChunk *chunk = gcs_index_iterator_seek(player->index_itr, moment,
+        &chunk_offset);
+
+    if(!chunk) {
+        printf("[wrn] there is nothing to play after the moment seeked to\n");
+        g_mutex_unlock(&player->lock);
+        return 0;
+    }
+
+    player->start_offset = chunk_offset;
+    gcs_player_prepare_bins(player);
+
+    GstPad *concat_src_pad = gst_element_get_static_pad(player->concat, "src");
+    player->seek_probe = gst_pad_add_probe(concat_src_pad,
+        GST_PAD_PROBE_TYPE_BUFFER, on_seek_done_probe, player, NULL);
+
+    GSTREAMER_FREE(concat_src_pad);
+
+    g_mutex_unlock(&player->lock);
+
+    /* the bins start seeking from their streaming threads, which
+    needs the worker thread, and with it the lock */
+    gst_element_set_state(player->pipeline, GST_STATE_PLAYING);
+    return 1;
+}
+
+void
+gcs_player_connect_signal(GcsPlayer *player, GCallback callback, gpointer user_data)
+{
+    g_signal_connect(player->concat, "pad-switch", G_CALLBACK(callback),
+      user_data);
+}
+
+void
+gcs_player_play(GcsPlayer *player)
+{
+    gcs_player_prepare(player);
+    gst_element_set_state(player->pipeline, GST_STATE_PLAYING);
+}
+
+void
+gcs_player_stop(GcsPlayer *player)
+{
+    gst_element_set_state(player->pipeline, GST_STATE_NULL);
+    gcs_player_reset_stream(player);
+
+    /* playing (or seeking) again prepares bins from scratch, the
+    ones that were linked have to be spare by then */
+    g_mutex_lock(&player->lock);
+    gcs_player_remove_seek_probe(player);
+    gcs_player_release_active_bins(player);
+    gcs_player_release_readahead(player, NULL);
+    g_mutex_unlock(&player->lock);
+}
+
+static long
+gcs_player_get_rss()
+{
+    /* resident pages, the second field, unlike the peak from
+    getrusage this goes down again, so it shows leaks over time */
+    FILE *file = fopen("/proc/self/statm", "r");
+    if(!file) {
+        return 0;
+    }
+
+    long size = 0;
+    long resident = 0;
+    if(fscanf(file, "%li %li", &size, &resident) != 2) {
+        resident = 0;
+    }
+
+    fclose(file);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void
+gcs_player_print_stats(GcsPlayer *player)
+{
+    g_mutex_lock(&player->lock);
+
+    printf("[inf] %i bins, %i switches, %i to a chunk that was not ready\n",
+        player->bin_count, g_atomic_int_get(&player->stats.switches),
+        g_atomic_int_get(&player->stats.not_ready));
+
+    gint64 average_time = 0;
+    if(player->stats.prepared) {
+        average_time = player->stats.prepare_time / player->stats.prepared;
+    }
+
+    printf("[inf] preparing took %" G_GINT64_FORMAT "us on average, "
+        "%" G_GINT64_FORMAT "us at most, %likB resident\n", average_time,
+        player->stats.max_prepare_time, gcs_player_get_rss());
+
+    gint dropped_frames = 0;
+    gint late_fallbacks = 0;
+
+    guint i;
+    for(i = 0; i < player->bins->len; ++i) {
+        GcsPlayerBin *player_bin = g_ptr_array_index(player->bins, i);
+        dropped_frames += g_atomic_int_get(&player_bin->dropped_frames);
+        late_fallbacks += g_atomic_int_get(&player_bin->late_fallbacks);
+    }
+
+    if(dropped_frames) {
+        printf("[inf] dropped %i frames that were not keyframes\n",
+            dropped_frames);
+    }
+
+    int seeks = g_atomic_int_get(&player->stats.seeks);
+    /* cpu time of the whole process, with one player it's that
+    player's, and how often the parser and decoder had to start over */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    gint64 cpu_time = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+
+    printf("[inf] %" G_GINT64_FORMAT "ms cpu time, %i caps changes, "
+        "frames at most %" G_GINT64_FORMAT "ms apart\n", cpu_time,
+        g_atomic_int_get(&player->stats.caps_changes),
+        player->stats.max_frame_interval / 1000);
+
+    if(seeks) {
+        printf("[inf] %i seeks took %" G_GINT64_FORMAT "ms on average, "
+            "%" G_GINT64_FORMAT "ms at most\n", seeks,
+            player->stats.seek_time / seeks / 1000,
+            player->stats.max_seek_time / 1000);
+    }
+
+    int slow_switches = g_atomic_int_get(&player->stats.slow_switches);
+    if(slow_switches) {
+        printf("[inf] %i switches took longer than %ims\n", slow_switches,
+            GCS_PLAYER_SLOW_SWITCH_TIME / 1000);
+    }
+
+    if(player->stats.skipped_gaps) {
+        printf("[inf] skipped %i gaps\n", player->stats.skipped_gaps);
+    }
+
+    GcsReadaheadStats readahead_stats;
+    gcs_readahead_get_stats(&readahead_stats);
+
+    /* shared by all players in the process */
+    if(readahead_stats.warmed || readahead_stats.skipped) {
+        printf("[inf] read ahead %i chunks (%" G_GINT64_FORMAT "MB), %i not "
+            "within the budget, %" G_GINT64_FORMAT "MB not played yet\n",
+            readahead_stats.warmed, readahead_stats.warmed_bytes / 1048576,
+            readahead_stats.skipped, readahead_stats.used_bytes / 1048576);
+    }
+
+    int underruns = g_atomic_int_get(&player->stats.underruns);
+    if(underruns) {
+        printf("[inf] ran out of frames %i times\n", underruns);
+    }
+
+    if(player->stats.fallbacks) {
+        printf("[inf] %i chunks were not understood by the reader and "
+            "went through matroskademux\n", player->stats.fallbacks);
+    }
+
+    if(late_fallbacks) {
+        printf("[inf] %i chunks went through matroskademux after the "
+            "reader gave up halfway\n", late_fallbacks);
+    }
+
+    g_mutex_unlock(&player->lock);
+}
+
+void
+gcs_player_free(GcsPlayer *player)
+{
+    if(!player) {
+        return;
+    }
+
+    /* whatever is still queued for the worker is dropped */
+    if(player->thread) {
+        g_main_loop_quit(player->loop);
+        g_thread_join(player->thread);
+
+        g_main_loop_unref(player->loop);
+        g_main_context_unref(player->context);
+    }
+
+    g_mutex_clear(&player->lock);
+
+    if(player->caps) {
+        gst_caps_unref(player->caps);
+    }
+
+    if(player->bins) {
+        /* free entire array, and the elements */
+        g_ptr_array_free(player->bins, TRUE);
+    }
+
+    /* these only point to the bins we just freed */
+    if(player->active_bins) {
+        g_queue_free(player->active_bins);
+    }
+
+    if(player->chunk_bins) {
+        g_queue_free(player->chunk_bins);
+    }
+
+    if(player->gap_bins) {
+        g_queue_free(player->gap_bins);
+    }
+
+    if(player->mkv_bins) {
+        g_queue_free(player->mkv_bins);
+    }
+
+    if(player->readahead_files) {
+        gcs_player_release_readahead(player, NULL);
+        g_queue_free(player->readahead_files);
+    }
+
+    free(player);
+}
+
+static void
+on_demuxer_pad_added(GstElement *element, GstPad *pad, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    /* the demuxer removes its pads when it stops and adds them again
+    for the next file, a delayed link from gst_element_link only
+    happens once, so link them ourselves every time */
+    GstPad *queue_sink_pad = gst_element_get_static_pad(player_bin->queue,
+        "sink");
+
+    if(!gst_pad_is_linked(queue_sink_pad)) {
+        if(gst_pad_link(pad, queue_sink_pad) != GST_PAD_LINK_OK) {
+            printf("[wrn] could not link demuxer pad\n");
+        }
+    }
+
+    GSTREAMER_FREE(queue_sink_pad);
+}
+
+static void
+on_gap_need_data(GstAppSrc *source, guint length, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    if(!player_bin->gap_frame ||
+        player_bin->gap_position >= player_bin->gap_duration) {
+        gst_app_src_end_of_stream(source);
+        return;
+    }
+
+    /* the same frame over and over, nothing is encoded or even
+    copied, the last one is shorter if the gap is not a multiple
+    of the interval */
+    uint64_t duration = MIN(GCS_GAP_FRAME_INTERVAL,
+        player_bin->gap_duration - player_bin->gap_position);
+
+    GstBuffer *buffer = gcs_gap_frame_new_buffer(player_bin->gap_frame,
+        player_bin->gap_position, duration);
+
+    player_bin->gap_position += duration;
+    gst_app_src_push_buffer(source, buffer);
+}
+
+static GstElement *
+gcs_player_bin_build_gap_bin(GcsPlayerBin *player_bin)
+{
+    /* an encoded frame, it goes through the same parser and decoder
+    as the chunks do, which frame (and caps) depends on the size of
+    the chunks, so it's picked when a gap is prepared */
+    player_bin->source = gst_element_factory_make("appsrc", NULL);
+
+    GstAppSrcCallbacks callbacks = { 0 };
+    callbacks.need_data = on_gap_need_data;
+
+    gst_app_src_set_callbacks(GST_APP_SRC(player_bin->source), &callbacks,
+        player_bin, NULL);
+
+    g_object_set(player_bin->source, "format", GST_FORMAT_TIME, NULL);
+
+    gst_bin_add(GST_BIN(player_bin->bin), player_bin->source);
+    return player_bin->source;
+}
+
+static void
+on_fallback_pad_added(GstElement *demuxer, GstPad *pad, gpointer user_data)
+{
+    GstElement *sink = GST_ELEMENT(user_data);
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+
+    /* the recorder writes a single track, the first pad is it */
+    if(!gst_pad_is_linked(sink_pad)) {
+        gst_pad_link(pad, sink_pad);
+    }
+
+    GSTREAMER_FREE(sink_pad);
+}
+
+static int
+gcs_player_bin_start_fallback(GcsPlayerBin *player_bin)
+{
+    if(!player_bin->filename) {
+        return 0;
+    }
+
+    GstElement *pipeline = gst_pipeline_new(NULL);
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *demuxer = gst_element_factory_make("matroskademux", NULL);
+    GstElement *sink = gst_element_factory_make("appsink", "sink");
+
+    gst_bin_add_many(GST_BIN(pipeline), source, demuxer, sink, NULL);
+    gst_element_link(source, demuxer);
+
+    g_signal_connect(demuxer, "pad-added",
+        G_CALLBACK(on_fallback_pad_added), sink);
+
+    /* frames are handed over as fast as the bin asks for them */
+    g_object_set(source, "location", player_bin->filename, NULL);
+    g_object_set(sink, "sync", FALSE, NULL);
+
+    /* prerolled, so the demuxer knows the file and can seek */
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+
+    if(gst_element_get_state(pipeline, NULL, NULL,
+        GCS_PLAYER_FALLBACK_TIMEOUT) != GST_STATE_CHANGE_SUCCESS ||
+        !gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+            GST_SEEK_FLAG_SNAP_BEFORE, (gint64) player_bin->keyframe_time)) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        GSTREAMER_FREE(pipeline);
+        return 0;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    player_bin->fallback = pipeline;
+    player_bin->fallback_skip = -1;
+    g_atomic_int_inc(&player_bin->late_fallbacks);
+
+    return 1;
+}
+
+static GstBuffer *
+gcs_player_bin_next_fallback_buffer(GcsPlayerBin *player_bin)
+{
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(player_bin->fallback),
+        "sink");
+
+    GstBuffer *buffer = NULL;
+
+    while(!buffer) {
+        /* a timeout instead of waiting forever, a fallback that
+        errors out never reaches the end of the stream */
+        GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink),
+            GCS_PLAYER_FALLBACK_TIMEOUT);
+
+        if(!sample) {
+            break;
+        }
+
+        GstBuffer *sample_buffer = gst_sample_get_buffer(sample);
+        GstClockTime pts = GST_BUFFER_PTS(sample_buffer);
+        int keyframe = !GST_BUFFER_FLAG_IS_SET(sample_buffer,
+            GST_BUFFER_FLAG_DELTA_UNIT);
+
+        /* the demuxer snaps to the keyframe the reader last passed,
+        or one before it, the frames from there on are counted and
+        not compared by timestamp, b-frames come out of order */
+        if(player_bin->fallback_skip < 0 && keyframe &&
+            GST_CLOCK_TIME_IS_VALID(pts) && pts >= player_bin->keyframe_time) {
+            player_bin->fallback_skip = player_bin->keyframe_frames;
+        }
+
+        if(player_bin->fallback_skip > 0) {
+            player_bin->fallback_skip--;
+        } else if(player_bin->fallback_skip == 0 &&
+            GST_CLOCK_TIME_IS_VALID(pts)) {
+            buffer = gst_buffer_ref(sample_buffer);
+        }
+
+        gst_sample_unref(sample);
+    }
+
+    GSTREAMER_FREE(sink);
+    return buffer;
+}
+
+static void
+on_mkv_need_data(GstAppSrc *source, guint length, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    GcsMkvFrame frame;
+    int ret = 0;
+
+    if(player_bin->fallback) {
+        GstBuffer *buffer = gcs_player_bin_next_fallback_buffer(player_bin);
+
+        if(!buffer) {
+            gst_app_src_end_of_stream(source);
+            return;
+        }
+
+        /* timestamped like the frames the reader pushed before it */
+        buffer = gst_buffer_make_writable(buffer);
+
+        GST_BUFFER_PTS(buffer) = GST_BUFFER_PTS(buffer) >
+            player_bin->time_offset ?
+            GST_BUFFER_PTS(buffer) - player_bin->time_offset : 0;
+        GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+
+        gst_app_src_push_buffer(source, buffer);
+        return;
+    }
+
+    if(player_bin->reader) {
+        ret = gcs_mkv_reader_next(player_bin->reader, &frame);
+    }
+
+    /* it was all checked when the chunk was opened, so this is a
+    block the reader doesn't support halfway, matroskademux reads
+    on from where it stopped, without ending the stream */
+    if(ret < 0 && gcs_player_bin_start_fallback(player_bin)) {
+        on_mkv_need_data(source, length, user_data);
+        return;
+    }
+
+    /* a chunk that was cut off (or broken) halfway */
+    if(ret <= 0) {
+        if(ret < 0) {
+            printf("[wrn] unsupported block in chunk, skipping the rest\n");
+        }
+
+        gst_app_src_end_of_stream(source);
+        return;
+    }
+
+    if(frame.keyframe) {
+        player_bin->keyframe_time = frame.time;
+        player_bin->keyframe_frames = 0;
+    }
+
+    player_bin->keyframe_frames++;
+
+    /* the frame is not copied, the buffer points into the block
+    the reader read it in, with the rest of its cluster */
+    GstBuffer *buffer = gcs_gst_new_frame_buffer(&frame);
+
+    /* started at a keyframe in the middle of the chunk, that's where
+    time starts too, like the segment of a seeked demuxer would
+
+    matroska only stores presentation times, so there's no DTS, like
+    matroskademux, which the chunks used to go through, the decoder
+    reorders by PTS itself and the parser works out the rest */
+    GST_BUFFER_PTS(buffer) = frame.time > player_bin->time_offset ?
+        frame.time - player_bin->time_offset : 0;
+
+    gst_app_src_push_buffer(source, buffer);
+}
+
+static GstClockTime
+gcs_player_bin_scale_time(GstClockTime time, double rate)
+{
+    if(!GST_CLOCK_TIME_IS_VALID(time)) {
+        return time;
+    }
+
+    return (GstClockTime) (time / rate);
+}
+
+static GstPadProbeReturn
+on_bin_rate_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+    double rate = ABS(player_bin->rate);
+
+    /* without a decoder to put the frames of a GOP back in order,
+    backwards can only be keyframes */
+    int keyframes_only = rate >= GCS_PLAYER_KEYFRAME_RATE ||
+        (player_bin->rate < 0 && !player_bin->enable_decoder);
+
+    if(rate == 1.0 && !keyframes_only) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    if(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+        /* fast enough that decoding every frame costs more than it
+        adds, the keyframes alone look like fast forward */
+        if(keyframes_only &&
+            GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+            g_atomic_int_inc(&player_bin->dropped_frames);
+            return GST_PAD_PROBE_DROP;
+        }
+
+        /* squeeze (or stretch) the chunk in time, the sink then
+        plays it at the rate as it would any other stream */
+        buffer = gst_buffer_make_writable(buffer);
+
+        GST_BUFFER_PTS(buffer) = gcs_player_bin_scale_time(
+            GST_BUFFER_PTS(buffer), rate);
+        GST_BUFFER_DTS(buffer) = gcs_player_bin_scale_time(
+            GST_BUFFER_DTS(buffer), rate);
+        GST_BUFFER_DURATION(buffer) = gcs_player_bin_scale_time(
+            GST_BUFFER_DURATION(buffer), rate);
+
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
     } else {
-        player_bin->decoder = gst_element_factory_make("queue", NULL);
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        /* the segment has to match the timestamps, or buffers
+        would be clipped after a seek into the chunk */
+        if(GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            GstSegment segment;
+            gst_event_copy_segment(event, &segment);
+
+            segment.start = gcs_player_bin_scale_time(segment.start, rate);
+            segment.stop = gcs_player_bin_scale_time(segment.stop, rate);
+            segment.position = gcs_player_bin_scale_time(segment.position,
+                rate);
+
+            gst_event_unref(event);
+            GST_PAD_PROBE_INFO_DATA(info) = gst_event_new_segment(&segment);
+        }
     }
 
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+on_source_read_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GcsPlayerBin *player_bin = (GcsPlayerBin *) user_data;
+
+    /* only the bin's streaming thread reads */
+    player_bin->bytes_read += gst_buffer_get_size(
+        GST_PAD_PROBE_INFO_BUFFER(info));
+
+    return GST_PAD_PROBE_OK;
+}
+
+static GstElement *
+gcs_player_bin_build_chunk_bin(GcsPlayerBin *player_bin)
+{
+    /* parsing and decoding happens after concat, for all
+    chunks, the bin only reads and demuxes */
+    player_bin->source = gst_element_factory_make("filesrc", NULL);
+    player_bin->demuxer = gst_element_factory_make("matroskademux", NULL);
+    player_bin->queue = gst_element_factory_make("queue", NULL);
+
     gst_bin_add_many(GST_BIN(player_bin->bin), player_bin->source,
-        player_bin->demuxer, player_bin->queue, player_bin->parser,
-        player_bin->capsfilter, player_bin->decoder, NULL);
+        player_bin->demuxer, player_bin->queue, NULL);
 
-    gst_element_link_many(player_bin->source, player_bin->demuxer,
-        player_bin->queue, player_bin->parser, player_bin->capsfilter,
-        player_bin->decoder, NULL);
+    gst_element_link(player_bin->source, player_bin->demuxer);
 
-    /* get the src pad of the decoder (last element in the bin), so
-    we can create a ghost pad for it on the bin */
-    GstPad *decoder_src_pad = gst_element_get_static_pad(player_bin->decoder,
+    /* the demuxer pulls from the source, the probe sees those too */
+    GstPad *source_src_pad = gst_element_get_static_pad(player_bin->source,
+        "src");
+
+    gst_pad_add_probe(source_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        on_source_read_probe, player_bin, NULL);
+
+    GSTREAMER_FREE(source_src_pad);
+
+    /* the demuxer only has pads once it's reading a file */
+    g_signal_connect(player_bin->demuxer, "pad-added",
+        G_CALLBACK(on_demuxer_pad_added), player_bin);
+
+    /* drop and rescale frames right after the demuxer, so dropped
+    frames are never queued, parsed or decoded */
+    GstPad *queue_sink_pad = gst_element_get_static_pad(player_bin->queue,
+        "sink");
+
+    gst_pad_add_probe(queue_sink_pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, on_bin_rate_probe, player_bin,
+        NULL);
+
+    GSTREAMER_FREE(queue_sink_pad);
+    return player_bin->queue;
+}
+
+static GstElement *
+gcs_player_bin_build_mkv_bin(GcsPlayerBin *player_bin)
+{
+    /* the reader hands over whole frames, so there's no demuxer,
+    nor a queue, appsrc has one of its own */
+    player_bin->source = gst_element_factory_make("appsrc", NULL);
+
+    GstAppSrcCallbacks callbacks = { 0 };
+    callbacks.need_data = on_mkv_need_data;
+
+    gst_app_src_set_callbacks(GST_APP_SRC(player_bin->source), &callbacks,
+        player_bin, NULL);
+
+    g_object_set(player_bin->source, "format", GST_FORMAT_TIME, NULL);
+    gst_bin_add(GST_BIN(player_bin->bin), player_bin->source);
+
+    GstPad *source_src_pad = gst_element_get_static_pad(player_bin->source,
         "src");
 
+    gst_pad_add_probe(source_src_pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, on_bin_rate_probe, player_bin,
+        NULL);
+
+    GSTREAMER_FREE(source_src_pad);
+    return player_bin->source;
+}
+
+GcsPlayerBin *
+gcs_player_bin_new(GcsPlayerBinType type, int enable_decoder)
+{
+    GcsPlayerBin *player_bin = ALLOC_NULL(GcsPlayerBin *, sizeof(GcsPlayerBin));
+    player_bin->type = type;
+    player_bin->rate = 1.0;
+    player_bin->enable_decoder = enable_decoder;
+    player_bin->bin = gst_bin_new(NULL);
+
+    GstElement *last_element = NULL;
+    if(type == GCS_PLAYER_BIN_TYPE_GAP) {
+        last_element = gcs_player_bin_build_gap_bin(player_bin);
+    } else if(type == GCS_PLAYER_BIN_TYPE_MKV) {
+        last_element = gcs_player_bin_build_mkv_bin(player_bin);
+    } else {
+        last_element = gcs_player_bin_build_chunk_bin(player_bin);
+    }
+
+    /* get the src pad of the last element in the bin, so
+    we can create a ghost pad for it on the bin */
+    GstPad *last_src_pad = gst_element_get_static_pad(last_element, "src");
+
     /* add a ghost pad to the bin that is linked to the src pad
-    of the decoder, this allows us to link the bin to other elements */
+    of the last element, this allows us to link the bin to other elements */
     gst_element_add_pad(player_bin->bin, gst_ghost_pad_new("src",
-        decoder_src_pad));
+        last_src_pad));
+
+    g_object_unref(last_src_pad);
 
-    g_object_unref(decoder_src_pad);
+    /* unused bins stay in the NULL state, whatever the state of
+    the pipeline is, until they're started */
+    gst_element_set_locked_state(player_bin->bin, TRUE);
     return player_bin;
 }
+
+void
+gcs_player_bin_free(GcsPlayerBin *player_bin)
+{
+    /* the elements belong to the pipeline the bin was added to,
+    the fallback does not */
+    if(player_bin->fallback) {
+        gst_element_set_state(player_bin->fallback, GST_STATE_NULL);
+        GSTREAMER_FREE(player_bin->fallback);
+    }
+
+    g_free(player_bin->filename);
+    free(player_bin);
+}
@@ -6,51 +6,260 @@
 #include <gst/gst.h>
 
 #include <gcs/index.h>
+#include <gcs/gap.h>
+#include <gcs/mkv.h>
+#include <gcs/readahead.h>
+#include <gcs/metrics.h>
 
 #define GCS_PLAYER_DEFAULT_BIN_COUNT 2
 
+/* one bin plays, the rest prepare the chunks after it, more than
+this does not help and costs a file handle and memory per bin */
+#define GCS_PLAYER_MAX_BIN_COUNT 16
+
+/* from this rate on, only keyframes are played, every other frame
+is dropped before it is parsed or decoded */
+#define GCS_PLAYER_KEYFRAME_RATE 2.0
+
+/* longest the matroskademux that takes over from a reader that gave
+up halfway may take to start, or to hand over a frame */
+#define GCS_PLAYER_FALLBACK_TIMEOUT (5 * GST_SECOND)
+
+/* switches that take longer than this (in microseconds) are
+counted in the stats, they point at slow storage or a broken chunk */
+#define GCS_PLAYER_SLOW_SWITCH_TIME 500000
+
+/* how long a gap lasts when it's shortened to a marker */
+#define GCS_PLAYER_DEFAULT_MARKER_DURATION 1000000000
+
+/* what to do with the gaps between chunks, the running time of the
+output stays continuous either way, it just doesn't include (all of)
+the gaps, the wall clock moments of what's playing are posted on the
+bus as "gcs-chunk" element messages */
+typedef enum {
+    GCS_PLAYER_GAP_MODE_PLAY = 0,
+    GCS_PLAYER_GAP_MODE_SKIP = 1,
+    GCS_PLAYER_GAP_MODE_MARKER = 2
+} GcsPlayerGapMode;
+
+/* chunks are read by GcsMkvReader (the mkv type) when it understands
+them, which it does for anything the recorder wrote, the others,
+and chunks played backwards, go through matroskademux */
 typedef enum {
     GCS_PLAYER_BIN_TYPE_CHUNK = 0,
-    GCS_PLAYER_BIN_TYPE_GAP = 1
+    GCS_PLAYER_BIN_TYPE_GAP = 1,
+    GCS_PLAYER_BIN_TYPE_MKV = 2
 } GcsPlayerBinType;
 
+/* bins are built once for one type and are only ever re-used
+for that type, gap and mkv bins only have a source, parsing and
+decoding is done by the player after concat */
 typedef struct {
     GstElement *bin;
     GstElement *source;
     GstElement *demuxer;
     GstElement *queue;
-    GstElement *parser;
-    GstElement *capsfilter;
-    GstElement *decoder;
 
     GcsPlayerBinType type;
 
     int linked;
+
+    /* wall clock moments of the chunk (or gap) the bin plays */
+    uint64_t start_moment;
+    uint64_t stop_moment;
+
+    /* moment (relative to the start of the chunk) of the keyframe
+    to start playing at, the demuxer is seeked to it as soon as
+    it produces data, when playing backwards, it's the moment to
+    stop at (zero for the end of the chunk) */
+    uint64_t seek_time;
+    gulong seek_probe;
+    int seek_pending;
+
+    /* set once the first buffer left the bin, which means it's
+    prerolled and concat can switch to it without waiting */
+    gint ready;
+    gulong ready_probe;
+
+    /* set once concat switched away from the bin, it can only be
+    re-used from then on */
+    gint finished;
+
+    /* reader that feeds an mkv bin, opened when the chunk is
+    prepared, frames are timestamped from the one it starts at */
+    GcsMkvReader *reader;
+    uint64_t time_offset;
+
+    /* when the reader gives up halfway through the chunk, a pipeline
+    of its own with matroskademux takes over from the last keyframe,
+    the frames from there on that were pushed already (including the
+    keyframe) are skipped, -1 until the keyframe came by, all of it
+    only touched by the bin's streaming thread */
+    char *filename;
+    GstElement *fallback;
+    uint64_t keyframe_time;
+    int keyframe_frames;
+    int fallback_skip;
+
+    /* frame that a gap bin repeats until it covered the
+    duration of the gap */
+    GcsGapFrame *gap_frame;
+    uint64_t gap_duration;
+    uint64_t gap_position;
+
+    /* rate the chunk plays at, its timestamps are divided by it,
+    fixed while the bin plays */
+    double rate;
+    int enable_decoder;
+
+    /* the worker thread of the player the bin belongs to, and the
+    lock that keeps it from changing bins while others do */
+    GMainContext *context;
+    GMutex *lock;
+
+    /* frames dropped because they were not keyframes, only
+    updated from the bin's streaming thread */
+    gint dropped_frames;
+
+    /* chunks the reader gave up on halfway, same as above */
+    gint late_fallbacks;
+
+    /* read from the chunk's file by the demuxer, mkv bins
+    have the reader count it instead */
+    gint64 bytes_read;
 } GcsPlayerBin;
 
+typedef struct {
+    /* switches between bins, and how many of those switched to
+    a bin that did not have any data yet (and had to wait for it) */
+    gint switches;
+    gint not_ready;
+
+    /* time spent recycling a bin and preparing the next chunk on
+    it, only updated with the player's lock held */
+    gint64 prepare_time;
+    gint64 max_prepare_time;
+    int prepared;
+
+    int skipped_gaps;
+
+    /* chunks played forward that the reader refused, and that
+    went through matroskademux instead */
+    int fallbacks;
+
+    /* from calling gcs_player_seek until the first frame leaves
+    concat, written from the streaming thread */
+    gint seeks;
+    gint64 seek_time;
+    gint64 max_seek_time;
+
+    /* switches that took longer than GCS_PLAYER_SLOW_SWITCH_TIME */
+    gint slow_switches;
+
+    /* caps that reached the parser and were different from the
+    ones before it, which makes the parser and decoder start over */
+    gint caps_changes;
+
+    /* longest time between two frames leaving the decoder, written
+    from the streaming thread */
+    gint64 last_frame_time;
+    gint64 max_frame_interval;
+
+    /* times the multiqueue after the decoder ran empty */
+    gint underruns;
+} GcsPlayerStats;
+
 typedef struct {
     GcsIndexIterator *index_itr;
 
     GstElement *pipeline;
     GstElement *concat;
+    GstElement *parser;
+    GstElement *decoder;
     GstElement *multiqueue;
     GstElement *sink;
 
+    /* every bin, built up front and never changed after that,
+    so that it can be looked through from the streaming thread */
     GPtrArray *bins;
-    int next_bin_index;
+
+    /* bins linked to concat in the order they play in, the first
+    one is playing, the rest are prepared behind it */
+    GQueue *active_bins;
+
+    /* bins that are built but not used, one per type */
+    GQueue *chunk_bins;
+    GQueue *gap_bins;
+    GQueue *mkv_bins;
+
+    int bin_count;
+
+    /* offset into the next chunk to start playing at, instead of
+    at its start, used once and reset */
+    uint64_t start_offset;
+
+    GcsPlayerGapMode gap_mode;
+    uint64_t marker_duration;
+
+    double rate;
+
+    /* how many chunks after the prepared ones are read ahead, and
+    the files this player read ahead that it didn't prepare yet */
+    int readahead_count;
+    GQueue *readahead_files;
+
+    /* when the last seek started, and the probe that waits for
+    the first frame after it, 0 once that left concat */
+    gint64 seek_start_time;
+    gulong seek_probe;
+
+    /* when concat last switched, until the first frame of the chunk
+    it switched to leaves it, set from the streaming thread of the
+    chunk and taken by that of concat, so only touched atomically */
+    gint64 switch_time;
+
+    /* caps that were last let through to the parser */
+    GstCaps *caps;
+
+    /* size of the video of the last chunk the reader opened, gaps
+    are filled with a frame of the same size, 0 until then */
+    int video_width;
+    int video_height;
+
+    /* bins are prepared on this thread, which runs a loop on its own
+    context, the lock is held while bins are changed, by it or by
+    any of the functions below */
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    GMutex lock;
+
+    /* updated from the streaming thread, read with g_atomic_int_get */
+    GcsPlayerStats stats;
 
 } GcsPlayer;
 
 #define GCS_PLAYER(x) ((GcsPlayer *)x);
 
 GcsPlayer *     gcs_player_new(GcsIndexIterator *index_itr,
-                    const char *sink_type, const char *sink_name, int enable_decoder);
+                    const char *sink_type, const char *sink_name, int enable_decoder,
+                    int bin_count);
 
+void            gcs_player_set_start_offset(GcsPlayer *player,
+                    uint64_t start_offset);
+void            gcs_player_set_gap_mode(GcsPlayer *player,
+                    GcsPlayerGapMode gap_mode, uint64_t marker_duration);
+void            gcs_player_set_rate(GcsPlayer *player, double rate);
+void            gcs_player_set_readahead(GcsPlayer *player, int chunk_count);
 void            gcs_player_prepare(GcsPlayer *player);
 void            gcs_player_play(GcsPlayer *player);
+int             gcs_player_seek(GcsPlayer *player, uint64_t moment);
 void            gcs_player_connect_signal(GcsPlayer *player, GCallback callback, gpointer user_data);
 void            gcs_player_stop(GcsPlayer *player);
+void            gcs_player_print_stats(GcsPlayer *player);
 void            gcs_player_free(GcsPlayer *player);
-GcsPlayerBin *  gcs_player_bin_new();
+GcsPlayerBin *  gcs_player_bin_new(GcsPlayerBinType type,
+                    int enable_decoder);
+void            gcs_player_bin_free(GcsPlayerBin *player_bin);
 
 #endif /* __gst_chunks_shared_player_h */
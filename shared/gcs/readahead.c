@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <gcs/mem.h>
+#include <gcs/readahead.h>
+
+typedef struct {
+    uint64_t size;
+
+    /* players that asked for the file and didn't release it yet */
+    int users;
+} GcsReadaheadFile;
+
+static GMutex readahead_lock;
+static GThreadPool *readahead_pool;
+static GHashTable *readahead_files;
+static uint64_t readahead_budget = GCS_READAHEAD_DEFAULT_BUDGET;
+static GcsReadaheadStats readahead_stats;
+
+static void
+readahead_file(gpointer data, gpointer user_data)
+{
+    char *filename = (char *) data;
+
+    /* WILLNEED starts reading the whole file, the reads themselves
+    happen in the background, but getting them queued can block for
+    a while on a busy disk, which is why it happens here and not on
+    the thread of the player */
+    int fd = open(filename, O_RDONLY);
+    if(fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+
+    g_free(filename);
+}
+
+static void
+readahead_init()
+{
+    if(readahead_pool) {
+        return;
+    }
+
+    /* like the gap frames, made once and kept for as long as
+    the process runs */
+    readahead_pool = g_thread_pool_new(readahead_file, NULL,
+        GCS_READAHEAD_THREAD_COUNT, FALSE, NULL);
+    readahead_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        free);
+}
+
+void
+gcs_readahead_set_budget(uint64_t budget)
+{
+    /* files that are read ahead already stay, until they're
+    released, even when that's more than the new budget */
+    g_mutex_lock(&readahead_lock);
+    readahead_budget = budget;
+    g_mutex_unlock(&readahead_lock);
+}
+
+int
+gcs_readahead_warm(const char *filename)
+{
+    /* the size is looked up before taking the lock, the index
+    just listed the directory, so it's cheap */
+    struct stat file_info;
+    if(stat(filename, &file_info) != 0 || file_info.st_size <= 0) {
+        return 0;
+    }
+
+    uint64_t size = (uint64_t) file_info.st_size;
+
+    g_mutex_lock(&readahead_lock);
+    readahead_init();
+
+    /* another player is about to play the same file */
+    GcsReadaheadFile *file = g_hash_table_lookup(readahead_files, filename);
+    if(file) {
+        file->users++;
+        g_mutex_unlock(&readahead_lock);
+        return 1;
+    }
+
+    if((uint64_t) readahead_stats.used_bytes + size > readahead_budget) {
+        readahead_stats.skipped++;
+        g_mutex_unlock(&readahead_lock);
+        return 0;
+    }
+
+    file = ALLOC_NULL(GcsReadaheadFile *, sizeof(GcsReadaheadFile));
+    file->size = size;
+    file->users = 1;
+
+    g_hash_table_insert(readahead_files, g_strdup(filename), file);
+
+    readahead_stats.used_bytes += size;
+    readahead_stats.warmed++;
+    readahead_stats.warmed_bytes += size;
+
+    g_thread_pool_push(readahead_pool, g_strdup(filename), NULL);
+
+    g_mutex_unlock(&readahead_lock);
+    return 1;
+}
+
+void
+gcs_readahead_release(const char *filename)
+{
+    g_mutex_lock(&readahead_lock);
+
+    GcsReadaheadFile *file = NULL;
+    if(readahead_files) {
+        file = g_hash_table_lookup(readahead_files, filename);
+    }
+
+    if(file && --file->users <= 0) {
+        readahead_stats.used_bytes -= file->size;
+        g_hash_table_remove(readahead_files, filename);
+    }
+
+    g_mutex_unlock(&readahead_lock);
+}
+
+void
+gcs_readahead_get_stats(GcsReadaheadStats *stats)
+{
+    g_mutex_lock(&readahead_lock);
+    *stats = readahead_stats;
+    g_mutex_unlock(&readahead_lock);
+}
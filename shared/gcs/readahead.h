@@ -0,0 +1,47 @@
+#ifndef __gst_chunks_shared_readahead_h
+#define __gst_chunks_shared_readahead_h
+
+#include <stdint.h>
+
+#include <glib.h>
+
+/* how many chunks after the ones that are prepared a player
+reads ahead, by default */
+#define GCS_READAHEAD_DEFAULT_CHUNK_COUNT 2
+
+/* most bytes that can be read ahead (and not played yet) at once,
+by all players in the process together, so many sessions at once
+don't push each other's chunks out of the page cache */
+#define GCS_READAHEAD_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+/* files are read ahead by this many threads, a couple, so a slow
+disk doesn't hold up read-ahead on the others */
+#define GCS_READAHEAD_THREAD_COUNT 4
+
+typedef struct {
+    /* files that were read ahead, and their size */
+    gint warmed;
+    gint64 warmed_bytes;
+
+    /* files that were not, because the budget was used up */
+    gint skipped;
+
+    /* bytes read ahead that weren't played yet */
+    gint64 used_bytes;
+} GcsReadaheadStats;
+
+/* the read-ahead state is shared by every player in the process, a
+file that several players are about to play counts once */
+void    gcs_readahead_set_budget(uint64_t budget);
+
+/* asks the kernel to read the file into the page cache, in the
+background, returns 0 when it doesn't fit in the budget, each call
+that returns 1 needs a call to gcs_readahead_release */
+int     gcs_readahead_warm(const char *filename);
+
+/* the file is being played (or won't be), what it took of the
+budget is available again */
+void    gcs_readahead_release(const char *filename);
+void    gcs_readahead_get_stats(GcsReadaheadStats *stats);
+
+#endif /* __gst_chunks_shared_readahead_h */
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <gcs/watch.h>
+#include <gcs/mapped.h>
+
+#if defined(__linux__)
+#   include <unistd.h>
+#   include <sys/inotify.h>
+#   include <glib-unix.h>
+#endif
+
+#if defined(__linux__)
+
+/* a chunk is done when the recorder closes it, or when it's
+moved into the directory (after being written elsewhere) */
+#define WATCH_ADD_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/* old chunks being deleted or moved away to free up space */
+#define WATCH_REMOVE_EVENTS (IN_DELETE | IN_MOVED_FROM)
+
+/* the recorder writes its chunk list through a mapping, which
+inotify doesn't tell us about, so it touches the file after every
+record it adds */
+#define WATCH_LIST_EVENTS (IN_ATTRIB)
+
+#define WATCH_EVENTS (WATCH_ADD_EVENTS | WATCH_REMOVE_EVENTS | \
+    WATCH_LIST_EVENTS)
+
+static int
+find_directory(GcsIndex *index, int watch_descriptor)
+{
+    guint i;
+    for(i = 0; i < index->watch_descriptors->len; ++i) {
+        if(g_array_index(index->watch_descriptors, int, i) ==
+            watch_descriptor) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+static gboolean
+on_watch_event(gint fd, GIOCondition condition, gpointer user_data)
+{
+    GcsIndex *index = (GcsIndex *) user_data;
+
+    /* buffer large enough for a bunch of events, and aligned
+    the way inotify expects it to be */
+    char buffer[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if(len <= 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    char *position = buffer;
+    while(position < buffer + len) {
+        struct inotify_event *event = (struct inotify_event *) position;
+        position += sizeof(struct inotify_event) + event->len;
+
+        if(event->len == 0 || (event->mask & IN_ISDIR)) {
+            continue;
+        }
+
+        if(strcmp(event->name, GCS_MAPPED_FILENAME) == 0 &&
+            (event->mask & WATCH_LIST_EVENTS)) {
+            if(gcs_index_refresh(index) > 0) {
+                printf("[inf] added chunks from the chunk list to the index\n");
+            }
+
+            continue;
+        }
+
+        /* hidden files, such as our own cache, and attributes
+        of chunks changing */
+        if(event->name[0] == '.' ||
+            !(event->mask & (WATCH_ADD_EVENTS | WATCH_REMOVE_EVENTS))) {
+            continue;
+        }
+
+        int directory = find_directory(index, event->wd);
+        if(directory < 0) {
+            continue;
+        }
+
+        if(event->mask & WATCH_REMOVE_EVENTS) {
+            if(gcs_index_remove_file(index, directory, event->name) >= 0) {
+                printf("[inf] removed chunk '%s' from the index\n",
+                    event->name);
+            }
+
+            continue;
+        }
+
+        /* the recorder lists the files it writes after closing them,
+        which saves probing them */
+        if(gcs_index_is_listed_later(index, directory, event->name)) {
+            continue;
+        }
+
+        if(gcs_index_append_file(index, directory, event->name) > 0) {
+            printf("[inf] added chunk '%s' to the index\n", event->name);
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+int
+gcs_index_watch(GcsIndex *index)
+{
+    if(!index || index->watch_source) {
+        return 0;
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0) {
+        fprintf(stderr, "[err] could not initialize inotify\n");
+        return 0;
+    }
+
+    index->watch_descriptors = g_array_new(FALSE, TRUE, sizeof(int));
+
+    guint i;
+    for(i = 0; i < index->directories->len; ++i) {
+        const char *directory = g_ptr_array_index(index->directories, i);
+        int watch_descriptor = inotify_add_watch(fd, directory, WATCH_EVENTS);
+
+        if(watch_descriptor < 0) {
+            fprintf(stderr, "[err] could not watch '%s'\n", directory);
+        }
+
+        /* keep the positions in sync with the directories, even
+        for directories we could not watch */
+        g_array_append_val(index->watch_descriptors, watch_descriptor);
+    }
+
+    index->watch_fd = fd;
+    index->watch_source = g_unix_fd_add(fd, G_IO_IN, on_watch_event, index);
+
+    /* records added between the fill and now */
+    gcs_index_refresh(index);
+
+    return 1;
+}
+
+void
+gcs_index_unwatch(GcsIndex *index)
+{
+    if(!index || !index->watch_source) {
+        return;
+    }
+
+    g_source_remove(index->watch_source);
+    index->watch_source = 0;
+
+    close(index->watch_fd);
+    index->watch_fd = -1;
+
+    g_array_free(index->watch_descriptors, TRUE);
+    index->watch_descriptors = NULL;
+}
+
+#else
+
+int
+gcs_index_watch(GcsIndex *index)
+{
+    /* only supported on linux */
+    return 0;
+}
+
+void
+gcs_index_unwatch(GcsIndex *index)
+{
+}
+
+#endif
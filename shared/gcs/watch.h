@@ -0,0 +1,13 @@
+#ifndef __gst_chunks_shared_watch_h
+#define __gst_chunks_shared_watch_h
+
+#include <gcs/index.h>
+
+/* watches the directories of an index for chunks that are finished
+after the index was filled (by chunk-recorder) and appends them, and
+removes chunks that are deleted, the events are handled on the default
+main context, which makes that thread the writer of the index */
+int     gcs_index_watch(GcsIndex *index);
+void    gcs_index_unwatch(GcsIndex *index);
+
+#endif /* __gst_chunks_shared_watch_h */